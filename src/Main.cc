@@ -1,13 +1,28 @@
 #include <server/Server.h>
 #include <logger/AsyncLogger.h>
 
+#include <algorithm>
+#include <thread>
+
 int main()
 {
+    // I/O线程从2个开始, 负载高时最多增加到CPU数的2倍; 磁盘线程在阻塞读取时按需增加
+    int cpus = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    // 磁盘跟不上时先丢弃DEBUG/INFO日志, 不阻塞处理请求的线程
+    AsyncLogger::getInstance().setOverflow(LogOverflow::DROP_BY_LEVEL);
     Server server(3333,
-                  6,
+                  2, std::max(2, cpus * 2), 8,
                   false, LogLevel::DEBUG, "./log",
                   ".log", 5000, 1024);
 
+    // 证书不存在时只提供HTTP服务, 测试证书可以通过 test/gen_cert.sh 生成
+    server.listenHttps(3334, "../certs/server.crt", "../certs/server.key");
+
+    // 快照不存在时直接从 resources 目录提供服务, 快照可以通过 cmake --build <构建目录> --target snapshot 生成
+    SnapshotOptions snapshot_options;
+    snapshot_options.populate = true;
+    server.useSnapshot("../resources.snap", snapshot_options);
+
     server.run();
     return 0;
 }
@@ -0,0 +1,108 @@
+#include <buffer/Arena.h>
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+using std::string_view;
+
+Arena::Arena(Arena &&other)
+  : blocks_(other.blocks_),
+    pos_(other.pos_),
+    end_(other.end_),
+    large_(other.large_)
+{
+    other.blocks_ = other.large_ = nullptr;
+    other.pos_ = other.end_ = nullptr;
+}
+
+Arena &Arena::operator=(Arena &&other)
+{
+    if (this != &other)
+    {
+        reset();
+        std::swap(blocks_, other.blocks_);
+        std::swap(pos_, other.pos_);
+        std::swap(end_, other.end_);
+        std::swap(large_, other.large_);
+    }
+    return *this;
+}
+
+void *Arena::allocate(size_t len, size_t align)
+{
+    if (len > LARGE_SIZE)
+    {
+        // 大块内存单独申请, 同样在reset()时释放
+        auto *block = static_cast<Block *>(::operator new(BLOCK_HEADER + len));
+        block->next = large_;
+        large_ = block;
+        return reinterpret_cast<char *>(block) + BLOCK_HEADER;
+    }
+    auto aligned = [align](char *p) {
+        auto addr = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char *>((addr + align - 1) & ~(static_cast<uintptr_t>(align) - 1));
+    };
+    if (!pos_ || aligned(pos_) + len > end_)
+    {
+        newSlab();
+    }
+    char *p = aligned(pos_);
+    pos_ = p + len;
+    return p;
+}
+
+char *Arena::copy(const char *data, size_t len)
+{
+    auto *p = static_cast<char *>(allocate(len + 1, 1));
+    std::memcpy(p, data, len);
+    p[len] = '\0';
+    return p;
+}
+
+string_view Arena::concat(std::initializer_list<string_view> parts)
+{
+    size_t len = 0;
+    for (string_view part : parts)
+    {
+        len += part.size();
+    }
+    auto *p = static_cast<char *>(allocate(len + 1, 1));
+    size_t pos = 0;
+    for (string_view part : parts)
+    {
+        std::memcpy(p + pos, part.data(), part.size());
+        pos += part.size();
+    }
+    p[len] = '\0';
+    return string_view(p, len);
+}
+
+void Arena::reset()
+{
+    SlabPool &pool = SlabPool::getInstance();
+    while (blocks_)
+    {
+        Block *next = blocks_->next;
+        pool.release(reinterpret_cast<Slab *>(blocks_));
+        blocks_ = next;
+    }
+    while (large_)
+    {
+        Block *next = large_->next;
+        ::operator delete(large_);
+        large_ = next;
+    }
+    pos_ = end_ = nullptr;
+}
+
+void Arena::newSlab()
+{
+    Slab *slab = SlabPool::getInstance().acquire();
+    auto *block = reinterpret_cast<Block *>(slab->data);
+    block->next = blocks_;
+    blocks_ = block;
+    pos_ = slab->data + BLOCK_HEADER;
+    end_ = slab->data + Slab::SIZE;
+}
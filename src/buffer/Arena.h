@@ -0,0 +1,77 @@
+// 按请求分配的内存区域: 从SlabPool取得slab, 在slab中顺序分配, 整体释放
+//
+// 请求范围内的数据(请求行, 请求头, 文件路径, 响应报文头等)都从arena分配, 请求结束时reset()
+// 稳定运行时slab在SlabPool的线程缓存中循环, 处理请求不会调用malloc/free
+//
+// -> char *line = arena.copy(data, len);      // 复制一段数据, 末尾补'\0'
+// -> ...
+// -> arena.reset();                           // 归还所有slab
+
+#ifndef HTTPSERVER_BUFFER_ARENA_H
+#define HTTPSERVER_BUFFER_ARENA_H
+
+#include <buffer/SlabPool.h>
+
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+class Arena
+{
+public:
+    Arena()
+      : blocks_(nullptr),
+        pos_(nullptr),
+        end_(nullptr),
+        large_(nullptr)
+    {}
+
+    Arena(const Arena &) = delete;
+
+    Arena(Arena &&other);
+
+    Arena &operator=(const Arena &) = delete;
+
+    Arena &operator=(Arena &&other);
+
+    ~Arena()
+    {
+        reset();
+    }
+
+public:
+    // 分配len字节, 按align对齐
+    void *allocate(size_t len, size_t align = alignof(std::max_align_t));
+
+    // 复制len字节, 末尾补'\0', 返回的数据可以直接作为C字符串使用
+    char *copy(const char *data, size_t len);
+
+    // 拼接多段数据, 末尾补'\0'
+    std::string_view concat(std::initializer_list<std::string_view> parts);
+
+    // 释放所有分配的内存, slab归还给SlabPool
+    void reset();
+
+public:
+    static constexpr size_t LARGE_SIZE = Slab::SIZE / 4;   // 超过1KiB的分配单独申请, 不浪费slab的剩余空间
+
+private:
+    // slab以及单独申请的大块内存开头的链表节点
+    struct Block
+    {
+        Block *next;
+    };
+
+    static constexpr size_t BLOCK_HEADER = alignof(std::max_align_t);
+
+    // 申请新的slab作为当前分配的位置
+    void newSlab();
+
+private:
+    Block *blocks_;     // 从SlabPool取得的slab
+    char *pos_;         // 当前slab中下一个可以分配的位置
+    char *end_;
+    Block *large_;      // 单独申请的大块内存
+};
+
+#endif
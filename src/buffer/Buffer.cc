@@ -2,79 +2,256 @@
 
 #include <sys/uio.h>
 
+#include <cassert>
 #include <cerrno>
+#include <climits>
+#include <cstring>
 #include <algorithm>
+#include <utility>
+
+Buffer::Buffer(Buffer &&other)
+  : slabs_(std::move(other.slabs_)),
+    read_pos_(other.read_pos_),
+    write_pos_(other.write_pos_),
+    readable_(other.readable_),
+    view_()
+{
+    other.slabs_.clear();
+    other.read_pos_ = other.write_pos_ = other.readable_ = 0;
+}
+
+Buffer &Buffer::operator=(Buffer &&other)
+{
+    if (this != &other)
+    {
+        releaseAll();
+        slabs_.swap(other.slabs_);
+        std::swap(read_pos_, other.read_pos_);
+        std::swap(write_pos_, other.write_pos_);
+        std::swap(readable_, other.readable_);
+    }
+    return *this;
+}
+
+Buffer::~Buffer()
+{
+    releaseAll();
+}
 
 ssize_t Buffer::readFd(int fd, int *save_errno)
 {
-    constexpr int EXTRA_BUFFER_SIZE = 64 * 1024; // 64KiB的临时栈内存
-    char extra_buffer[EXTRA_BUFFER_SIZE];  
-    struct iovec iovecs[2];
-    iovecs[0].iov_base = beginWrite();
-    iovecs[0].iov_len = writableBytes();
-    iovecs[1].iov_base = extra_buffer;
-    iovecs[1].iov_len = EXTRA_BUFFER_SIZE;
+    // 最后一个slab剩余的空间以及READ_SLABS个空闲slab, 数据直接读入slab, 不经过栈上的临时内存
+    struct iovec iovecs[READ_SLABS + 1];
+    int count = 0;
+    size_t tail_writable = tailWritable();
+    if (tail_writable > 0)
+    {
+        iovecs[count].iov_base = slabs_.back()->data + write_pos_;
+        iovecs[count].iov_len = tail_writable;
+        ++count;
+    }
+    SlabPool &pool = SlabPool::getInstance();
+    Slab *fresh[READ_SLABS];
+    for (int i = 0; i < READ_SLABS; ++i)
+    {
+        fresh[i] = pool.acquire();
+        iovecs[count].iov_base = fresh[i]->data;
+        iovecs[count].iov_len = Slab::SIZE;
+        ++count;
+    }
 
-    ssize_t read_len = ::readv(fd, iovecs, 2);
+    ssize_t read_len = ::readv(fd, iovecs, count);
     if (read_len < 0)
     {
         *save_errno = errno;
     }
-    // 数据全部读入buffer_
-    else if (read_len <= iovecs[0].iov_len)
-    {
-        write_pos_ += read_len;
-    }
-    // 部分数据读入extra_buffer
-    else
+    size_t left = read_len > 0 ? read_len : 0;
+    readable_ += left;
+    size_t len = std::min(left, tail_writable);
+    write_pos_ += len;
+    left -= len;
+    // 收到数据的slab接到链尾, 其余的归还
+    for (int i = 0; i < READ_SLABS; ++i)
     {
-        write_pos_ = buffer_.size();
-        append(extra_buffer, read_len - iovecs[0].iov_len);
+        if (left == 0)
+        {
+            pool.release(fresh[i]);
+            continue;
+        }
+        pushSlab(fresh[i]);
+        write_pos_ = std::min(left, Slab::SIZE);
+        left -= write_pos_;
     }
     return read_len;
 }
 
 ssize_t Buffer::writeFd(int fd, int *save_errno)
 {
-    ssize_t write_len = write(fd, beginRead(), readableBytes());
+    struct iovec iovecs[IOV_MAX];
+    int count = std::min<size_t>(slabs_.size(), IOV_MAX);
+    for (int i = 0; i < count; ++i)
+    {
+        iovecs[i].iov_base = slabs_[i]->data + slabBegin(i);
+        iovecs[i].iov_len = slabEnd(i) - slabBegin(i);
+    }
+    ssize_t write_len = ::writev(fd, iovecs, count);
     if (write_len < 0)
     {
         *save_errno = errno;
     }
     else
     {
-        read_pos_ += write_len;
+        retrieve(write_len);
     }
     return write_len;
 }
 
 const char *Buffer::peek() const
 {
-    return beginRead();
+    return slabs_.empty() ? view_.data() : slabs_.front()->data + read_pos_;
+}
+
+size_t Buffer::contiguousBytes() const
+{
+    return slabs_.empty() ? 0 : slabEnd(0) - read_pos_;
+}
+
+const char *Buffer::view(size_t len)
+{
+    assert(len <= readable_);
+    if (len <= contiguousBytes())
+    {
+        return peek();
+    }
+    view_.clear();
+    for (size_t i = 0; view_.size() < len; ++i)
+    {
+        size_t n = std::min(slabEnd(i) - slabBegin(i), len - view_.size());
+        view_.append(slabs_[i]->data + slabBegin(i), n);
+    }
+    return view_.data();
 }
 
-void Buffer::retrieve(int len)
+void Buffer::copyTo(char *dst, size_t len) const
 {
-    read_pos_ += len;
+    assert(len <= readable_);
+    for (size_t i = 0, copied = 0; copied < len; ++i)
+    {
+        size_t n = std::min(slabEnd(i) - slabBegin(i), len - copied);
+        std::memcpy(dst + copied, slabs_[i]->data + slabBegin(i), n);
+        copied += n;
+    }
 }
 
-void Buffer::append(const char *ptr, int len)
+size_t Buffer::findCrlf() const
 {
-    if (writableBytes() < len)
+    size_t offset = 0;          // 当前slab的可读数据相对于读指针的偏移
+    bool prev_cr = false;       // 上一个slab是否以\r结尾
+    for (size_t i = 0; i < slabs_.size(); ++i)
     {
-        if (writableBytes() + prependableBytes() >= len)
+        const char *data = slabs_[i]->data + slabBegin(i);
+        size_t len = slabEnd(i) - slabBegin(i);
+        if (len == 0)
         {
-            // 消除前面的空闲内存, 不需要扩容
-            std::copy(beginRead(), beginWrite(), begin());
-            write_pos_ -= prependableBytes();
-            read_pos_ = 0;
+            continue;
         }
-        else
+        if (prev_cr && data[0] == '\n')
         {
-            buffer_.resize(write_pos_ + len);
+            return offset - 1;
         }
+        const char *pos = data;
+        const char *end = data + len;
+        while ((pos = static_cast<const char *>(std::memchr(pos, '\r', end - pos))) != nullptr)
+        {
+            if (pos + 1 == end)
+            {
+                break;
+            }
+            if (pos[1] == '\n')
+            {
+                return offset + (pos - data);
+            }
+            ++pos;
+        }
+        prev_cr = data[len - 1] == '\r';
+        offset += len;
     }
+    return npos;
+}
 
-    std::copy(ptr, ptr + len, beginWrite());
-    write_pos_ += len;
+void Buffer::retrieve(size_t len)
+{
+    assert(len <= readable_);
+    readable_ -= len;
+    while (len > 0)
+    {
+        size_t available = slabEnd(0) - read_pos_;
+        if (len < available)
+        {
+            read_pos_ += len;
+            break;
+        }
+        len -= available;
+        if (slabs_.size() == 1)
+        {
+            // 保留最后一个slab给后面的读取
+            read_pos_ = write_pos_ = 0;
+            break;
+        }
+        SlabPool::getInstance().release(slabs_.front());
+        slabs_.erase(slabs_.begin());
+        read_pos_ = 0;
+    }
+}
+
+void Buffer::retrieveAll()
+{
+    retrieve(readable_);
+}
+
+void Buffer::shrink()
+{
+    if (readable_ == 0)
+    {
+        releaseAll();
+        std::string().swap(view_);
+    }
+}
+
+void Buffer::append(const char *ptr, size_t len)
+{
+    while (len > 0)
+    {
+        if (tailWritable() == 0)
+        {
+            pushSlab(SlabPool::getInstance().acquire());
+        }
+        size_t n = std::min(len, tailWritable());
+        std::memcpy(slabs_.back()->data + write_pos_, ptr, n);
+        write_pos_ += n;
+        readable_ += n;
+        ptr += n;
+        len -= n;
+    }
+}
+
+void Buffer::pushSlab(Slab *slab)
+{
+    if (slabs_.empty())
+    {
+        read_pos_ = 0;
+    }
+    slabs_.push_back(slab);
+    write_pos_ = 0;
+}
+
+void Buffer::releaseAll()
+{
+    SlabPool &pool = SlabPool::getInstance();
+    for (Slab *slab : slabs_)
+    {
+        pool.release(slab);
+    }
+    slabs_.clear();
+    read_pos_ = write_pos_ = readable_ = 0;
 }
@@ -1,16 +1,17 @@
-// 应用层缓冲区
+// 应用层缓冲区: 由SlabPool中固定大小的slab组成的链, 不需要扩容和移动数据
 //
 // fd -> buffer
-// -> ssize_t read_len = buffer.readfd(fd, &save_errno)
+// -> ssize_t read_len = buffer.readFd(fd, &save_errno)   // 一次readv(2)读入多个空闲slab
 //
 // buffer -> user
-// -> int len = buffer.readableBytes();
-// -> const char *data = buffer.peek();
-// -> read read_len bytes from buffer
-// -> buffer.retireve(read_len);
+// -> size_t pos = buffer.findCrlf();                      // 跨越slab查找\r\n
+// -> const char *data = buffer.view(len);                 // 前len个字节的连续视图
+// -> buffer.copyTo(dst, len);                             // 复制前len个字节
+// -> read len bytes from data
+// -> buffer.retrieve(len);                                // 归还读完的slab
 //
 // buffer -> fd
-// -> ssize_t write_len = buffer.writefd(fd, &save_errno);
+// -> ssize_t write_len = buffer.writeFd(fd, &save_errno);
 //
 // user -> buffer
 // -> buffer.append(data, len);
@@ -18,104 +19,101 @@
 #ifndef HTTPSERVER_BUFFER_H
 #define HTTPSERVER_BUFFER_H
 
+#include <buffer/SlabPool.h>
+
 #include <unistd.h>
 
+#include <cstddef>
+#include <string>
 #include <vector>
 
 class Buffer
 {
-    friend class HttpRequest;
 public:
+    Buffer()
+      : slabs_(),
+        read_pos_(0),
+        write_pos_(0),
+        readable_(0),
+        view_()
+    {}
 
-    Buffer(int size = 1024)
-    : buffer_(size),
-      read_pos_(0),
-      write_pos_(0)
-      {}
-
-    Buffer(const Buffer &) = default;
+    Buffer(const Buffer &) = delete;
 
-    Buffer(Buffer &&) = default;
+    Buffer(Buffer &&other);
 
-    Buffer &operator=(const Buffer &) = default;
+    Buffer &operator=(const Buffer &) = delete;
 
-    Buffer &operator=(Buffer &&) = default;
+    Buffer &operator=(Buffer &&other);
 
-    ~Buffer() = default;
+    ~Buffer();
 
+public:
     ssize_t readFd(int fd, int *save_errno);
 
     ssize_t writeFd(int fd, int *save_errno);
 
+    // 第一个slab中可读数据的起始地址, 连续的长度为contiguousBytes()
     const char *peek() const;
 
-    void retrieve(int len);
+    // 从peek()开始连续的可读字节数
+    size_t contiguousBytes() const;
+
+    // 前len个可读字节的连续视图, 跨越slab时复制到内部的缓冲
+    // 返回的地址在下一次修改缓冲区之前有效
+    const char *view(size_t len);
+
+    // 把前len个可读字节复制到dst, 不移动读指针
+    void copyTo(char *dst, size_t len) const;
+
+    // 可读数据中第一个\r\n相对于读指针的偏移, 不存在返回npos
+    size_t findCrlf() const;
+
+    // 取出len个字节, 读完的slab归还给SlabPool
+    void retrieve(size_t len);
 
-    void append(const char *ptr, int len);
+    void retrieveAll();
 
-    // 缓冲区可写字节数
-    int writableBytes() const
-    {
-        return buffer_.size() - write_pos_;
-    }
+    // 没有可读数据时把所有slab归还给SlabPool, 下一次readFd()/append()时再申请
+    // slab指针数组保留容量, 持久连接上反复空闲/读取时不需要重新分配
+    void shrink();
+
+    void append(const char *ptr, size_t len);
 
     // 缓冲区可读字节数
-    int readableBytes() const
-    {
-        return write_pos_ - read_pos_;
-    }
+    size_t readableBytes() const { return readable_; }
+
+    // 缓冲区持有的slab数目
+    size_t slabCount() const { return slabs_.size(); }
+
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr int READ_SLABS = 4;    // readFd()一次最多额外读入的空闲slab数目
 
 private:
+    // 最后一个slab可写的字节数
+    size_t tailWritable() const { return slabs_.empty() ? 0 : Slab::SIZE - write_pos_; }
+
+    // 第i个slab中可读数据的范围[begin, end)
+    size_t slabBegin(size_t i) const { return i == 0 ? read_pos_ : 0; }
+
+    size_t slabEnd(size_t i) const { return i + 1 == slabs_.size() ? write_pos_ : Slab::SIZE; }
+
+    // 在末尾追加一个空的slab
+    void pushSlab(Slab *slab);
 
-    char *begin()
-    {
-        return buffer_.data();
-    }
-
-    const char *begin() const
-    {
-        return buffer_.data();
-    }
-
-    // 写起始地址
-    char *beginWrite()
-    {
-        return buffer_.data() + write_pos_;
-    }
-
-    // 写起始地址
-    const char *beginWrite() const
-    {
-        return buffer_.data() + write_pos_;
-    }
-
-    // 读起始地址
-    const char *beginRead() const
-    {
-        return buffer_.data() + read_pos_;
-    }
-
-    // 读起始地址
-    char *beginRead()
-    {
-        return buffer_.data() + read_pos_;
-    }
-
-
-    // 读指针之前可用的字节数
-    int prependableBytes() const
-    {
-        return read_pos_;
-    }
+    void releaseAll();
 
 private:
+    std::vector<Slab *> slabs_; // slab链, 通常只有几个slab, 空的vector不占用堆内存
 
-    std::vector<char> buffer_;  // 容器
+    size_t read_pos_;       // 第一个slab中的读指针
 
-    int read_pos_;  // 读指针
+    size_t write_pos_;      // 最后一个slab中的写指针
 
-    int write_pos_; // 写指针
+    size_t readable_;       // 可读字节数
 
+    std::string view_;      // view()跨越slab时的连续副本
 };
 
 #endif
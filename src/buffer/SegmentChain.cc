@@ -0,0 +1,151 @@
+#include <buffer/SegmentChain.h>
+
+#include <cassert>
+#include <utility>
+
+using std::move;
+using std::shared_ptr;
+using std::string;
+
+void SegmentChain::appendOwned(string bytes)
+{
+    if (bytes.empty())
+    {
+        return;
+    }
+    segments_.emplace_back(SegmentType::OWNED, bytes.size());
+    segments_.back().owned = move(bytes);
+    bytes_ += segments_.back().len;
+}
+
+void SegmentChain::prependOwned(string bytes)
+{
+    if (bytes.empty())
+    {
+        return;
+    }
+    if (first_ > 0)
+    {
+        // 复用已经发送完的位置
+        segments_[--first_] = Segment(SegmentType::OWNED, bytes.size());
+    }
+    else
+    {
+        segments_.emplace(segments_.begin(), SegmentType::OWNED, bytes.size());
+    }
+    front().owned = move(bytes);
+    bytes_ += front().len;
+}
+
+void SegmentChain::appendBorrowed(const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    segments_.emplace_back(SegmentType::BORROWED, len);
+    segments_.back().borrowed = data;
+    bytes_ += len;
+}
+
+void SegmentChain::prependBorrowed(const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (first_ > 0)
+    {
+        segments_[--first_] = Segment(SegmentType::BORROWED, len);
+    }
+    else
+    {
+        segments_.emplace(segments_.begin(), SegmentType::BORROWED, len);
+    }
+    front().borrowed = data;
+    bytes_ += len;
+}
+
+void SegmentChain::appendShared(shared_ptr<const char> data, size_t len,
+                                shared_ptr<FileHandle> file, off_t file_offset)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    segments_.emplace_back(SegmentType::SHARED, len);
+    Segment &segment = segments_.back();
+    segment.shared = move(data);
+    segment.file = move(file);
+    segment.file_offset = file_offset;
+    segment.resident_pos = file_offset;
+    bytes_ += len;
+}
+
+void SegmentChain::appendFile(shared_ptr<FileHandle> file, off_t offset, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    segments_.emplace_back(SegmentType::FILE, len);
+    Segment &segment = segments_.back();
+    segment.file = move(file);
+    segment.file_offset = offset;
+    segment.readahead_pos = offset;
+    segment.resident_pos = offset;
+    bytes_ += len;
+}
+
+int SegmentChain::gatherIovecs(struct iovec *iovecs, int max_iovecs) const
+{
+    int count = 0;
+    for (size_t i = first_; i < segments_.size(); ++i)
+    {
+        const Segment &segment = segments_[i];
+        if (count == max_iovecs || !segment.inMemory())
+        {
+            break;
+        }
+        iovecs[count].iov_base = const_cast<char *>(segment.data());
+        iovecs[count].iov_len = segment.remaining();
+        ++count;
+    }
+    return count;
+}
+
+void SegmentChain::advance(size_t len)
+{
+    assert(len <= bytes_);
+    bytes_ -= len;
+    while (len > 0)
+    {
+        Segment &segment = front();
+        if (len < segment.remaining())
+        {
+            segment.pos += len;
+            return;
+        }
+        len -= segment.remaining();
+        // 立即释放数据段持有的引用(如映射的文件)
+        segment = Segment(SegmentType::OWNED, 0);
+        if (++first_ == segments_.size())
+        {
+            clear();
+        }
+    }
+}
+
+void SegmentChain::clear()
+{
+    segments_.clear();
+    first_ = 0;
+    bytes_ = 0;
+}
+
+void SegmentChain::shrink()
+{
+    assert(empty());
+    std::vector<Segment>().swap(segments_);
+    first_ = 0;
+}
@@ -0,0 +1,181 @@
+// 由多个数据段组成的发送链, 用来拼接响应报文而不复制数据
+//
+// 数据段类型:
+// -> OWNED:  链自己持有的字节
+// -> BORROWED: 由调用者保证发送期间有效的数据(如从请求arena分配的报文头)
+// -> SHARED: 共享的不可变数据(如映射的文件, 缓存的片段), 通过shared_ptr保证发送期间有效
+// -> FILE:   文件中的一段范围, 通过sendfile(2)发送
+//
+// chain -> fd
+// -> int n = chain.gatherIovecs(iovecs, IOV_MAX);   // 从游标开始收集连续的内存数据段
+// -> ssize_t write_len = ::writev(fd, iovecs, n);
+// -> chain.advance(write_len);                      // 推进游标, 释放发送完的数据段
+
+#ifndef HTTPSERVER_BUFFER_SEGMENT_CHAIN_H
+#define HTTPSERVER_BUFFER_SEGMENT_CHAIN_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 文件描述符的共享所有权, 最后一个引用释放时关闭文件
+class FileHandle
+{
+public:
+    explicit FileHandle(int fd)
+      : fd_(fd)
+    {}
+
+    FileHandle(const FileHandle &) = delete;
+
+    FileHandle(FileHandle &&) = delete;
+
+    FileHandle &operator=(const FileHandle &) = delete;
+
+    FileHandle &operator=(FileHandle &&) = delete;
+
+    ~FileHandle()
+    {
+        ::close(fd_);
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+enum class SegmentType
+{
+    OWNED,
+    BORROWED,
+    SHARED,
+    FILE,
+};
+
+struct Segment
+{
+    SegmentType type;
+    std::string owned;                  // OWNED: 持有的字节
+    const char *borrowed;               // BORROWED: 数据的起始地址
+    std::shared_ptr<const char> shared; // SHARED: 共享数据的起始地址
+    std::shared_ptr<FileHandle> file;   // FILE: 需要发送的文件; SHARED: 映射来源的文件(可以为空)
+    off_t file_offset;                  // 数据段第一个字节在文件中的偏移
+    size_t len;                         // 数据段总长度
+    size_t pos;                         // 已经发送的字节数
+
+    off_t readahead_pos;                // FILE: 已经发出预读请求的文件偏移
+    off_t resident_pos;                 // 该文件偏移之前的数据已经确认在页缓存中
+
+    Segment(SegmentType type, size_t len)
+      : type(type),
+        owned(),
+        borrowed(nullptr),
+        shared(),
+        file(),
+        file_offset(0),
+        len(len),
+        pos(0),
+        readahead_pos(0),
+        resident_pos(0)
+    {}
+
+    bool inMemory() const { return type != SegmentType::FILE; }
+
+    // 内存数据段下一个需要发送的字节
+    const char *data() const
+    {
+        switch (type)
+        {
+            case SegmentType::OWNED:
+                return owned.data() + pos;
+            case SegmentType::BORROWED:
+                return borrowed + pos;
+            default:
+                return shared.get() + pos;
+        }
+    }
+
+    // 下一个需要发送的字节在文件中的偏移
+    off_t filePos() const { return file_offset + static_cast<off_t>(pos); }
+
+    // 剩余的字节数
+    size_t remaining() const { return len - pos; }
+};
+
+class SegmentChain
+{
+public:
+    SegmentChain()
+      : segments_(),
+        first_(0),
+        bytes_(0)
+    {}
+
+    SegmentChain(const SegmentChain &) = default;
+
+    SegmentChain(SegmentChain &&) = default;
+
+    SegmentChain &operator=(const SegmentChain &) = default;
+
+    SegmentChain &operator=(SegmentChain &&) = default;
+
+    ~SegmentChain() = default;
+
+public:
+    // 追加链自己持有的字节
+    void appendOwned(std::string bytes);
+
+    // 在链首插入链自己持有的字节(如根据主体长度生成的报文头)
+    void prependOwned(std::string bytes);
+
+    // 追加调用者保证发送完成之前有效的数据
+    void appendBorrowed(const char *data, size_t len);
+
+    // 在链首插入调用者保证发送完成之前有效的数据
+    void prependBorrowed(const char *data, size_t len);
+
+    // 追加共享的不可变数据, file不为空表示数据是file从file_offset开始的映射
+    void appendShared(std::shared_ptr<const char> data, size_t len,
+                      std::shared_ptr<FileHandle> file = nullptr, off_t file_offset = 0);
+
+    // 追加文件中[offset, offset + len)范围的数据
+    void appendFile(std::shared_ptr<FileHandle> file, off_t offset, size_t len);
+
+    // 从游标开始收集连续的内存数据段, 遇到文件数据段或者收集了max_iovecs个后停止
+    // 返回收集到的iovec数目
+    int gatherIovecs(struct iovec *iovecs, int max_iovecs) const;
+
+    // 发送len字节后推进游标, 释放已经发送完的数据段
+    void advance(size_t len);
+
+    void clear();
+
+    // 释放数据段数组占用的内存, 发送链需要为空
+    void shrink();
+
+    bool empty() const { return first_ == segments_.size(); }
+
+    // 没有发送的字节数
+    size_t bytes() const { return bytes_; }
+
+    // 数据段数目
+    size_t size() const { return segments_.size() - first_; }
+
+    Segment &at(size_t idx) { return segments_[first_ + idx]; }
+
+    Segment &front() { return segments_[first_]; }
+
+private:
+    std::vector<Segment> segments_; // 数据段通常只有几个, 空的vector不占用堆内存
+    size_t first_;                  // 游标所在的数据段, 之前的都已经发送完并释放了引用
+
+    size_t bytes_;                  // 没有发送的字节数
+};
+
+#endif
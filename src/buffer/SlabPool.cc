@@ -0,0 +1,82 @@
+#include <buffer/SlabPool.h>
+
+#include <algorithm>
+
+using std::lock_guard;
+using std::mutex;
+
+SlabPool::~SlabPool()
+{
+    for (Slab *slab : depot_)
+    {
+        delete slab;
+    }
+}
+
+SlabPool::LocalCache::~LocalCache()
+{
+    SlabPool::getInstance().flush(*this, slabs.size());
+}
+
+SlabPool::LocalCache &SlabPool::localCache()
+{
+    thread_local LocalCache cache;
+    return cache;
+}
+
+Slab *SlabPool::acquire()
+{
+    LocalCache &cache = localCache();
+    if (cache.slabs.empty())
+    {
+        refill(cache);
+    }
+    if (cache.slabs.empty())
+    {
+        return new Slab;
+    }
+    Slab *slab = cache.slabs.back();
+    cache.slabs.pop_back();
+    return slab;
+}
+
+void SlabPool::release(Slab *slab)
+{
+    LocalCache &cache = localCache();
+    cache.slabs.push_back(slab);
+    if (cache.slabs.size() > LOCAL_CAPACITY)
+    {
+        flush(cache, TRANSFER_BATCH);
+    }
+}
+
+size_t SlabPool::depotSize() const
+{
+    lock_guard<mutex> guard(lock_);
+    return depot_.size();
+}
+
+void SlabPool::refill(LocalCache &cache)
+{
+    lock_guard<mutex> guard(lock_);
+    size_t count = std::min(TRANSFER_BATCH, depot_.size());
+    cache.slabs.insert(cache.slabs.end(), depot_.end() - count, depot_.end());
+    depot_.resize(depot_.size() - count);
+}
+
+void SlabPool::flush(LocalCache &cache, size_t count)
+{
+    auto first = cache.slabs.end() - count;
+    {
+        lock_guard<mutex> guard(lock_);
+        size_t keep = std::min(count, DEPOT_CAPACITY - std::min(DEPOT_CAPACITY, depot_.size()));
+        depot_.insert(depot_.end(), first, first + keep);
+        first += keep;
+    }
+    // 仓库已满, 剩下的还给系统
+    for (auto it = first; it != cache.slabs.end(); ++it)
+    {
+        delete *it;
+    }
+    cache.slabs.resize(cache.slabs.size() - count);
+}
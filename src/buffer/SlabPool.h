@@ -0,0 +1,86 @@
+// 固定大小内存块(slab)的池, 为Buffer提供内存
+//
+// 每个线程有自己的缓存, 申请和归还都不加锁
+// 线程缓存过多时把一批slab归还到全局仓库, 缓存为空时再从全局仓库取回一批
+// 一个连接可能先后在不同的工作线程上处理, 仓库让slab可以在线程之间流动
+//
+// -> Slab *slab = SlabPool::getInstance().acquire();
+// -> SlabPool::getInstance().release(slab);
+
+#ifndef HTTPSERVER_BUFFER_SLAB_POOL_H
+#define HTTPSERVER_BUFFER_SLAB_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+struct alignas(std::max_align_t) Slab
+{
+    static constexpr size_t SIZE = 4096;   // 每个slab的字节数
+
+    char data[SIZE];
+};
+
+class SlabPool
+{
+public:
+    SlabPool(const SlabPool &) = delete;
+
+    SlabPool(SlabPool &&) = delete;
+
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    SlabPool &operator=(SlabPool &&) = delete;
+
+    ~SlabPool();
+
+public:
+    // 获取 SlabPool 的唯一单例
+    static SlabPool &getInstance()
+    {
+        static SlabPool instance;
+        return instance;
+    }
+
+    // 申请一个slab, 内容未初始化
+    Slab *acquire();
+
+    // 归还一个slab
+    void release(Slab *slab);
+
+    // 全局仓库中空闲的slab数目
+    size_t depotSize() const;
+
+public:
+    static constexpr size_t LOCAL_CAPACITY = 64;        // 线程缓存最多保存的slab数目
+    static constexpr size_t TRANSFER_BATCH = 32;        // 线程缓存与全局仓库之间一次转移的slab数目
+    static constexpr size_t DEPOT_CAPACITY = 16384;     // 全局仓库最多保存的slab数目(64MiB), 超过时释放给系统
+
+private:
+    SlabPool()
+      : depot_(),
+        lock_()
+    {}
+
+    // 线程缓存, 线程退出时把缓存的slab归还到全局仓库
+    struct LocalCache
+    {
+        std::vector<Slab *> slabs;
+
+        ~LocalCache();
+    };
+
+    static LocalCache &localCache();
+
+    // 从全局仓库取回最多TRANSFER_BATCH个slab到cache
+    void refill(LocalCache &cache);
+
+    // 把cache中的count个slab归还到全局仓库
+    void flush(LocalCache &cache, size_t count);
+
+private:
+    std::vector<Slab *> depot_;     // 全局仓库
+    mutable std::mutex lock_;
+};
+
+#endif
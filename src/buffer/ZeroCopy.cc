@@ -0,0 +1,79 @@
+#include <buffer/ZeroCopy.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <cerrno>
+#include <cstring>
+
+using std::shared_ptr;
+
+std::atomic<uint64_t> ZeroCopyStats::sends(0);
+std::atomic<uint64_t> ZeroCopyStats::bytes(0);
+std::atomic<uint64_t> ZeroCopyStats::completions(0);
+std::atomic<uint64_t> ZeroCopyStats::copied(0);
+std::atomic<uint64_t> ZeroCopyStats::fallbacks(0);
+
+void ZeroCopyTracker::pin(uint32_t seq, shared_ptr<const char> data)
+{
+    pinned_.emplace_back(seq, std::move(data));
+}
+
+bool ZeroCopyTracker::reap(int sock)
+{
+    while (true)
+    {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return false;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            bool is_recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!is_recverr)
+            {
+                continue;
+            }
+            auto *err = reinterpret_cast<struct sock_extended_err *>(CMSG_DATA(cm));
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0)
+            {
+                continue;
+            }
+            // 完成通知的序号范围是[ee_info, ee_data]
+            uint32_t count = err->ee_data - err->ee_info + 1;
+            ZeroCopyStats::completions += count;
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                ZeroCopyStats::copied += count;
+            }
+            release(err->ee_data);
+        }
+    }
+    // 错误队列中只有完成通知, socket本身的错误需要单独检查
+    int sock_err = 0;
+    socklen_t len = sizeof(sock_err);
+    if (::getsockopt(sock, SOL_SOCKET, SO_ERROR, &sock_err, &len) < 0 || sock_err != 0)
+    {
+        return false;
+    }
+    return true;
+}
+
+void ZeroCopyTracker::release(uint32_t hi)
+{
+    // 序号会回绕, 通过有符号差值比较先后
+    while (!pinned_.empty() && static_cast<int32_t>(pinned_.front().first - hi) <= 0)
+    {
+        pinned_.pop_front();
+    }
+}
@@ -0,0 +1,76 @@
+// MSG_ZEROCOPY发送的数据在内核确认之前必须保持有效且不被修改
+//
+// 每次成功的sendmsg(MSG_ZEROCOPY)按顺序占用一个序号, 内核完成后通过socket的错误队列通知[lo, hi]范围的序号
+// -> uint32_t seq = tracker.nextSeq();
+// -> ::sendmsg(fd, &msg, MSG_ZEROCOPY);
+// -> tracker.pin(seq, data);                // 发送涉及的共享数据保留到完成通知为止
+// -> tracker.reap(fd);                      // EPOLLERR触发时读取错误队列, 释放完成的数据
+
+#ifndef HTTPSERVER_BUFFER_ZERO_COPY_H
+#define HTTPSERVER_BUFFER_ZERO_COPY_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+
+// 所有连接共享的零拷贝发送统计, 用来判断零拷贝是否划算
+struct ZeroCopyStats
+{
+    static std::atomic<uint64_t> sends;         // 成功的sendmsg(MSG_ZEROCOPY)次数
+    static std::atomic<uint64_t> bytes;         // 通过零拷贝发送的字节数
+    static std::atomic<uint64_t> completions;   // 完成通知覆盖的发送次数
+    static std::atomic<uint64_t> copied;        // 其中内核退回到复制的发送次数(如回环设备, 不支持分散聚集的网卡)
+    static std::atomic<uint64_t> fallbacks;     // 因为ENOBUFS退回到writev(2)的次数
+};
+
+class ZeroCopyTracker
+{
+public:
+    ZeroCopyTracker()
+      : next_seq_(0),
+        pinned_()
+    {}
+
+    ZeroCopyTracker(const ZeroCopyTracker &) = default;
+
+    ZeroCopyTracker(ZeroCopyTracker &&) = default;
+
+    ZeroCopyTracker &operator=(const ZeroCopyTracker &) = default;
+
+    ZeroCopyTracker &operator=(ZeroCopyTracker &&) = default;
+
+    ~ZeroCopyTracker() = default;
+
+public:
+    // 下一次sendmsg(MSG_ZEROCOPY)成功后占用的序号, 调用即占用
+    uint32_t nextSeq() { return next_seq_++; }
+
+    // 序号为seq的发送完成之前保留data
+    void pin(uint32_t seq, std::shared_ptr<const char> data);
+
+    // 从socket的错误队列读取所有完成通知, 释放已经完成的数据
+    // socket出现了真正的错误时返回false
+    bool reap(int sock);
+
+    // socket已经关闭, 丢弃所有没有完成的发送, 序号重新从0开始
+    void clear()
+    {
+        next_seq_ = 0;
+        pinned_.clear();
+    }
+
+    // 是否还有没有完成的零拷贝发送
+    bool pending() const { return !pinned_.empty(); }
+
+private:
+    // 释放序号不超过hi的数据
+    void release(uint32_t hi);
+
+private:
+    uint32_t next_seq_;
+    std::deque<std::pair<uint32_t, std::shared_ptr<const char>>> pinned_;  // 按序号排列
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include <http/FileCache.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <cstdio>
+#include <functional>
+#include <string_view>
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::string_view;
+
+int FileCache::get(const char *path, off_t map_limit, CachedFile *out)
+{
+    string_view key(path);
+    Slot &slot = slots_[std::hash<string_view>()(key) % SLOT_COUNT];
+    lock_guard<mutex> guard(slot.lock);
+    struct stat file_stat;
+    if (slot.path == key && slot.map_limit == map_limit &&
+        ::stat(path, &file_stat) == 0 &&
+        file_stat.st_dev == slot.dev && file_stat.st_ino == slot.ino &&
+        static_cast<size_t>(file_stat.st_size) == slot.cached.size &&
+        file_stat.st_mtim.tv_sec == slot.mtime.tv_sec &&
+        file_stat.st_mtim.tv_nsec == slot.mtime.tv_nsec)
+    {
+        // 复制shared_ptr只增加引用计数, 命中时不分配内存
+        *out = slot.cached;
+        return 0;
+    }
+    int status = load(slot, path, map_limit);
+    if (status == 0)
+    {
+        *out = slot.cached;
+    }
+    return status;
+}
+
+int FileCache::load(Slot &slot, const char *path, off_t map_limit)
+{
+    // 先清空槽位, 正在发送的响应仍然持有旧文件的引用
+    slot.path.clear();
+    slot.cached = CachedFile();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 400;
+    }
+    shared_ptr<FileHandle> file(new FileHandle(fd));
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode))
+    {
+        return 400;
+    }
+    size_t len = file_stat.st_size;
+    shared_ptr<const char> data;
+    if (file_stat.st_size > 0 && file_stat.st_size <= map_limit)
+    {
+        void *addr = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            ::perror("::mmap()");
+            return 500;
+        }
+        // 最后一个引用释放时解除映射
+        data.reset(static_cast<const char *>(addr), [len](const char *p){
+            ::munmap(const_cast<char *>(p), len);
+        });
+    }
+    slot.path = path;
+    slot.cached.file = std::move(file);
+    slot.cached.data = std::move(data);
+    slot.cached.size = len;
+    slot.dev = file_stat.st_dev;
+    slot.ino = file_stat.st_ino;
+    slot.mtime = file_stat.st_mtim;
+    slot.map_limit = map_limit;
+    return 0;
+}
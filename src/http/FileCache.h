@@ -0,0 +1,78 @@
+// 打开的静态资源文件的缓存: 持久连接上重复请求同一个文件时复用文件描述符以及映射
+//
+// 直接映射的缓存, 路径的哈希值决定槽位, 每个槽位有自己的锁
+// 每次命中都通过stat(2)确认文件没有被替换或修改, 否则重新打开
+//
+// -> CachedFile file;
+// -> int status = FileCache::getInstance().get(path, map_limit, &file);   // 0表示成功, 否则是响应码
+
+#ifndef HTTPSERVER_HTTP_FILE_CACHE_H
+#define HTTPSERVER_HTTP_FILE_CACHE_H
+
+#include <buffer/SegmentChain.h>
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct CachedFile
+{
+    std::shared_ptr<FileHandle> file;
+    std::shared_ptr<const char> data;   // 整个文件的映射, 文件超过映射上限或者为空时为空
+    size_t size = 0;
+};
+
+class FileCache
+{
+public:
+    FileCache(const FileCache &) = delete;
+
+    FileCache(FileCache &&) = delete;
+
+    FileCache &operator=(const FileCache &) = delete;
+
+    FileCache &operator=(FileCache &&) = delete;
+
+    ~FileCache() = default;
+
+public:
+    // 获取 FileCache 的唯一单例
+    static FileCache &getInstance()
+    {
+        static FileCache instance;
+        return instance;
+    }
+
+    // 获取path(以'\0'结尾)对应的文件, 不超过map_limit字节的文件整体映射
+    // 成功返回0, 文件无法打开或者不是普通文件返回400, 映射失败返回500
+    int get(const char *path, off_t map_limit, CachedFile *out);
+
+public:
+    static constexpr size_t SLOT_COUNT = 64;    // 槽位数目, 哈希冲突的文件互相替换
+
+private:
+    FileCache() = default;
+
+    struct Slot
+    {
+        std::mutex lock;
+        std::string path;               // 为空表示槽位没有缓存文件
+        CachedFile cached;
+        dev_t dev = 0;
+        ino_t ino = 0;
+        struct timespec mtime = {};
+        off_t map_limit = 0;
+    };
+
+    // 打开文件并放入槽位, 返回值同get()
+    static int load(Slot &slot, const char *path, off_t map_limit);
+
+private:
+    Slot slots_[SLOT_COUNT];
+};
+
+#endif
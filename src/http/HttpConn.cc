@@ -10,6 +10,8 @@ using std::string;
 
 string HttpConn::resources_path_ = getDefaultResourcesPath();
 
+std::shared_ptr<const Snapshot> HttpConn::snapshot_;
+
 string HttpConn::getDefaultResourcesPath()
 {
     char cur_path[PATH_MAX];
@@ -25,10 +27,43 @@ void HttpConn::setResourcesPath(const string &path)
     resources_path_ = path;
 }
 
+void HttpConn::close()
+{
+    if (conn_sock_ < 0)
+    {
+        return;
+    }
+    if (tls_)
+    {
+        tls_->shutdown();
+    }
+    if (close_callback_)
+    {
+        close_callback_();
+    }
+    conn_sock_ = -1;
+    // 放回对象池之前释放连接持有的资源(TLS会话, 缓冲区, 映射的文件等)
+    tls_.reset();
+    request_.recycle();
+    response_.recycle();
+    close_callback_ = nullptr;
+}
+
+void HttpConn::reset(int conn_sock, const struct sockaddr_in &client_addr, bool is_et, SSL_CTX *tls_ctx)
+{
+    assert(conn_sock_ < 0);
+    conn_sock_ = conn_sock;
+    is_et_ = is_et;
+    keep_alive_ = false;
+    lingering_ = false;
+    tls_.reset(tls_ctx ? new TlsSession(tls_ctx, conn_sock) : nullptr);
+    client_addr_ = client_addr;
+}
+
 // 读取数据到缓冲区, 并根据缓冲区中的数据解析报文
 bool HttpConn::processRequest()
 {
-    request_.read(conn_sock_, is_et_);
+    request_.read(conn_sock_, is_et_, tls_.get());
     request_.parse();
     // 请求报文解析完成
     if (request_.finished())
@@ -64,19 +99,37 @@ void HttpConn::setResponse()
     {
         // 请求报文没有问题, 则由Response生成响应
         response_.setStatusCode(200);
-        // ! 如何保证 request_.filepath() 不会通过 .. 访问上级目录
-        response_.setFilePath(resources_path_ + request_.filePath());
+        auto snapshot = getSnapshot();
+        if (snapshot)
+        {
+            // 快照只能精确匹配打包时的路径, 不会访问到资源以外的文件
+            response_.setAcceptGzip(request_.header("Accept-Encoding").find("gzip") != std::string_view::npos);
+            response_.setIfNoneMatch(request_.header("If-None-Match"));
+            const SnapshotEntry *entry = snapshot->find(request_.filePath());
+            response_.setSnapshotEntry(std::move(snapshot), entry);
+        }
+        else
+        {
+            // ! 如何保证 request_.filepath() 不会通过 .. 访问上级目录
+            response_.setFilePath(request_.arena().concat({resources_path_, request_.filePath()}));
+        }
     }
-    // 准备好写入
-    response_.init();
+    // 准备好写入, 报文头等数据与请求一起在reset()时释放
+    response_.init(request_.arena());
 }
 
 bool HttpConn::processResponse()
 {
-    if (response_.write(conn_sock_, is_et_))
+    if (response_.write(conn_sock_, is_et_, tls_.get()))
     {
         // 响应完成后, 重置请求
         request_.reset();
+        // 持久连接进入空闲, 释放缓冲区等内存, 只保留连接本身的状态
+        if (!request_.hasPendingInput())
+        {
+            request_.releaseMemory();
+            response_.releaseMemory();
+        }
         return true;
     }
     return false;
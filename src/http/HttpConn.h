@@ -3,22 +3,30 @@
 
 #include <http/HttpRequest.h>
 #include <http/HttpResponse.h>
+#include <tls/TlsSession.h>
+#include <snapshot/Snapshot.h>
 
 #include <arpa/inet.h>
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
 
 class HttpConn
 {
 public:
-    HttpConn(int conn_sock, const struct sockaddr_in &client_addr, bool is_et)
+    // tls_ctx不为空时该连接是HTTPS连接, 需要先完成TLS握手
+    HttpConn(int conn_sock, const struct sockaddr_in &client_addr, bool is_et, SSL_CTX *tls_ctx = nullptr)
       : conn_sock_(conn_sock),
-        client_addr_(client_addr),
         is_et_(is_et),
+        keep_alive_(false),
+        lingering_(false),
+        tls_(tls_ctx ? new TlsSession(tls_ctx, conn_sock) : nullptr),
         request_(),
         response_(),
-        keep_alive_(false)
+        client_addr_(client_addr),
+        close_callback_()
         {}
 
     HttpConn(const HttpConn &) = delete;
@@ -31,10 +39,36 @@ public:
 
     ~HttpConn()
     {
-        close_callback_();
+        close();
     }
 
 public:
+    // * 连接对象池回收时调用
+    // 关闭连接: 发送TLS的close_notify, 调用关闭回调函数, 释放连接持有的资源, 重复调用没有效果
+    void close();
+
+    // * 连接对象池复用时调用
+    // 用新的连接socket重新初始化已经close()的对象
+    void reset(int conn_sock, const struct sockaddr_in &client_addr, bool is_et, SSL_CTX *tls_ctx = nullptr);
+
+public:
+    // HTTPS连接是否还在进行TLS握手
+    bool handshaking() const { return tls_ && !tls_->established(); }
+
+    // 推进TLS握手
+    HandshakeState handshake() { return tls_->handshake(); }
+
+    // 读取请求或者发送响应没有完成时, TLS会话需要等待的事件; 不经过TLS会话读写时为DONE
+    // 记录加密卸载到内核后, 响应直接写入socket
+    HandshakeState tlsWaiting() const
+    {
+        if (!tls_ || (responding() && tls_->ktlsSend()))
+        {
+            return HandshakeState::DONE;
+        }
+        return tls_->ioState();
+    }
+
     // * EPOLLIN触发
     // 读数据到缓冲区, 并进行解析
     // 1. 请求报文解析成功, 将响应写入缓冲区, 返回true
@@ -51,6 +85,36 @@ public:
     // 2. 没有发送完, 返回false
     bool processResponse();
 
+    // 响应是否在等待I/O线程把文件数据读入页缓存
+    bool waitingForDisk() const { return response_.waitingForDisk(); }
+
+    // * I/O线程调用
+    // 读入响应即将发送的文件数据, 完成后可以继续processResponse()
+    void loadResponseData() { response_.loadFileData(); }
+
+    // 大于等于threshold字节的共享数据通过MSG_ZEROCOPY发送, socket需要已经开启SO_ZEROCOPY
+    void enableZeroCopy(size_t threshold) { response_.setZeroCopyThreshold(threshold); }
+
+    bool zeroCopyEnabled() const { return response_.zeroCopyEnabled(); }
+
+    // 是否还有内核没有确认完成的零拷贝发送
+    bool zeroCopyPending() const { return response_.zeroCopyPending(); }
+
+    // * EPOLLERR触发
+    // 读取零拷贝完成通知, socket出现了真正的错误时返回false
+    bool reapZeroCopy() { return response_.reapZeroCopy(conn_sock_); }
+
+    // 是否有正在发送的响应
+    bool responding() const { return !response_.finished(); }
+
+    // 正在发送的响应还剩多少字节
+    size_t pendingBytes() const { return response_.pendingBytes(); }
+
+    // 响应已经发送完, 等待零拷贝完成后关闭连接
+    bool lingering() const { return lingering_; }
+
+    void setLingering() { lingering_ = true; }
+
     // 注册关闭HTTP连接时的回调函数
     void registerCloseCallBack(const std::function<void()> &callback) { close_callback_ = callback; }
 
@@ -59,6 +123,13 @@ public:
 
     bool keepAlive() const { return keep_alive_; }
 
+public:
+    // 原子地替换静态资源快照, 为空时从资源目录提供服务
+    // 替换前已经生成的响应继续引用旧快照, 直到发送完成
+    static void setSnapshot(std::shared_ptr<const Snapshot> snapshot) { std::atomic_store(&snapshot_, std::move(snapshot)); }
+
+    static std::shared_ptr<const Snapshot> getSnapshot() { return std::atomic_load(&snapshot_); }
+
 private:
     static void setResourcesPath(const std::string &path);
 
@@ -67,15 +138,21 @@ private:
 private:
     static std::string resources_path_;  // 静态资源目录
 
-    int conn_sock_;                     // 连接socket
-    struct sockaddr_in client_addr_;    // 客户端的socket地址
+    static std::shared_ptr<const Snapshot> snapshot_;  // 静态资源快照, 通过atomic_load/atomic_store访问
 
+    // * 热数据: 处理每个请求都会访问
+    int conn_sock_;                     // 连接socket, 已经关闭时为-1
     bool is_et_;                        // 从socket读写数据时是否一次读完/写完
+    bool keep_alive_;
+    bool lingering_;                    // 等待零拷贝完成后关闭
+
+    std::unique_ptr<TlsSession> tls_;   // HTTPS连接的TLS会话, HTTP连接为空
 
     HttpRequest request_;
     HttpResponse response_;
 
-    bool keep_alive_;
+    // * 冷数据: 只在建立以及关闭连接时访问
+    struct sockaddr_in client_addr_;    // 客户端的socket地址
 
     std::function<void()> close_callback_;  // 关闭连接时的回调函数
 };
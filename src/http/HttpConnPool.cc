@@ -0,0 +1,60 @@
+#include <http/HttpConnPool.h>
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+
+HttpConnPool::~HttpConnPool()
+{
+    for (HttpConn *p_conn : idle_)
+    {
+        delete p_conn;
+    }
+}
+
+shared_ptr<HttpConn> HttpConnPool::acquire(int conn_sock, const struct sockaddr_in &client_addr,
+                                           bool is_et, SSL_CTX *tls_ctx)
+{
+    HttpConn *p_conn = nullptr;
+    {
+        lock_guard<mutex> guard(lock_);
+        if (!idle_.empty())
+        {
+            p_conn = idle_.back();
+            idle_.pop_back();
+        }
+    }
+    if (p_conn)
+    {
+        p_conn->reset(conn_sock, client_addr, is_et, tls_ctx);
+    }
+    else
+    {
+        p_conn = new HttpConn(conn_sock, client_addr, is_et, tls_ctx);
+    }
+    // 删除器持有对象池的引用
+    auto self = shared_from_this();
+    return shared_ptr<HttpConn>(p_conn, [self](HttpConn *p) {
+        self->recycle(p);
+    });
+}
+
+size_t HttpConnPool::idleSize() const
+{
+    lock_guard<mutex> guard(lock_);
+    return idle_.size();
+}
+
+void HttpConnPool::recycle(HttpConn *p_conn)
+{
+    p_conn->close();
+    {
+        lock_guard<mutex> guard(lock_);
+        if (idle_.size() < capacity_)
+        {
+            idle_.push_back(p_conn);
+            return;
+        }
+    }
+    delete p_conn;
+}
@@ -0,0 +1,57 @@
+// HttpConn对象池: 复用构造好的连接对象, 避免每次accept(2)都分配请求/响应/缓冲区等对象
+//
+// -> auto p_conn = pool->acquire(conn_sock, client_addr, is_et, tls_ctx);
+// -> ... 最后一个shared_ptr释放时关闭连接, 对象重置后放回池中
+//
+// 每次acquire()得到新的shared_ptr控制块, 旧连接遗留的weak_ptr不会锁定到复用后的对象
+
+#ifndef HTTPSERVER_HTTP_CONN_POOL_H
+#define HTTPSERVER_HTTP_CONN_POOL_H
+
+#include <http/HttpConn.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class HttpConnPool : public std::enable_shared_from_this<HttpConnPool>
+{
+public:
+    // 池中最多保留capacity个空闲对象
+    // 需要通过std::shared_ptr持有, 连接的删除器引用对象池, 对象池比所有连接活得更久
+    explicit HttpConnPool(size_t capacity)
+      : capacity_(capacity),
+        idle_(),
+        lock_()
+    {}
+
+    HttpConnPool(const HttpConnPool &) = delete;
+
+    HttpConnPool(HttpConnPool &&) = delete;
+
+    HttpConnPool &operator=(const HttpConnPool &) = delete;
+
+    HttpConnPool &operator=(HttpConnPool &&) = delete;
+
+    ~HttpConnPool();
+
+public:
+    // 取出一个空闲对象并用新的连接初始化, 没有空闲对象时新建
+    std::shared_ptr<HttpConn> acquire(int conn_sock, const struct sockaddr_in &client_addr,
+                                      bool is_et, SSL_CTX *tls_ctx);
+
+    // 空闲对象的数目
+    size_t idleSize() const;
+
+private:
+    // 关闭连接并放回池中, 池满时释放
+    void recycle(HttpConn *p_conn);
+
+private:
+    size_t capacity_;
+    std::vector<HttpConn *> idle_;
+    mutable std::mutex lock_;   // 连接可能在事件处理线程或者工作线程上释放
+};
+
+#endif
@@ -1,26 +1,27 @@
 #include <http/HttpRequest.h>
 
-#include <regex>
+#include <strings.h>
+#include <cerrno>
 
 using std::string;
-using std::search;
-using std::begin;
-using std::end;
+using std::string_view;
 
 // 读取数据
-void HttpRequest::read(int conn_sock, bool is_et)
+void HttpRequest::read(int conn_sock, bool is_et, TlsSession *tls)
 {
     do
     {
         int save_errno = 0;
-        ssize_t read_len = buffer_.readFd(conn_sock, &save_errno);
+        ssize_t read_len = tls ? readTls(tls, &save_errno) : buffer_.readFd(conn_sock, &save_errno);
         if (read_len < 0)
         {
             if (save_errno == EAGAIN || save_errno == EWOULDBLOCK)
             {
                 break;
             }
+            // TLS出错之后SSL_read会一直失败且不再进行系统调用, 必须退出循环
             parse_state_ = ParseState::UNKNOWN_ERROR;
+            break;
         }
         if (read_len == 0)
         {
@@ -31,19 +32,33 @@ void HttpRequest::read(int conn_sock, bool is_et)
     } while (is_et);
 }
 
+ssize_t HttpRequest::readTls(TlsSession *tls, int *save_errno)
+{
+    // 一个TLS记录最多16KiB明文
+    constexpr int TLS_RECORD_SIZE = 16 * 1024;
+    char record[TLS_RECORD_SIZE];
+    ssize_t read_len = tls->read(record, TLS_RECORD_SIZE);
+    if (read_len < 0)
+    {
+        *save_errno = errno;
+    }
+    else if (read_len > 0)
+    {
+        buffer_.append(record, read_len);
+    }
+    return read_len;
+}
+
 // todo: 解析报文主体部分存在问题, 不能用从状态机驱动
 void HttpRequest::parse()
 {
     while(!finished())
     {
-        const string crlf("\r\n");
-        auto buffer_end = buffer_.peek() + buffer_.readableBytes();
-        auto crlf_iter = search(buffer_.peek(), buffer_end,
-                                begin(crlf), end(crlf));
+        size_t crlf_pos = buffer_.findCrlf();
 
         auto findCrlf = [&]()
         {
-            return crlf_iter != buffer_end;
+            return crlf_pos != Buffer::npos;
         };
 
         // todo: 没有处理post方法的body
@@ -51,15 +66,17 @@ void HttpRequest::parse()
         // 2. 如果连接关闭或者对端关闭写进行解析
         if ((parse_state_ != ParseState::BODY && findCrlf()) || is_closed_)
         {
-            // 从缓冲区中取出一行数据进行解析
-            int line_len = crlf_iter - buffer_.peek() + 2;
-            std::string line(buffer_.peek(), line_len);
+            // 从缓冲区中取出一行数据进行解析, 连接关闭时取出剩余的全部数据
+            // 请求的各个字段引用这一行, 复制到arena中, 缓冲区可以立即释放
+            size_t line_len = findCrlf() ? crlf_pos + 2 : buffer_.readableBytes();
+            auto *line_data = static_cast<char *>(arena_.allocate(line_len, 1));
+            buffer_.copyTo(line_data, line_len);
+            string_view line(line_data, line_len);
             buffer_.retrieve(line_len);
             if (parse_state_ != ParseState::BODY && findCrlf())
             {
                 // 移除末尾的 \r\n
-                line.pop_back();
-                line.pop_back();
+                line.remove_suffix(2);
             }
 
             switch(parse_state_)
@@ -94,6 +111,11 @@ void HttpRequest::parse()
                 }
             }
         }
+        else
+        {
+            // 缓冲区中没有完整的一行, 等待更多数据
+            break;
+        }
 
     }
 }
@@ -101,33 +123,57 @@ void HttpRequest::parse()
 void HttpRequest::reset()
 {
     parse_state_ = ParseState::REQUESTLINE;
-    method_.clear();
-    path_.clear();
-    version_.clear();
-    headers_.clear();
-    body_.clear();
+    method_ = path_ = version_ = body_ = string_view();
+    headers_ = nullptr;
+    arena_.reset();
+}
+
+void HttpRequest::releaseMemory()
+{
+    buffer_.shrink();
 }
 
-void HttpRequest::parseRequestLine(const std::string &line)
+string_view HttpRequest::header(string_view key) const
 {
-    // * 通过正则表达式解析请求首行
-    std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch submatch;
-    if (std::regex_match(line, submatch, pattern))
+    for (const HttpHeader *p = headers_; p; p = p->next)
     {
-        method_ = submatch[1];
-        path_ = submatch[2];
-        version_ = submatch[3];
-        parse_state_ = ParseState::HEADER;
+        if (p->key.size() == key.size() && ::strncasecmp(p->key.data(), key.data(), key.size()) == 0)
+        {
+            return p->value;
+        }
     }
-    else
+    return string_view();
+}
+
+void HttpRequest::recycle()
+{
+    reset();
+    // 连同slab指针数组一起释放
+    buffer_ = Buffer();
+    is_closed_ = false;
+}
+
+void HttpRequest::parseRequestLine(string_view line)
+{
+    // * 请求首行的格式: 方法 SP 路径 SP HTTP/版本, 各部分都不含空格
+    size_t method_end = line.find(' ');
+    size_t path_end = method_end == string_view::npos ? string_view::npos : line.find(' ', method_end + 1);
+    constexpr string_view prefix = "HTTP/";
+    if (path_end == string_view::npos ||
+        line.compare(path_end + 1, prefix.size(), prefix) != 0 ||
+        line.find(' ', path_end + 1) != string_view::npos)
     {
         // 匹配失败, 说明请求报文格式有问题
         parse_state_ = ParseState::BAD_REQUEST;
+        return;
     }
+    method_ = line.substr(0, method_end);
+    path_ = line.substr(method_end + 1, path_end - method_end - 1);
+    version_ = line.substr(path_end + 1 + prefix.size());
+    parse_state_ = ParseState::HEADER;
 }
 
-void HttpRequest::parseHeader(const std::string &line)
+void HttpRequest::parseHeader(string_view line)
 {
     if (line.empty())
     {
@@ -146,22 +192,28 @@ void HttpRequest::parseHeader(const std::string &line)
         }
         return;
     }
-    // * 通过正则表达式解析请求头
-    std::regex patten("^([^:]*): ?(.*)$");
-    std::smatch subMatch;
-    if(std::regex_match(line, subMatch, patten))
+    // * 请求头的格式: 字段名: 值, 冒号后最多跳过一个空格
+    size_t colon = line.find(':');
+    if (colon == string_view::npos)
     {
-        headers_[subMatch[1]] = subMatch[2];
+        parse_state_ = ParseState::BAD_REQUEST;
+        return;
     }
-    else
+    string_view value = line.substr(colon + 1);
+    if (!value.empty() && value.front() == ' ')
     {
-        parse_state_ = ParseState::BAD_REQUEST;
+        value.remove_prefix(1);
     }
-
+    auto *p_header = static_cast<HttpHeader *>(arena_.allocate(sizeof(HttpHeader), alignof(HttpHeader)));
+    p_header->key = line.substr(0, colon);
+    p_header->value = value;
+    // 插入链表头, 重复的字段查找时得到最后出现的值
+    p_header->next = headers_;
+    headers_ = p_header;
 }
 
 // todo: 需要修改
-void HttpRequest::parseBody(const std::string &line)
+void HttpRequest::parseBody(string_view line)
 {
     body_ = line;
     parse_state_ = ParseState::OK;
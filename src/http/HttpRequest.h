@@ -1,10 +1,12 @@
 #ifndef HTTPSERVER_HTTP_HTTP_REQUEST_H
 #define HTTPSERVER_HTTP_HTTP_REQUEST_H
 
+#include <buffer/Arena.h>
 #include <buffer/Buffer.h>
+#include <tls/TlsSession.h>
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 // HTTP请求解析状态(主状态机)
 enum class ParseState
@@ -17,6 +19,14 @@ enum class ParseState
     UNKNOWN_ERROR, // 意料之外的错误
 };
 
+// 请求头字段, 从请求的arena分配, 按出现的相反顺序链接
+struct HttpHeader
+{
+    std::string_view key;
+    std::string_view value;
+    HttpHeader *next;
+};
+
 class HttpRequest
 {
 
@@ -25,36 +35,53 @@ public:
     HttpRequest()
       : parse_state_(ParseState::REQUESTLINE),
         buffer_(),
+        arena_(),
         method_(),
         path_(),
         version_(),
-        headers_(),
+        headers_(nullptr),
         body_(),
         is_closed_(false)
     {}
 
-    HttpRequest(const HttpRequest &) = default;
+    HttpRequest(const HttpRequest &) = delete;
 
     HttpRequest(HttpRequest &&) = default;
 
-    HttpRequest &operator=(const HttpRequest &) = default;
+    HttpRequest &operator=(const HttpRequest &) = delete;
 
     HttpRequest &operator=(HttpRequest &&) = default;
 
     ~HttpRequest() = default;
 
 public:
-    // 读取数据
-    void read(int conn_sock, bool is_et);
+    // 读取数据, tls不为空时读取解密后的数据
+    void read(int conn_sock, bool is_et, TlsSession *tls = nullptr);
 
     // 驱动状态机执行
     void parse();
 
-    // 持久连接: 清空上一次请求的内容
+    // 持久连接: 清空上一次请求的内容, 整体释放请求范围内分配的内存
     void reset();
 
-    // 请求文件路径
-    const std::string &filePath() const { return path_; }
+    // 缓冲区中是否还有没有解析的数据(如流水线发送的下一个请求)
+    bool hasPendingInput() const { return buffer_.readableBytes() > 0; }
+
+    // 持久连接空闲时释放缓冲区占用的内存, 下一次read()时重新申请
+    // 需要在reset()之后并且没有待解析的数据时调用
+    void releaseMemory();
+
+    // 连接对象复用: 清空所有状态并释放内存
+    void recycle();
+
+    // 请求文件路径, 在reset()之前有效
+    std::string_view filePath() const { return path_; }
+
+    // 请求头字段的值(字段名不区分大小写), 不存在时返回空串
+    std::string_view header(std::string_view key) const;
+
+    // 请求范围内的内存, reset()时整体释放, 生成响应时也从这里分配
+    Arena &arena() { return arena_; }
 
 public:
     // 请求是否解析完成
@@ -74,33 +101,36 @@ public:
     // 请求报文是否请求持久连接
     bool keepAlive() const
     {
-        return headers_.count("Connection") &&
-               (headers_.at("Connection") == "keep-alive");
+        return header("Connection") == "keep-alive";
     }
 
 private:
     // 解析请求首行
-    void parseRequestLine(const std::string &line);
+    void parseRequestLine(std::string_view line);
 
     // 解析请求头
-    void parseHeader(const std::string &line);
+    void parseHeader(std::string_view line);
 
     // 解析请求体
-    void parseBody(const std::string &line);
+    void parseBody(std::string_view line);
 
     void getHttpLine();
 
+    // 从TLS会话读取一个记录的明文到缓冲区, 返回值同Buffer::readFd()
+    ssize_t readTls(TlsSession *tls, int *save_errno);
+
 private:
     ParseState parse_state_;
 
     Buffer buffer_;
+    Arena arena_;               // 下面的字段都指向arena中的数据
 
-    std::string method_;
-    std::string path_;
-    std::string version_;
+    std::string_view method_;
+    std::string_view path_;
+    std::string_view version_;
 
-    std::unordered_map<std::string, std::string> headers_;
-    std::string body_;
+    HttpHeader *headers_;
+    std::string_view body_;
 
     bool is_closed_;  // 对端关闭或者关闭了写方向
 };
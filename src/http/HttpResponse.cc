@@ -1,3 +1,4 @@
+#include <http/FileCache.h>
 #include <http/HttpResponse.h>
 #include <logger/AsyncLogger.h>
 
@@ -5,17 +6,27 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <cerrno>
 #include <cstring>
 
+#include <climits>
 #include <cstdio>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
+using std::shared_ptr;
 using std::string;
+using std::string_view;
 using std::unordered_map;
 
 unordered_map<int, string> HttpResponse::code_to_text = {
     {200, "OK"},
+    {304, "Not Modified"},
     {400, "Bad Request"},
     {403, "Forbidden"},
     {404, "Not Found"},
@@ -29,152 +40,458 @@ unordered_map<string, string> HttpResponse::suffix_to_type = {
     {"png", "image/png"}
 };
 
-// 生成HTTP报文将其写入缓冲区
-void HttpResponse::init()
+// 生成HTTP报文: 报文头以及主体的各个数据段依次放入发送链
+void HttpResponse::init(Arena &arena)
 {
-    while (true)
+    p_arena_ = &arena;
+    p_headers_ = static_cast<HeaderField *>(arena.allocate(sizeof(HeaderField) * MAX_HEADERS, alignof(HeaderField)));
+    header_count_ = 0;
+    chain_.clear();
+    waiting_disk_ = false;
+    if (snapshot_ && status_code_ == 200)
     {
-        if (status_code_ != 200)
-        {
-            break;
-        }
-        int fd = ::open(file_path_.data(), O_RDONLY);
-        if (fd < 0)
+        initFromSnapshot();
+        snapshot_.reset();
+        snapshot_entry_ = nullptr;
+        p_arena_ = nullptr;
+        p_headers_ = nullptr;
+        return;
+    }
+    if (status_code_ == 200)
+    {
+        // 同一个文件的描述符以及映射在请求之间复用
+        CachedFile cached;
+        int status = FileCache::getInstance().get(file_path_.data(), STREAM_FILE_THRESHOLD, &cached);
+        if (status != 0)
         {
-            status_code_ = 400;
-            break;
+            status_code_ = status;
         }
-        fstat(fd, &file_stat_);
-
-        if(!S_ISREG(file_stat_.st_mode))
+        else if (cached.size > static_cast<size_t>(STREAM_FILE_THRESHOLD))
         {
-            status_code_ = 400;
-            break;
+            // 大文件不整体映射, 作为文件数据段按窗口发送, 每个连接占用的内存与文件大小无关
+            ::posix_fadvise(cached.file->fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+            chain_.appendFile(std::move(cached.file), 0, cached.size);
+            advanceReadahead(chain_.front());
         }
-        file_addr_ = ::mmap(nullptr, file_stat_.st_size,
-                            PROT_READ, MAP_PRIVATE, fd, 0);
-        if (file_addr_ == MAP_FAILED)
+        else if (cached.size > 0)
         {
-            ::perror("::mmap()");
-            status_code_ = 500;
-            break;
+            // 映射的文件作为共享数据段
+            // 带上文件描述符, 用来检查映射的数据是否在页缓存中
+            chain_.appendShared(std::move(cached.data), cached.size, std::move(cached.file), 0);
         }
-        ::close(fd);
-
-        addStatusLine();
-        setHeader("Content-Length", std::to_string(file_stat_.st_size));
+    }
+    if (status_code_ == 200)
+    {
+        setHeader("Content-Length", formatNumber(chain_.bytes()));
         setHeader("Content-Type", getFileType());
         setHeader("Connection", keep_alive_ ? "keep-alive" : "close");
-        addHeaders();
-        addCrlfLine();
+        string_view head = makeHead();
+        chain_.prependBorrowed(head.data(), head.size());
+    }
+    else
+    {
+        // * 请求没有成功, 生成异常响应报文
+        chain_.clear();
+        handleExceptStatus();
+    }
+    p_arena_ = nullptr;
+    p_headers_ = nullptr;
+}
 
-        iovec_arr[0].iov_base = const_cast<char *>(buffer_.peek());
-        iovec_arr[0].iov_len = buffer_.readableBytes();
-        iovec_arr[1].iov_base = file_addr_;
-        iovec_arr[1].iov_len = file_stat_.st_size;
+void HttpResponse::initFromSnapshot()
+{
+    if (!snapshot_entry_)
+    {
+        status_code_ = 404;
+        handleExceptStatus();
+        return;
+    }
+    const SnapshotEntry &entry = *snapshot_entry_;
+    // 先确定内容编码, 客户端缓存的必须是同一种编码的版本
+    bool gzip = accept_gzip_ && entry.gzip_len > 0;
+    string_view etag = snapshot_->etag(entry, gzip);
+    if (if_none_match_ == etag)
+    {
+        // 客户端缓存的版本仍然有效, 只发送报文头
+        status_code_ = 304;
+        setHeader("ETag", etag);
+        if (entry.gzip_len > 0)
+        {
+            setHeader("Vary", "Accept-Encoding");
+        }
+        setHeader("Connection", keep_alive_ ? "keep-alive" : "close");
+        string_view head = makeHead();
+        chain_.appendBorrowed(head.data(), head.size());
         return;
     }
-    // * 请求没有成功, 生成异常响应报文
-    handleExceptStatus();
+    size_t len = gzip ? entry.gzip_len : entry.data_len;
+    off_t offset = gzip ? entry.gzip_offset : entry.data_offset;
+    // 带上快照文件, 映射的数据不在页缓存中时交给磁盘线程读入
+    chain_.appendShared(snapshot_->data(entry, gzip), len, snapshot_->file(), offset);
+
+    setHeader("Content-Length", formatNumber(len));
+    setHeader("Content-Type", snapshot_->contentType(entry));
+    setHeader("ETag", etag);
+    if (entry.gzip_len > 0)
+    {
+        setHeader("Vary", "Accept-Encoding");
+    }
+    if (gzip)
+    {
+        setHeader("Content-Encoding", "gzip");
+    }
+    setHeader("Connection", keep_alive_ ? "keep-alive" : "close");
+    string_view head = makeHead();
+    chain_.prependBorrowed(head.data(), head.size());
+}
+
+string_view HttpResponse::makeHead()
+{
+    char code[16];
+    int code_len = std::snprintf(code, sizeof(code), "%d", status_code_);
+    auto it = code_to_text.find(status_code_);
+    string_view text = it == code_to_text.end() ? string_view() : string_view(it->second);
+    // 先计算长度, 一次分配
+    size_t len = http_version_.size() + 1 + code_len + 1 + text.size() + 2;
+    for (size_t i = 0; i < header_count_; ++i)
+    {
+        len += p_headers_[i].key.size() + 2 + p_headers_[i].value.size() + 2;
+    }
+    len += 2;
+    auto *head = static_cast<char *>(p_arena_->allocate(len, 1));
+    char *p = head;
+    auto put = [&p](string_view part) {
+        std::memcpy(p, part.data(), part.size());
+        p += part.size();
+    };
+    put(http_version_);
+    put(" ");
+    put(string_view(code, code_len));
+    put(" ");
+    put(text);
+    put("\r\n");
+    for (size_t i = 0; i < header_count_; ++i)
+    {
+        put(p_headers_[i].key);
+        put(": ");
+        put(p_headers_[i].value);
+        put("\r\n");
+    }
+    put("\r\n");
+    header_count_ = 0;
+    return string_view(head, len);
+}
+
+string_view HttpResponse::formatNumber(size_t value)
+{
+    char digits[24];
+    int len = std::snprintf(digits, sizeof(digits), "%zu", value);
+    return string_view(p_arena_->copy(digits, len), len);
+}
+
+void HttpResponse::setZeroCopyThreshold(size_t threshold)
+{
+    zerocopy_threshold_ = threshold;
+    if (threshold > 0 && !p_zerocopy_)
+    {
+        p_zerocopy_.reset(new ZeroCopyTracker);
+    }
+}
+
+void HttpResponse::recycle()
+{
+    chain_.clear();
+    status_code_ = 0;
+    waiting_disk_ = false;
+    keep_alive_ = false;
+    zerocopy_threshold_ = 0;
+    if (p_zerocopy_)
+    {
+        // 序号属于旧的socket, 新连接重新从0开始
+        p_zerocopy_->clear();
+    }
+    snapshot_.reset();
+    snapshot_entry_ = nullptr;
+    accept_gzip_ = false;
+    releaseMemory();
+    chain_.shrink();
+}
+
+void HttpResponse::releaseMemory()
+{
+    assert(chain_.empty());
+    // 这些字段引用请求的arena, 之后就会失效
+    file_path_ = string_view();
+    if_none_match_ = string_view();
 }
 
 // 向连接socket发送HTTP响应报文
-bool HttpResponse::write(int conn_sock, bool is_et)
+bool HttpResponse::write(int conn_sock, bool is_et, TlsSession *tls)
 {
+    // 记录加密已经卸载到内核时, 仍然直接对socket使用writev(2)/sendfile(2)
+    TlsSession *userspace_tls = (tls && !tls->ktlsSend()) ? tls : nullptr;
+    size_t written = 0;
     do
     {
-        ssize_t write_len = ::writev(conn_sock, iovec_arr, 2);
+        if (chain_.empty())
+        {
+            return true;
+        }
+        Segment &front = chain_.front();
+        // 文件数据不在页缓存中, 发送会阻塞在缺页或磁盘读上, 交给I/O线程读入后再继续
+        if (front.file && !checkResident(front))
+        {
+            waiting_disk_ = true;
+            return false;
+        }
+        bool in_memory = front.inMemory();
+        ssize_t write_len = in_memory ? writeMemory(conn_sock, userspace_tls)
+                                      : sendFileWindow(conn_sock, front, userspace_tls);
         if (write_len < 0)
         {
             if (errno == EWOULDBLOCK || errno == EAGAIN)
             {
                 break;
             }
-            LOG_ERROR("client:%d writev(): %s", conn_sock, strerror(errno));
+            LOG_ERROR("client:%d %s(): %s", conn_sock, in_memory ? "writev" : "sendfile", strerror(errno));
+            chain_.clear();
             return true;
         }
-        // 更新 iovec_arr[0]
-        auto buffer_len = iovec_arr[0].iov_len;
-        if (iovec_arr[0].iov_len > 0)
+        if (!in_memory && write_len == 0)
         {
-            if (write_len >= iovec_arr[0].iov_len)
+            // 发送过程中文件被截断, 无法再发送声明的长度
+            LOG_ERROR("client:%d file truncated while sending", conn_sock);
+            chain_.clear();
+            return true;
+        }
+        // 推进游标, 释放已经发送完的数据段
+        chain_.advance(write_len);
+        written += write_len;
+        if (written >= WRITE_BUDGET)
+        {
+            // socket仍然可写, 重新注册EPOLLOUT后立即触发, 由新的任务继续发送
+            break;
+        }
+    } while (is_et);
+    return chain_.empty();
+}
+
+ssize_t HttpResponse::writeMemory(int conn_sock, TlsSession *tls)
+{
+    if (tls)
+    {
+        // 用户态加密时按顺序写入第一个数据段
+        const Segment &front = chain_.front();
+        return tls->write(front.data(), front.remaining());
+    }
+    struct iovec iovecs[IOV_MAX];
+    int count = chain_.gatherIovecs(iovecs, IOV_MAX);
+    // 后面的映射文件数据不在页缓存中时不和前面的数据一起发送, 留到它成为第一个数据段时再处理
+    for (int i = 1; i < count; ++i)
+    {
+        Segment &segment = chain_.at(i);
+        if (segment.file && !checkResident(segment))
+        {
+            count = i;
+            break;
+        }
+    }
+    if (zerocopy_threshold_ > 0)
+    {
+        // 找到第一段连续的共享数据, 足够大时单独通过零拷贝发送, 前面的报文头等数据先正常发送
+        int owned_count = 0;
+        while (owned_count < count && chain_.at(owned_count).type != SegmentType::SHARED)
+        {
+            ++owned_count;
+        }
+        int shared_end = owned_count;
+        size_t shared_bytes = 0;
+        while (shared_end < count && chain_.at(shared_end).type == SegmentType::SHARED)
+        {
+            shared_bytes += iovecs[shared_end].iov_len;
+            ++shared_end;
+        }
+        if (shared_bytes >= zerocopy_threshold_)
+        {
+            if (owned_count > 0)
             {
-                buffer_.retrieve(buffer_len);
-                iovec_arr[0].iov_len = 0;
-                iovec_arr[0].iov_base = nullptr;
+                // MSG_MORE让报文头和随后零拷贝发送的主体合并成完整的TCP报文段
+                struct msghdr msg;
+                std::memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iovecs;
+                msg.msg_iovlen = owned_count;
+                return ::sendmsg(conn_sock, &msg, MSG_MORE);
             }
-            else
+            ssize_t write_len = sendZeroCopy(conn_sock, iovecs, shared_end);
+            if (write_len >= 0 || errno != ENOBUFS)
             {
-                buffer_.retrieve(write_len);
-                iovec_arr[0].iov_len -= write_len;
-                iovec_arr[0].iov_base = const_cast<char *>(buffer_.peek());
+                return write_len;
             }
+            // 锁定的页超过了optmem_max的限制, 这次退回到复制
+            ++ZeroCopyStats::fallbacks;
         }
-        // 更新 iovec_arr[1]
-        if (buffer_len < write_len)
+    }
+    return ::writev(conn_sock, iovecs, count);
+}
+
+ssize_t HttpResponse::sendZeroCopy(int conn_sock, struct iovec *iovecs, int count)
+{
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iovecs;
+    msg.msg_iovlen = count;
+    ssize_t write_len = ::sendmsg(conn_sock, &msg, MSG_ZEROCOPY);
+    if (write_len <= 0)
+    {
+        // 失败的发送不占用序号
+        return write_len;
+    }
+    // 内核引用了用户态的页, 发送涉及的数据段在完成通知到达之前不能释放
+    uint32_t seq = p_zerocopy_->nextSeq();
+    size_t pinned_len = 0;
+    for (int i = 0; i < count && pinned_len < static_cast<size_t>(write_len); ++i)
+    {
+        p_zerocopy_->pin(seq, chain_.at(i).shared);
+        pinned_len += iovecs[i].iov_len;
+    }
+    ++ZeroCopyStats::sends;
+    ZeroCopyStats::bytes += write_len;
+    return write_len;
+}
+
+ssize_t HttpResponse::sendFileWindow(int conn_sock, Segment &segment, TlsSession *tls)
+{
+    advanceReadahead(segment);
+    off_t offset = segment.filePos();
+    if (tls)
+    {
+        // 用户态加密无法使用sendfile(2), 读出一个TLS记录大小的数据再加密发送
+        // 重试时从相同偏移读取相同长度, 满足SSL_write()重试的要求
+        thread_local std::vector<char> chunk(TLS_FILE_CHUNK);
+        size_t len = std::min(chunk.size(), segment.remaining());
+        ssize_t read_len = ::pread(segment.file->fd(), chunk.data(), len, offset);
+        if (read_len <= 0)
         {
-            iovec_arr[1].iov_len  -= write_len - buffer_len;
-            iovec_arr[1].iov_base = static_cast<char *>(iovec_arr[1].iov_base) +
-                                    write_len - buffer_len;
-            if (iovec_arr[1].iov_len == 0)
-            {
-                munmap(file_addr_, file_stat_.st_size);
-                file_addr_ = nullptr;
-            }
+            return read_len;
         }
-        if (iovec_arr[0].iov_len == 0 && iovec_arr[1].iov_len == 0)
+        return tls->write(chunk.data(), read_len);
+    }
+    size_t window = std::min(SEND_FILE_WINDOW, segment.remaining());
+    return ::sendfile(conn_sock, segment.file->fd(), &offset, window);
+}
+
+void HttpResponse::advanceReadahead(Segment &segment)
+{
+    // 预读位置与发送位置的距离不足半个窗口时, 再预读一个窗口
+    off_t end = segment.file_offset + static_cast<off_t>(segment.len);
+    if (segment.readahead_pos >= end ||
+        segment.readahead_pos - segment.filePos() > READAHEAD_WINDOW / 2)
+    {
+        return;
+    }
+    off_t len = std::min<off_t>(READAHEAD_WINDOW, end - segment.readahead_pos);
+    ::posix_fadvise(segment.file->fd(), segment.readahead_pos, len, POSIX_FADV_WILLNEED);
+    segment.readahead_pos += len;
+}
+
+bool HttpResponse::checkResident(Segment &segment)
+{
+    off_t pos = segment.filePos();
+    if (pos < segment.resident_pos)
+    {
+        return true;
+    }
+    // 以RWF_NOWAIT每隔DISK_PROBE_STRIDE读取1字节, 数据不在页缓存中时返回EAGAIN而不会等待磁盘
+    off_t end = std::min<off_t>(pos + DISK_PROBE_WINDOW,
+                                segment.file_offset + static_cast<off_t>(segment.len));
+    off_t off = pos;
+    while (true)
+    {
+        char byte;
+        struct iovec probe = {&byte, 1};
+        if (::preadv2(segment.file->fd(), &probe, 1, off, RWF_NOWAIT) < 0 && errno == EAGAIN)
         {
-            // 数据全部发送完
-            return true;
+            return false;
         }
-    } while (is_et);
-    return false;
+        if (off == end - 1)
+        {
+            break;
+        }
+        // 最后一个字节所在的页也要检查
+        off = std::min(off + DISK_PROBE_STRIDE, end - 1);
+    }
+    segment.resident_pos = end;
+    return true;
+}
+
+void HttpResponse::loadFileData()
+{
+    assert(!chain_.empty() && chain_.front().file);
+    Segment &segment = chain_.front();
+    int fd = segment.file->fd();
+    // I/O线程上通过pread(2)把数据读入页缓存, 阻塞只发生在I/O线程上
+    thread_local std::vector<char> scratch(DISK_PROBE_STRIDE);
+    off_t pos = segment.filePos();
+    off_t end = std::min<off_t>(pos + DISK_PROBE_WINDOW,
+                                segment.file_offset + static_cast<off_t>(segment.len));
+    ::posix_fadvise(fd, pos, end - pos, POSIX_FADV_WILLNEED);
+    for (off_t off = pos; off < end; )
+    {
+        ssize_t read_len = ::pread(fd, scratch.data(),
+                                   std::min<off_t>(scratch.size(), end - off), off);
+        if (read_len <= 0)
+        {
+            break;
+        }
+        off += read_len;
+    }
+    segment.resident_pos = end;
+    waiting_disk_ = false;
 }
 
 void HttpResponse::handleExceptStatus()
 {
-    auto content = getHtmlString(code_to_text[status_code_]);
-    addStatusLine();
+    auto it = code_to_text.find(status_code_);
+    string_view content = getHtmlString(it == code_to_text.end() ? string_view() : string_view(it->second));
     setHeader("Connection", keep_alive_ ? "keep-alive" : "close");
-    setHeader("Content-Length", std::to_string(content.size()));
+    setHeader("Content-Length", formatNumber(content.size()));
     setHeader("Content-Type", "text/html");
-    addHeaders();
-    addCrlfLine();
-    addContent(content);
-
-    iovec_arr[0].iov_base = const_cast<char *>(buffer_.peek());
-    iovec_arr[0].iov_len = buffer_.readableBytes();
-    iovec_arr[1].iov_base = nullptr;
-    iovec_arr[1].iov_len = 0;
+    string_view head = makeHead();
+    chain_.appendBorrowed(head.data(), head.size());
+    chain_.appendBorrowed(content.data(), content.size());
 }
 
 // 根据文件后缀名获取文件类型
-string HttpResponse::getFileType() const
+string_view HttpResponse::getFileType() const
 {
     auto pos = file_path_.find_last_of('.');
-    if (pos == std::string::npos)
+    if (pos == string_view::npos)
     {
         return "";
     }
     auto suffix = file_path_.substr(pos + 1);
-    if (suffix_to_type.count(suffix))
+    // 表很小, 逐项比较避免为查找构造std::string
+    for (const auto &p : suffix_to_type)
     {
-        return suffix_to_type[suffix];
+        if (p.first == suffix)
+        {
+            return p.second;
+        }
     }
     return "";
 }
 
-// 生成简单的HTML页面
-std::string HttpResponse::getHtmlString(const std::string &content)
+// 在arena中生成简单的HTML页面
+string_view HttpResponse::getHtmlString(string_view content)
 {
-    return "<html>"
-            "  <head>"
-            "    <title>"
-            "      Http Server"
-            "    </title>"
-            "  </head>"
-            "  <body>"
-            + content +
-            "  </body>"
-            "</html>";
+    return p_arena_->concat({"<html>"
+                             "  <head>"
+                             "    <title>"
+                             "      Http Server"
+                             "    </title>"
+                             "  </head>"
+                             "  <body>",
+                             content,
+                             "  </body>"
+                             "</html>"});
 }
@@ -1,69 +1,138 @@
 #ifndef HTTPSERVER_HTTP_HTTP_RESPONSE_H
 #define HTTPSERVER_HTTP_HTTP_RESPONSE_H
 
-#include <buffer/Buffer.h>
+#include <buffer/Arena.h>
+#include <buffer/SegmentChain.h>
+#include <buffer/ZeroCopy.h>
+#include <snapshot/Snapshot.h>
+#include <tls/TlsSession.h>
 
 #include <sys/uio.h>
 #include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <cassert>
 
 class HttpResponse
 {
 public:
-    using Headers = std::unordered_map<std::string, std::string>;
+    // 响应报文头字段, 引用常量字符串或者请求arena中的数据
+    struct HeaderField
+    {
+        std::string_view key;
+        std::string_view value;
+    };
 
 public:
     HttpResponse()
-      : buffer_(),
+      : p_arena_(nullptr),
         status_code_(),
         http_version_("/HTTP1.1"),
-        headers_(),
+        p_headers_(nullptr),
+        header_count_(0),
         file_path_(),
-        iovec_arr(),
-        file_addr_(nullptr),
-        file_stat_({0}),
+        snapshot_(),
+        snapshot_entry_(nullptr),
+        accept_gzip_(false),
+        if_none_match_(),
+        chain_(),
+        waiting_disk_(false),
+        zerocopy_threshold_(0),
+        p_zerocopy_(),
         keep_alive_(false)
     {}
 
-    HttpResponse(const HttpResponse &) = default;
+    HttpResponse(const HttpResponse &) = delete;
 
     HttpResponse(HttpResponse &&) = default;
 
-    HttpResponse &operator=(const HttpResponse &) = default;
+    HttpResponse &operator=(const HttpResponse &) = delete;
 
     HttpResponse &operator=(HttpResponse &&) = default;
 
-    ~HttpResponse() {
-        if (file_addr_)
-        {
-            ::munmap(file_addr_, file_stat_.st_size);
-            file_addr_ = nullptr;
-        }
-    }
+    ~HttpResponse() = default;
 
 public:
     void setStatusCode(int status_code) { status_code_ = status_code; }
 
-    void setFilePath(const std::string &file_path) { file_path_ = file_path; }
+    // 文件路径需要以'\0'结尾, 并且在init()之前有效
+    void setFilePath(std::string_view file_path) { file_path_ = file_path; }
 
-    void setHttpVersion(const std::string &http_version) { http_version_ = http_version; }
+    void setHttpVersion(std::string_view http_version) { http_version_ = http_version; }
 
     void setKeepAlive(bool keep_alive) { keep_alive_ = keep_alive; }
 
+    // 从静态资源快照生成响应, snapshot为空时从setFilePath()的文件生成响应
+    // entry为空表示快照中没有请求的资源
+    void setSnapshotEntry(std::shared_ptr<const Snapshot> snapshot, const SnapshotEntry *entry)
+    {
+        snapshot_ = std::move(snapshot);
+        snapshot_entry_ = entry;
+    }
+
+    // 客户端是否接受gzip编码(Accept-Encoding), 只对快照中带有gzip版本的资源有效
+    void setAcceptGzip(bool accept_gzip) { accept_gzip_ = accept_gzip; }
+
+    // 请求的If-None-Match, 与快照中资源的ETag相同时返回304
+    void setIfNoneMatch(std::string_view etag) { if_none_match_ = etag; }
+
+    // 连续的共享数据达到threshold字节时通过MSG_ZEROCOPY发送, 0表示不使用零拷贝
+    // socket需要已经开启SO_ZEROCOPY
+    void setZeroCopyThreshold(size_t threshold);
+
 public:
-    // 生成HTTP报文将其写入缓冲区
-    void init();
+    // 生成HTTP报文: 报文头以及主体的各个数据段依次放入发送链
+    // 报文头等数据从arena分配, arena需要在报文发送完成之前有效
+    void init(Arena &arena);
 
     // 向连接socket发送HTTP响应报文
     // 报文发送完成返回true, 否则返回false
-    bool write(int conn_sock, bool is_et);
+    // 即将发送的文件数据不在页缓存中时不会阻塞在缺页上, 而是设置waitingForDisk()并返回false
+    // 一次最多发送WRITE_BUDGET字节, 大文件分多个任务发送, 不长时间占用工作线程
+    // tls不为空时通过TLS会话发送
+    bool write(int conn_sock, bool is_et, TlsSession *tls = nullptr);
+
+    // 持久连接空闲时释放对请求数据的引用, 下一次init()时重新设置
+    // 发送链的数据段数组保留容量, 等待内核确认的零拷贝数据仍然保留
+    void releaseMemory();
+
+    // 连接对象复用: 清空所有状态并释放内存, 丢弃旧连接没有完成的零拷贝发送
+    void recycle();
+
+    // 报文是否已经全部发送
+    bool finished() const { return chain_.empty(); }
+
+    // 还没有发送的字节数
+    size_t pendingBytes() const { return chain_.bytes(); }
+
+    bool zeroCopyEnabled() const { return zerocopy_threshold_ > 0; }
+
+    // 是否还有内核没有确认完成的零拷贝发送
+    bool zeroCopyPending() const { return p_zerocopy_ && p_zerocopy_->pending(); }
+
+    // * EPOLLERR触发
+    // 读取零拷贝完成通知, socket出现了真正的错误时返回false
+    bool reapZeroCopy(int conn_sock) { return p_zerocopy_->reap(conn_sock); }
+
+    // 是否在等待I/O线程把文件数据读入页缓存
+    bool waitingForDisk() const { return waiting_disk_; }
+
+    // * I/O线程调用
+    // 将即将发送的一段文件数据读入页缓存, 之后可以继续write()
+    void loadFileData();
 
 public:
+    static constexpr off_t STREAM_FILE_THRESHOLD = 1024 * 1024;     // 超过1MiB的文件不再整体映射, 按窗口流式发送
+    static constexpr size_t SEND_FILE_WINDOW = 256 * 1024;          // 每次sendfile(2)最多发送256KiB
+    static constexpr off_t READAHEAD_WINDOW = 2 * 1024 * 1024;      // 在发送位置之前保持2MiB的预读
+    static constexpr off_t DISK_PROBE_WINDOW = 1024 * 1024;         // 每次检查/读入页缓存的文件范围
+    static constexpr off_t DISK_PROBE_STRIDE = 64 * 1024;           // 检查页缓存时的采样间隔
+    static constexpr size_t WRITE_BUDGET = 1024 * 1024;             // 一次write()最多发送1MiB, 之后让出工作线程
+    static constexpr size_t TLS_FILE_CHUNK = 16 * 1024;             // 用户态TLS每次读出加密的文件数据
+    static constexpr size_t MAX_HEADERS = 8;                        // 一个响应最多的报文头字段数目
+
     static std::unordered_map<int, std::string> code_to_text;            // 响应码到原因短语的映射
 
     static std::unordered_map<std::string, std::string> suffix_to_type;  // 文件后缀映射到响应报文content-type
@@ -72,58 +141,66 @@ private:
     // 统一处理异常响应(状态码不是200)
     void handleExceptStatus();
 
-private:
-    void addStatusLine()
-    {
-        const std::string line = http_version_ + " " +
-                                 std::to_string(status_code_) + " " +
-                                 code_to_text[status_code_] + "\r\n";
-        buffer_.append(line.data(), line.size());
-    }
+    // 从快照中的资源生成响应, 资源内容直接引用快照的映射
+    void initFromSnapshot();
 
-    void setHeader(const std::string &key, const std::string &value)
-    {
-        headers_[key] = value;
-    }
+    // 从发送链的游标开始一次writev(2)最多IOV_MAX个内存数据段, tls不为空时在用户态加密后发送
+    // 返回writev(2)的返回值
+    ssize_t writeMemory(int conn_sock, TlsSession *tls);
 
-    void addHeaders()
-    {
-        for (const auto &p : headers_)
-        {
-            const std::string header = p.first + ": " + p.second + "\r\n";
-            buffer_.append(header.data(), header.size());
-        }
-    }
+    // 通过sendmsg(MSG_ZEROCOPY)发送iovecs对应的共享数据段, 并保留数据直到内核确认完成
+    // 返回sendmsg(2)的返回值
+    ssize_t sendZeroCopy(int conn_sock, struct iovec *iovecs, int count);
 
-    void addCrlfLine()
-    {
-        buffer_.append("\r\n", 2);
-    }
+    // 文件数据段: 通过sendfile(2)从当前偏移处发送一个窗口的数据, tls不为空时在用户态加密后发送
+    // 返回sendfile(2)的返回值
+    ssize_t sendFileWindow(int conn_sock, Segment &segment, TlsSession *tls);
+
+    // 在发送位置之前预读文件, 让sendfile(2)尽量命中页缓存
+    void advanceReadahead(Segment &segment);
+
+    // 数据段即将发送的文件数据是否已经在页缓存中
+    bool checkResident(Segment &segment);
 
-    void addContent(const std::string &content)
+private:
+    void setHeader(std::string_view key, std::string_view value)
     {
-        buffer_.append(content.data(), content.size());
+        assert(header_count_ < MAX_HEADERS);
+        p_headers_[header_count_++] = {key, value};
     }
 
+    // 把状态行, 报文头字段以及空行拼接到arena中
+    std::string_view makeHead();
+
+    // 在arena中格式化数字
+    std::string_view formatNumber(size_t value);
 
 private:
     // 根据文件后缀名获取文件类型
-    std::string getFileType() const;
+    std::string_view getFileType() const;
 
-    // 生成简单的HTML页面
-    std::string getHtmlString(const std::string &content);
+    // 在arena中生成简单的HTML页面
+    std::string_view getHtmlString(std::string_view content);
 
 private:
-    Buffer buffer_;
+    Arena *p_arena_;            // 只在init()期间使用, 由请求提供
 
     int status_code_;
-    std::string http_version_;
-    Headers headers_;
-    std::string file_path_;
+    std::string_view http_version_;
+    HeaderField *p_headers_;    // 正在生成的报文头字段, init()时从arena分配MAX_HEADERS个
+    size_t header_count_;
+    std::string_view file_path_;
+
+    std::shared_ptr<const Snapshot> snapshot_;  // 只在init()期间持有, 发送中的数据段各自引用快照
+    const SnapshotEntry *snapshot_entry_;
+    bool accept_gzip_;
+    std::string_view if_none_match_;
+
+    SegmentChain chain_;        // 需要发送的报文头以及主体
+    bool waiting_disk_;         // 等待I/O线程读入文件数据
 
-    struct iovec iovec_arr[2];  // iovecs[0]指向缓冲区 iovecs[1]指向需要发送的文件
-    void *file_addr_;           // 装载文件的内存地址
-    struct stat file_stat_;
+    size_t zerocopy_threshold_;     // 通过MSG_ZEROCOPY发送的最小字节数, 0表示不使用
+    std::unique_ptr<ZeroCopyTracker> p_zerocopy_;   // 等待内核确认的零拷贝发送, 跨越keep-alive的多个响应, 开启零拷贝时才分配
 
     bool keep_alive_;
 
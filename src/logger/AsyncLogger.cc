@@ -1,8 +1,14 @@
 #include "logger/AsyncLogger.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cassert>
 #include <cstdio>
 #include <ctime>
 #include <cerrno>
@@ -16,21 +22,60 @@
 using std::thread;
 using std::string;
 using std::lock_guard;
+using std::unique_lock;
 using std::mutex;
 using std::vector;
 using std::min;
-using std::to_string;
+
+std::atomic<int> AsyncLogger::enabled_level_(LOG_DISABLED);
+std::atomic<bool> AsyncLogger::binary_(false);
+
+AsyncLogger::ThreadBuffer::ThreadBuffer(size_t capacity)
+  : data(new char[capacity]),
+    mask(capacity - 1)
+{}
+
+AsyncLogger::LocalBuffer::~LocalBuffer()
+{
+    if (p_buffer)
+    {
+        p_buffer->retired.store(true, std::memory_order_release);
+    }
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    enabled_level_.store(LOG_DISABLED, std::memory_order_relaxed);
+    {
+        lock_guard<mutex> guard(lock_);
+        stopped_ = true;
+    }
+    wakeup_cond_.notify_all();
+    space_cond_.notify_all();
+    if (worker_.joinable())
+    {
+        worker_.join();
+    }
+    closeLogfile();
+}
 
 void AsyncLogger::init(LogLevel filter_level, const std::string &log_path,
-                       const std::string &log_suffix, int file_max_line, int block_queue_size)
+                       const std::string &log_suffix, int file_max_line, int block_queue_size, LogFormat format)
 {
     opened_ = true;
     filter_level_ = filter_level;
+    format_ = format;
 
     log_path_ = log_path;
     log_suffix_ = log_suffix;
     log_file_max_lineno_ = file_max_line;
-    block_queue_.setCapactity(block_queue_size);
+    size_t capacity = std::max(static_cast<size_t>(block_queue_size) * AVERAGE_LINE_LEN, MIN_BUFFER_CAPACITY);
+    buffer_capacity_ = MIN_BUFFER_CAPACITY;
+    while (buffer_capacity_ < capacity)
+    {
+        buffer_capacity_ *= 2;
+    }
+    flush_bytes_ = buffer_capacity_ / 4;
 
     // 获取当前时间
     time_t now = time(nullptr);
@@ -41,10 +86,14 @@ void AsyncLogger::init(LogLevel filter_level, const std::string &log_path,
     }
 
     // 打开日志文件
+    rotator_.start(log_path_, log_suffix_, rotation_);
     openLogfile();
 
     // 创建异步写入日志数据的线程
     worker_ = thread(&AsyncLogger::threadFunc, this);
+
+    binary_.store(format_ == LogFormat::BINARY, std::memory_order_relaxed);
+    enabled_level_.store(static_cast<int>(filter_level_), std::memory_order_relaxed);
 }
 
 // 输出日志
@@ -54,126 +103,713 @@ void AsyncLogger::log(LogLevel level, const char *fmt, ...)
     {
         return;
     }
+    ThreadBuffer *p_buffer = localBuffer();
+    if (format_ == LogFormat::BINARY)
+    {
+        // 二进制模式下没有通过LOG_*宏输出的日志保存格式化好的文本
+        char *record = p_buffer->line;
+        int start = sizeof(LogRecordHeader);
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(record + start, sizeof(p_buffer->line) - start, fmt, args);
+        va_end(args);
+        start += std::max(0, min<int>(len, sizeof(p_buffer->line) - start - 1));
+        fillRecordHeader(record, start, LogRecordType::TEXT, level, 0);
+        append(p_buffer, level, record, start);
+        return;
+    }
+
     time_t now = time(nullptr);
-    struct tm log_tm;
-    auto ret = localtime_r(&now, &log_tm);
-    if (ret == nullptr)
+    if (now != p_buffer->cached_second)
     {
-        fprintf(stderr, "localtime_r(): %s\n", strerror(errno));
+        struct tm log_tm;
+        auto ret = localtime_r(&now, &log_tm);
+        if (ret == nullptr)
+        {
+            fprintf(stderr, "localtime_r(): %s\n", strerror(errno));
+        }
+        p_buffer->prefix_len = strftime(p_buffer->prefix, STR_TIME_LEN, "%Y-%m-%d %H:%M:%S ", &log_tm);
+        p_buffer->cached_second = now;
     }
 
-    vector<char> line(LOG_FILE_MAX_LINE_LEN + 2);
-    int start = 0;
-    start += appendTimestamp(line.data() + start, LOG_FILE_MAX_LINE_LEN - start, log_tm);
-    start += appendLogLevel(line.data() + start, LOG_FILE_MAX_LINE_LEN - start, level);
+    char *line = p_buffer->line;
+    int start = p_buffer->prefix_len;
+    memcpy(line, p_buffer->prefix, start);
+    start += appendLogLevel(line + start, level);
     va_list args;
     va_start(args, fmt);
-    int len = vsnprintf(line.data() + start, LOG_FILE_MAX_LINE_LEN- start, fmt, args);
+    int len = vsnprintf(line + start, LOG_FILE_MAX_LINE_LEN - start, fmt, args);
+    va_end(args);
     if (len >= LOG_FILE_MAX_LINE_LEN - start)
     {
         fprintf(stderr, "vsnprintf(): output was truncated\n");
-        start = LOG_FILE_MAX_LINE_LEN;
+        start = LOG_FILE_MAX_LINE_LEN - 1;
     }
-    else
+    else if (len > 0)
     {
         start += len;
     }
-    strncat(line.data() + start, "\n\0", 2);
-    start += 2;
-    va_end(args);
-    line.resize(start);
-    line.shrink_to_fit();
+    line[start++] = '\n';
 
-    block_queue_.put(std::move(line));
+    append(p_buffer, level, line, start);
 }
-   
-int AsyncLogger::appendTimestamp(char *start, int len, const struct tm &log_tm)
+
+int AsyncLogger::appendLogLevel(char *start, LogLevel level)
 {
-    char str_time[STR_TIME_LEN];
-    int write_len = strftime(str_time, STR_TIME_LEN, "%Y-%m-%d %H:%M:%S ", &log_tm);
-    strncpy(start, str_time, len);
-    return min(write_len, len);
+    auto prefix = logLevelPrefix(static_cast<int>(level));
+    memcpy(start, prefix.data(), prefix.size());
+    return prefix.size();
+}
+
+void AsyncLogger::fillRecordHeader(char *record, size_t size, LogRecordType type, LogLevel level, uint32_t format_id)
+{
+    // 粗粒度的时钟只读取内核更新的时间, 不需要读取硬件计时器
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    LogRecordHeader header;
+    header.size = static_cast<uint32_t>(size);
+    header.type = static_cast<uint16_t>(type);
+    header.level = static_cast<uint16_t>(level);
+    header.format_id = format_id;
+    header.reserved = 0;
+    header.timestamp_ns = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    memcpy(record, &header, sizeof(header));
+}
+
+uint32_t AsyncLogger::registerFormat(const char *fmt, const char *file, int line)
+{
+    lock_guard<mutex> guard(formats_lock_);
+    formats_.push_back({fmt, file, line});
+    return static_cast<uint32_t>(formats_.size());
+}
+
+void AsyncLogger::encodeFormats()
+{
+    preamble_.clear();
+    lock_guard<mutex> guard(formats_lock_);
+    for (; formats_written_ < formats_.size(); ++formats_written_)
+    {
+        const FormatSite &site = formats_[formats_written_];
+        size_t fmt_len = strlen(site.fmt) + 1;
+        size_t file_len = strlen(site.file) + 1;
+        uint32_t line = site.line;
+        size_t size = sizeof(LogRecordHeader) + sizeof(line) + fmt_len + file_len;
+        size_t start = preamble_.size();
+        preamble_.resize(start + size);
+        char *record = &preamble_[start];
+        fillRecordHeader(record, size, LogRecordType::FORMAT, LogLevel::DEBUG, formats_written_ + 1);
+        record += sizeof(LogRecordHeader);
+        memcpy(record, &line, sizeof(line));
+        memcpy(record + sizeof(line), site.fmt, fmt_len);
+        memcpy(record + sizeof(line) + fmt_len, site.file, file_len);
+    }
+}
+
+AsyncLogger::ThreadBuffer *AsyncLogger::localBuffer()
+{
+    thread_local LocalBuffer local;
+    if (local.p_buffer == nullptr)
+    {
+        std::unique_ptr<ThreadBuffer> p_buffer(new ThreadBuffer(buffer_capacity_));
+        local.p_buffer = p_buffer.get();
+        lock_guard<mutex> guard(lock_);
+        buffers_.push_back(std::move(p_buffer));
+    }
+    return local.p_buffer;
+}
+
+void AsyncLogger::append(ThreadBuffer *p_buffer, LogLevel level, const char *line, size_t len)
+{
+    size_t capacity = p_buffer->mask + 1;
+    uint64_t head = p_buffer->head.load(std::memory_order_relaxed);
+    uint64_t tail = p_buffer->tail.load(std::memory_order_acquire);
+    size_t limit = capacity;
+    if (overflow_ == LogOverflow::DROP_BY_LEVEL)
+    {
+        // 给级别高的日志保留空间
+        limit = level == LogLevel::DEBUG ? capacity / 2 : level == LogLevel::INFO ? capacity / 4 * 3 : capacity;
+    }
+    if (head + len - tail > limit && !overflow(p_buffer, level, head, len, tail))
+    {
+        return;
+    }
+
+    size_t pos = head & p_buffer->mask;
+    size_t first = min(len, capacity - pos);
+    memcpy(p_buffer->data.get() + pos, line, first);
+    memcpy(p_buffer->data.get(), line + first, len - first);
+    p_buffer->records.store(p_buffer->records.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    p_buffer->head.store(head + len, std::memory_order_release);
+
+    // 只在积累的数据越过阈值时唤醒一次, 其余的由后台线程定时写出
+    size_t used = head + len - tail;
+    if (used >= flush_bytes_ && used - len < flush_bytes_)
+    {
+        wakeup();
+    }
 }
 
-int AsyncLogger::appendLogLevel(char *start, int len, LogLevel level)
+bool AsyncLogger::overflow(ThreadBuffer *p_buffer, LogLevel level, uint64_t head, size_t len, uint64_t &tail)
 {
-    int write_len = 0;
-    const char *level_str = nullptr;
-    switch(level)    
+    size_t capacity = p_buffer->mask + 1;
+    if (overflow_ == LogOverflow::BLOCK)
     {
-        case LogLevel::DEBUG:
+        // 等待后台线程写出
+        wakeup();
+        unique_lock<mutex> guard(lock_);
+        space_cond_.wait(guard, [&]() {
+            tail = p_buffer->tail.load(std::memory_order_acquire);
+            return stopped_ || head + len - tail <= capacity;
+        });
+        return head + len - tail <= capacity;
+    }
+    if (overflow_ == LogOverflow::DROP_BY_LEVEL && level >= LogLevel::WARN)
+    {
+        // 只挤掉DEBUG/INFO; 后台线程正在读取或者缓冲区中都是WARN以上的日志时等待写出, 超时才丢弃
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(OVERFLOW_WAIT_MS);
+        while (!dropLowLevel(p_buffer, head + len - capacity, tail))
         {
-            level_str = "[DEBUG] : ";
-            break;
+            wakeup();
+            unique_lock<mutex> guard(lock_);
+            space_cond_.wait_for(guard, std::chrono::milliseconds(1), [&]() {
+                tail = p_buffer->tail.load(std::memory_order_acquire);
+                return stopped_ || head + len - tail <= capacity;
+            });
+            if (head + len - tail <= capacity)
+            {
+                return true;
+            }
+            if (stopped_ || std::chrono::steady_clock::now() >= deadline)
+            {
+                countDrop(p_buffer, static_cast<int>(level));
+                return false;
+            }
         }
-        case LogLevel::INFO:
+        return true;
+    }
+    // 丢弃日志时不唤醒后台线程: 越过flush_bytes_时已经唤醒过, 通常正阻塞在写文件上
+    if (overflow_ == LogOverflow::DROP_OLDEST && dropOldest(p_buffer, head + len - capacity, tail))
+    {
+        return true;
+    }
+    countDrop(p_buffer, static_cast<int>(level));
+    return false;
+}
+
+bool AsyncLogger::dropOldest(ThreadBuffer *p_buffer, uint64_t min_tail, uint64_t &tail)
+{
+    // 后台线程只在复制数据时持有claimed, 这时只能丢弃新的日志
+    if (p_buffer->claimed.exchange(true, std::memory_order_acquire))
+    {
+        return false;
+    }
+    // 丢弃的日志仍然计入日志文件的条数
+    uint64_t head = p_buffer->head.load(std::memory_order_relaxed);
+    tail = p_buffer->tail.load(std::memory_order_relaxed);
+    while (tail < min_tail && tail < head)
+    {
+        size_t size;
+        int level;
+        recordAt(p_buffer, tail, head, size, level);
+        tail += size;
+        countDrop(p_buffer, level);
+    }
+    p_buffer->tail.store(tail, std::memory_order_release);
+    p_buffer->claimed.store(false, std::memory_order_release);
+    return true;
+}
+
+bool AsyncLogger::dropLowLevel(ThreadBuffer *p_buffer, uint64_t min_tail, uint64_t &tail)
+{
+    if (p_buffer->claimed.exchange(true, std::memory_order_acquire))
+    {
+        return false;
+    }
+    uint64_t head = p_buffer->head.load(std::memory_order_relaxed);
+    tail = p_buffer->tail.load(std::memory_order_relaxed);
+    // 扫描最旧的日志, 复制出要保留的WARN以上的日志, 丢弃的字节数足够时停止
+    std::string &kept = p_buffer->kept;
+    kept.clear();
+    uint64_t dropped[LOG_LEVEL_COUNT] = {};
+    uint64_t pos = tail;
+    size_t freed = 0;
+    while (tail + freed < min_tail && pos < head)
+    {
+        size_t size;
+        int level;
+        recordAt(p_buffer, pos, head, size, level);
+        if (level < static_cast<int>(LogLevel::WARN))
         {
-            level_str = "[INFO] : ";
-            break;
+            freed += size;
+            ++dropped[level];
         }
-        case LogLevel::WARN:
+        else
         {
-            level_str = "[WARN] : ";
-            break;
+            size_t start = pos & p_buffer->mask;
+            size_t first = min(size, p_buffer->mask + 1 - start);
+            kept.append(p_buffer->data.get() + start, first);
+            kept.append(p_buffer->data.get(), size - first);
         }
-        case LogLevel::ERROR:
+        pos += size;
+    }
+    if (tail + freed < min_tail)
+    {
+        p_buffer->claimed.store(false, std::memory_order_release);
+        return false;
+    }
+    // 保留的日志写回到扫描过的区域的末尾, 之前的空间释放
+    tail = pos - kept.size();
+    size_t start = tail & p_buffer->mask;
+    size_t first = min(kept.size(), p_buffer->mask + 1 - start);
+    memcpy(p_buffer->data.get() + start, kept.data(), first);
+    memcpy(p_buffer->data.get(), kept.data() + first, kept.size() - first);
+    for (int level = 0; level < LOG_LEVEL_COUNT; ++level)
+    {
+        if (dropped[level] > 0)
         {
-            level_str = "[ERROR] : ";
-            break;
+            countDrop(p_buffer, level, dropped[level]);
         }
-        case LogLevel::FATAL:
+    }
+    p_buffer->tail.store(tail, std::memory_order_release);
+    p_buffer->claimed.store(false, std::memory_order_release);
+    return true;
+}
+
+void AsyncLogger::recordAt(const ThreadBuffer *p_buffer, uint64_t pos, uint64_t head, size_t &size, int &level) const
+{
+    const char *data = p_buffer->data.get();
+    size_t capacity = p_buffer->mask + 1;
+    // 复制记录开头的若干字节, 可能跨过缓冲区末尾
+    auto peek = [&](char *dst, size_t len) {
+        len = min<size_t>(len, head - pos);
+        size_t start = pos & p_buffer->mask;
+        size_t first = min(len, capacity - start);
+        memcpy(dst, data + start, first);
+        memcpy(dst + first, data, len - first);
+        return len;
+    };
+    if (format_ == LogFormat::BINARY)
+    {
+        LogRecordHeader header;
+        if (peek(reinterpret_cast<char *>(&header), sizeof(header)) < sizeof(header) || header.size == 0)
         {
-            level_str = "[FATAL] : ";
-            break;
+            size = head - pos;
+            level = static_cast<int>(LogLevel::INFO);
+            return;
+        }
+        size = min<size_t>(header.size, head - pos);
+        level = min<int>(header.level, LOG_LEVEL_COUNT - 1);
+        return;
+    }
+
+    // 文本日志以换行结束, 时间前缀之后是"[级别]"
+    size_t start = pos & p_buffer->mask;
+    size_t len = head - pos;
+    size_t first = min(len, capacity - start);
+    auto p_end = static_cast<const char *>(memchr(data + start, '\n', first));
+    if (p_end)
+    {
+        size = p_end - (data + start) + 1;
+    }
+    else
+    {
+        p_end = static_cast<const char *>(memchr(data, '\n', len - first));
+        size = p_end ? first + (p_end - data) + 1 : len;
+    }
+    // 消息中带换行时后面的部分找不到级别, 按INFO统计
+    constexpr size_t TIME_PREFIX_LEN = sizeof("YYYY-mm-dd HH:MM:SS ") - 1;
+    static constexpr char LEVEL_LETTERS[] = "DIWEF";
+    char prefix[TIME_PREFIX_LEN + 2];
+    level = static_cast<int>(LogLevel::INFO);
+    if (peek(prefix, sizeof(prefix)) == sizeof(prefix) && prefix[TIME_PREFIX_LEN] == '[' && prefix[TIME_PREFIX_LEN + 1])
+    {
+        const char *p_level = strchr(LEVEL_LETTERS, prefix[TIME_PREFIX_LEN + 1]);
+        if (p_level)
+        {
+            level = p_level - LEVEL_LETTERS;
         }
-        default:
-            break;
     }
-    assert(level_str);
-    strncpy(start, level_str, len);
-    return strlen(level_str);
+}
+
+void AsyncLogger::wakeup()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        wakeup_ = true;
+    }
+    wakeup_cond_.notify_one();
+}
+
+void AsyncLogger::sync()
+{
+    if (!opened_)
+    {
+        return;
+    }
+    unique_lock<mutex> guard(lock_);
+    uint64_t ticket = ++sync_requests_;
+    wakeup_ = true;
+    wakeup_cond_.notify_one();
+    space_cond_.wait(guard, [&]() {
+        return stopped_ || synced_ >= ticket;
+    });
 }
 
 void AsyncLogger::threadFunc()
 {
-    vector<char> line;
     while (true)
     {
-        block_queue_.take(line);
-        if (line.size() > 0)
+        bool stopping = false;
+        uint64_t sync_to = 0;
+        {
+            unique_lock<mutex> guard(lock_);
+            wakeup_cond_.wait_for(guard, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]() {
+                return stopped_ || wakeup_;
+            });
+            wakeup_ = false;
+            stopping = stopped_;
+            sync_to = sync_requests_;
+        }
+        // 停止前写完所有已经输出的日志
+        drain();
+        if (sync_to > synced_)
+        {
+            // 只有后台线程修改synced_, 读取不需要加锁
+            syncFile();
+            {
+                lock_guard<mutex> guard(lock_);
+                synced_ = sync_to;
+            }
+            space_cond_.notify_all();
+        }
+        if (stopping)
+        {
+            break;
+        }
+    }
+}
+
+void AsyncLogger::drain()
+{
+    draining_.clear();
+    {
+        lock_guard<mutex> guard(lock_);
+        for (auto &p_buffer : buffers_)
+        {
+            draining_.emplace_back(p_buffer.get(), 0);
+        }
+    }
+
+    iovecs_.clear();
+    staging_.clear();
+    int lines = 0;
+    size_t batch_bytes = 0;
+    // 可以丢弃最旧的日志时输出日志的线程可能移动tail, 在claimed保护下把数据复制出来并立即释放空间
+    bool copy = overflow_ == LogOverflow::DROP_OLDEST || overflow_ == LogOverflow::DROP_BY_LEVEL;
+    for (auto &item : draining_)
+    {
+        ThreadBuffer *p_buffer = item.first;
+        size_t capacity = p_buffer->mask + 1;
+        while (copy && p_buffer->claimed.exchange(true, std::memory_order_acquire))
+        {
+            // 对方只在丢弃几条日志期间持有
+            std::this_thread::yield();
+        }
+        uint64_t tail = p_buffer->tail.load(std::memory_order_relaxed);
+        uint64_t head = p_buffer->head.load(std::memory_order_acquire);
+        item.second = head;
+        if (head == tail)
+        {
+            if (copy)
+            {
+                p_buffer->claimed.store(false, std::memory_order_release);
+            }
+            continue;
+        }
+        // 条数在head之前更新, 可能包括还没有写完的一条, 下一批少算一条
+        uint64_t records = p_buffer->records.load(std::memory_order_relaxed);
+        lines += records - p_buffer->drained_records;
+        p_buffer->drained_records = records;
+        // 环形缓冲区中的数据最多分成两段
+        char *data = p_buffer->data.get();
+        size_t pos = tail & p_buffer->mask;
+        size_t len = head - tail;
+        size_t first = min(len, capacity - pos);
+        batch_bytes += len;
+        if (copy)
+        {
+            staging_.append(data + pos, first);
+            staging_.append(data, len - first);
+            p_buffer->tail.store(head, std::memory_order_release);
+            p_buffer->claimed.store(false, std::memory_order_release);
+            continue;
+        }
+        iovecs_.push_back({data + pos, first});
+        if (len > first)
+        {
+            iovecs_.push_back({data, len - first});
+        }
+    }
+    if (!staging_.empty())
+    {
+        iovecs_.push_back({&staging_[0], staging_.size()});
+    }
+
+    reportDrops();
+    if (!report_.empty())
+    {
+        iovecs_.push_back({&report_[0], report_.size()});
+        batch_bytes += report_.size();
+        ++lines;
+    }
+
+    if (!iovecs_.empty())
+    {
+        time_t now = time(nullptr);
+        struct tm log_tm;
+        auto ret = localtime_r(&now, &log_tm);
+        if (ret == nullptr)
+        {
+            fprintf(stderr, "localtime_r(): %s\n", strerror(errno));
+        }
+        // 新的一天, 或者单个文件放不下时分割日志
+        bool new_day = log_tm.tm_year > now_tm_.tm_year || log_tm.tm_yday > now_tm_.tm_yday;
+        bool full_lines = log_file_max_lineno_ > 0 && file_lines_ >= log_file_max_lineno_;
+        bool full_bytes = rotation_.max_file_bytes > 0 && file_bytes_ > 0 &&
+                          file_bytes_ + batch_bytes > rotation_.max_file_bytes;
+        if (new_day)
+        {
+            file_index_ = 0;
+        }
+        if (new_day || full_lines || full_bytes)
+        {
+            now_tm_ = log_tm;
+            openLogfile();
+        }
+        if (format_ == LogFormat::BINARY)
         {
-            time_t now = time(nullptr);
-            struct tm log_tm;
-            auto ret = localtime_r(&now, &log_tm);
-            if (ret == nullptr)
+            // 日志使用的格式字符串在写入日志之前已经登记, 在head之后读取保证都能看到
+            encodeFormats();
+            if (!preamble_.empty())
             {
-                fprintf(stderr, "localtime_r(): %s\n", strerror(errno));
+                iovecs_.insert(iovecs_.begin(), iovec{&preamble_[0], preamble_.size()});
             }
-            if (log_tm.tm_year > now_tm_.tm_year || log_tm.tm_yday > now_tm_.tm_yday)
+        }
+        preallocate(batch_bytes + preamble_.size());
+        file_bytes_ += writeAll();
+        file_lines_ += lines;
+    }
+
+    // 复制数据时已经释放了空间, 这里再写tail可能覆盖输出日志的线程丢弃后的位置
+    for (auto &item : draining_)
+    {
+        if (!copy)
+        {
+            item.first->tail.store(item.second, std::memory_order_release);
+        }
+    }
+    {
+        // 在锁内释放缓冲区, 与等待空间的线程同步, 之后的通知不会丢失
+        lock_guard<mutex> guard(lock_);
+        buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(), [this](const std::unique_ptr<ThreadBuffer> &p_buffer) {
+            if (!p_buffer->retired.load(std::memory_order_acquire) ||
+                p_buffer->head.load(std::memory_order_acquire) != p_buffer->tail.load(std::memory_order_relaxed))
             {
-                // 新的一天需要分割日志
-                day_lineno_ = 1;
-                now_tm_ = log_tm;
-                openLogfile();
+                return false;
             }
-            if (day_lineno_ > 1 && day_lineno_ % log_file_max_lineno_ == 1)
+            for (int level = 0; level < LOG_LEVEL_COUNT; ++level)
             {
-                // 单个文件放不下
-                now_tm_ = log_tm;
-                openLogfile();
+                retired_dropped_[level] += p_buffer->dropped[level].load(std::memory_order_relaxed);
             }
+            return true;
+        }), buffers_.end());
+    }
+    space_cond_.notify_all();
+}
+
+void AsyncLogger::reportDrops()
+{
+    report_.clear();
+    uint64_t dropped[LOG_LEVEL_COUNT];
+    uint64_t total = 0;
+    uint64_t fresh = 0;
+    for (int level = 0; level < LOG_LEVEL_COUNT; ++level)
+    {
+        dropped[level] = retired_dropped_[level];
+        for (auto &item : draining_)
+        {
+            dropped[level] += item.first->dropped[level].load(std::memory_order_relaxed);
+        }
+        dropped_[level].store(dropped[level], std::memory_order_relaxed);
+        total += dropped[level];
+        fresh += dropped[level] - reported_dropped_[level];
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (fresh == 0 || now - last_report_ < std::chrono::milliseconds(DROP_REPORT_INTERVAL_MS))
+    {
+        return;
+    }
+    last_report_ = now;
+
+    // 作为一条WARN日志写在本批日志之后
+    char message[256];
+    int len = snprintf(message, sizeof(message),
+                       "logger dropped %lu logs (debug:%lu info:%lu warn:%lu error:%lu fatal:%lu), %lu in total",
+                       fresh, dropped[0] - reported_dropped_[0], dropped[1] - reported_dropped_[1],
+                       dropped[2] - reported_dropped_[2], dropped[3] - reported_dropped_[3],
+                       dropped[4] - reported_dropped_[4], total);
+    len = std::max(0, min<int>(len, sizeof(message) - 1));
+    std::copy(dropped, dropped + LOG_LEVEL_COUNT, reported_dropped_);
+    if (format_ == LogFormat::BINARY)
+    {
+        report_.resize(sizeof(LogRecordHeader));
+        report_.append(message, len);
+        fillRecordHeader(&report_[0], report_.size(), LogRecordType::TEXT, LogLevel::WARN, 0);
+        return;
+    }
+    time_t seconds = time(nullptr);
+    struct tm log_tm;
+    localtime_r(&seconds, &log_tm);
+    char str_time[STR_TIME_LEN];
+    size_t time_len = strftime(str_time, sizeof(str_time), "%Y-%m-%d %H:%M:%S ", &log_tm);
+    report_.assign(str_time, time_len);
+    report_ += logLevelPrefix(static_cast<int>(LogLevel::WARN));
+    report_.append(message, len);
+    report_ += '\n';
+}
 
-            fputs(line.data(), fp_);
-            fflush(fp_);
-            line.clear();
+LogDropStats AsyncLogger::dropStats() const
+{
+    LogDropStats stats;
+    for (int level = 0; level < LOG_LEVEL_COUNT; ++level)
+    {
+        stats.dropped[level] = dropped_[level].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+size_t AsyncLogger::writeAll()
+{
+    if (fd_ < 0)
+    {
+        return 0;
+    }
+    size_t total = 0;
+    size_t index = 0;
+    if (p_map_)
+    {
+        total = copyToMap(index);
+    }
+    while (index < iovecs_.size())
+    {
+        int count = static_cast<int>(min<size_t>(IOV_MAX, iovecs_.size() - index));
+        ssize_t write_len = ::writev(fd_, &iovecs_[index], count);
+        if (write_len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "writev(): %s\n", strerror(errno));
+            return total;
+        }
+        // 部分写入时跳过已经写出的部分
+        size_t written = write_len;
+        total += written;
+        while (index < iovecs_.size() && written >= iovecs_[index].iov_len)
+        {
+            written -= iovecs_[index].iov_len;
+            ++index;
+        }
+        if (written > 0)
+        {
+            iovecs_[index].iov_base = static_cast<char *>(iovecs_[index].iov_base) + written;
+            iovecs_[index].iov_len -= written;
+        }
+    }
+    return total;
+}
 
-            ++day_lineno_;
+size_t AsyncLogger::copyToMap(size_t &index)
+{
+    size_t total = 0;
+    while (index < iovecs_.size())
+    {
+        struct iovec &iov = iovecs_[index];
+        size_t pos = file_bytes_ + total;
+        if (pos == map_offset_ + MAP_CHUNK && !mapChunk(pos))
+        {
+            return total;
         }
-        else
+        size_t len = min(iov.iov_len, map_offset_ + MAP_CHUNK - pos);
+        memcpy(p_map_ + (pos - map_offset_), iov.iov_base, len);
+        total += len;
+        iov.iov_base = static_cast<char *>(iov.iov_base) + len;
+        iov.iov_len -= len;
+        if (iov.iov_len == 0)
         {
-            break;
+            ++index;
         }
     }
+    return total;
+}
+
+bool AsyncLogger::mapChunk(size_t pos)
+{
+    unmapChunk();
+    size_t offset = pos / MAP_CHUNK * MAP_CHUNK;
+    // 先分配磁盘空间: 写入映射中没有分配的块时如果磁盘满了会产生SIGBUS
+    int ret = ::posix_fallocate(fd_, offset, MAP_CHUNK);
+    void *p_map = MAP_FAILED;
+    if (ret == 0)
+    {
+        p_map = ::mmap(nullptr, MAP_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset);
+        ret = p_map == MAP_FAILED ? errno : 0;
+    }
+    if (ret != 0)
+    {
+        fprintf(stderr, "map log file: %s(%s), falling back to writev\n", strerror(ret), log_filename_.data());
+        // 去掉分配的部分, 之后从pos开始追加
+        if (::ftruncate(fd_, pos) < 0 || ::lseek(fd_, pos, SEEK_SET) < 0)
+        {
+            fprintf(stderr, "ftruncate(): %s(%s)\n", strerror(errno), log_filename_.data());
+        }
+        return false;
+    }
+    p_map_ = static_cast<char *>(p_map);
+    map_offset_ = offset;
+#ifdef MADV_POPULATE_WRITE
+    // 一次建立可写的页表项, 之后复制日志时不会每页产生一次缺页; 内核不支持时按需缺页
+    ::madvise(p_map_, MAP_CHUNK, MADV_POPULATE_WRITE);
+#endif
+    return true;
+}
+
+void AsyncLogger::unmapChunk()
+{
+    if (p_map_)
+    {
+        // 映射中的数据已经在页缓存中, 解除映射后由内核回写
+        ::munmap(p_map_, MAP_CHUNK);
+        p_map_ = nullptr;
+    }
+}
+
+void AsyncLogger::syncFile()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    if (p_map_ && ::msync(p_map_, MAP_CHUNK, MS_SYNC) < 0)
+    {
+        fprintf(stderr, "msync(): %s(%s)\n", strerror(errno), log_filename_.data());
+    }
+    // 之前解除映射的部分和文件大小
+    if (::fdatasync(fd_) < 0)
+    {
+        fprintf(stderr, "fdatasync(): %s(%s)\n", strerror(errno), log_filename_.data());
+    }
 }
 
 void AsyncLogger::openLogfile()
@@ -185,21 +821,126 @@ void AsyncLogger::openLogfile()
     {
         fprintf(stderr, "strftime(): error\n");
     }
+    // 序号补齐到4位, 按文件名排序就是写入的顺序
+    char str_index[16];
+    snprintf(str_index, sizeof(str_index), "-%04d", file_index_++);
 
-    string log_filename = log_path_ + "/" + string(str_time) + "-" +
-                          to_string(day_lineno_ / log_file_max_lineno_) + log_suffix_;
-    if (fp_)
+    string previous = log_filename_;
+    closeLogfile();
+    log_filename_ = log_path_ + "/" + string(str_time) + str_index + log_suffix_;
+    file_lines_ = 0;
+    file_bytes_ = 0;
+    // 追加写入, 同名文件(如同一秒内重启)不会被截断; 映射文件需要读写权限
+    int flags = sink_ == LogSink::MMAP ? O_RDWR | O_CREAT | O_CLOEXEC : O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    fd_ = ::open(log_filename_.data(), flags, 0644);
+    if (fd_ < 0)
     {
-        fclose(fp_);
+        mkdir(log_path_.data(), 0755);
+        fd_ = ::open(log_filename_.data(), flags, 0644);
+        if (fd_ < 0)
+        {
+            fprintf(stderr, "open(): %s(%s)\n", strerror(errno), log_filename_.data());
+        }
     }
-    fp_ = fopen(log_filename.data(), "w");
-    if (fp_ == nullptr)
+    if (!previous.empty())
     {
-        mkdir(log_path_.data(), 0755);
-        fp_ = fopen(log_filename.data(), "w");
-        if (!fp_)
+        rotator_.rotated(previous, log_filename_);
+    }
+    if (fd_ < 0)
+    {
+        return;
+    }
+
+    struct stat file_stat;
+    if (::fstat(fd_, &file_stat) == 0)
+    {
+        file_bytes_ = file_stat.st_size;
+    }
+    if (sink_ == LogSink::MMAP && file_bytes_ > 0)
+    {
+        // 崩溃的进程留下的文件末尾是映射时填充的0, 从实际的数据之后继续写
+        size_t start = file_bytes_ > MAP_CHUNK ? file_bytes_ - MAP_CHUNK : 0;
+        vector<char> tail(file_bytes_ - start);
+        if (::pread(fd_, tail.data(), tail.size(), start) == static_cast<ssize_t>(tail.size()))
         {
-            fprintf(stderr, "fopen(): %s(%s)\n", strerror(errno), log_filename.data());
+            while (file_bytes_ > start && tail[file_bytes_ - start - 1] == '\0')
+            {
+                --file_bytes_;
+            }
+        }
+        if (::ftruncate(fd_, file_bytes_) < 0 || ::lseek(fd_, file_bytes_, SEEK_SET) < 0)
+        {
+            fprintf(stderr, "ftruncate(): %s(%s)\n", strerror(errno), log_filename_.data());
         }
     }
-}
\ No newline at end of file
+    preallocated_ = file_bytes_;
+    preallocate_failed_ = false;
+    if (format_ == LogFormat::BINARY && file_bytes_ == 0)
+    {
+        // 每个文件可以单独解码: 写入文件头, 之后重新写入所有格式字符串
+        LogFileHeader header = {};
+        memcpy(header.magic, LOG_BINARY_MAGIC, sizeof(header.magic));
+        header.version = LOG_BINARY_VERSION;
+        if (::write(fd_, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)))
+        {
+            fprintf(stderr, "write(): %s(%s)\n", strerror(errno), log_filename_.data());
+        }
+        file_bytes_ += sizeof(header);
+    }
+    formats_written_ = 0;
+    if (sink_ == LogSink::MMAP)
+    {
+        mapChunk(file_bytes_);
+    }
+}
+
+void AsyncLogger::closeLogfile()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    if (preallocated_ > file_bytes_)
+    {
+        // 文件末尾之后预先分配的块在关闭时不会自动释放
+        ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, file_bytes_, preallocated_ - file_bytes_);
+    }
+    if (sink_ == LogSink::MMAP)
+    {
+        // 去掉映射时分配的没有写入的部分
+        unmapChunk();
+        if (::ftruncate(fd_, file_bytes_) < 0)
+        {
+            fprintf(stderr, "ftruncate(): %s(%s)\n", strerror(errno), log_filename_.data());
+        }
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void AsyncLogger::preallocate(size_t bytes)
+{
+    // 映射的文件按MAP_CHUNK分配
+    if (!rotation_.preallocate || preallocate_failed_ || fd_ < 0 || p_map_ || file_bytes_ + bytes <= preallocated_)
+    {
+        return;
+    }
+    // 每次多分配PREALLOCATE_CHUNK, 不超过文件的大小上限, 不改变文件大小:
+    // 之后的追加写入不需要分配块, 文件在磁盘上基本连续
+    size_t end = file_bytes_ + bytes + PREALLOCATE_CHUNK;
+    if (rotation_.max_file_bytes > 0)
+    {
+        end = std::max(file_bytes_ + bytes, std::min(end, rotation_.max_file_bytes));
+    }
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, preallocated_, end - preallocated_) < 0)
+    {
+        if (errno != EOPNOTSUPP)
+        {
+            fprintf(stderr, "fallocate(): %s(%s)\n", strerror(errno), log_filename_.data());
+        }
+        // 不支持或者空间不足时不再预先分配, preallocated_仍然是已经分配到的位置, 关闭时释放
+        preallocate_failed_ = true;
+        return;
+    }
+    preallocated_ = end;
+}
@@ -1,10 +1,51 @@
+// 异步日志: 调用线程只把日志格式化到自己的缓冲区, 后台线程批量写入文件
+//
+// -> 每个线程第一次输出日志时分配一个字节环(单生产者单消费者), 之后输出日志不需要加锁, 也不分配内存
+// -> 时间前缀按线程缓存, 每秒只调用一次localtime_r(3)/strftime(3)
+// -> 后台线程每隔FLUSH_INTERVAL_MS, 或者某个缓冲区积累了1/4容量时, 用writev(2)把所有缓冲区一次写入文件
+// -> 缓冲区满时按LogOverflow处理: 等待后台线程写出, 或者丢弃日志而不阻塞调用线程
+//    丢弃的条数按级别统计, 后台线程每隔DROP_REPORT_INTERVAL_MS把新丢弃的条数写入日志, 也可以通过dropStats()读取
+// 同一个线程的日志保持顺序, 不同线程的日志按批次交错
+// 日志文件以O_APPEND打开, 按天, 日志条数或者大小(LogRotation)分割, 不再写入的文件由LogRotator压缩和清理
+// LogSink::MMAP时后台线程把日志复制到映射的文件区域, 每次映射MAP_CHUNK并预先分配磁盘空间, 由内核回写:
+// -> 写文件不需要系统调用, 进程崩溃时已经复制到映射中的日志都在页缓存中, 不会丢失
+// -> sync()等待后台线程写出调用之前的日志, 并把文件刷到磁盘
+// -> 文件关闭时截断到实际大小, 进程崩溃时文件末尾可能留下填充的0(DecodeLog会忽略)
+// -> AsyncLogger::getInstance().init(LogLevel::INFO, "./log", ".log", 5000, 1024);
+// -> LOG_INFO("client:%d closed", sock);
+//
+// 二进制模式(LogFormat::BINARY, 格式见BinaryLog.h)下调用线程不格式化文本:
+// -> 每个LOG_*调用点第一次执行时登记格式字符串, 得到编号
+// -> 之后只写入编号和参数的原始字节, 用DecodeLog转换成与文本模式相同的文本
+//
+// 日志级别在两个地方过滤, 都在计算参数之前:
+// -> 编译时: 低于LOG_MIN_LEVEL(0 DEBUG ~ 4 FATAL, 由cmake -DLOG_MIN_LEVEL=1设置)的日志调用整个被删除
+// -> 运行时: 内联比较AsyncLogger::enabled(level), 没有开启日志或者级别被过滤时不调用getInstance()和log()
+
 #ifndef HTTPSERVER_ASYNC_LOGGER_H
 #define HTTPSERVER_ASYNC_LOGGER_H
 
-#include <logger/BlockQueue.h>
+#include <logger/BinaryLog.h>
+#include <logger/LogRotator.h>
+
+#include <sys/uio.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
+
+// 编译时保留的最低日志级别, 对应LogLevel的值
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
 
 enum class LogLevel
 {
@@ -15,6 +56,48 @@ enum class LogLevel
     FATAL
 };
 
+// 日志文件的格式
+enum class LogFormat
+{
+    TEXT,       // 调用线程格式化成文本
+    BINARY,     // 调用线程只记录格式字符串的编号和参数, 离线解码
+};
+
+// 后台线程写日志文件的方式
+enum class LogSink
+{
+    WRITE,      // writev(2)
+    MMAP,       // 复制到映射的文件区域, 由内核回写
+};
+
+// 缓冲区满(后台线程写文件跟不上)时的处理方式
+enum class LogOverflow
+{
+    BLOCK,          // 调用线程等待后台线程写出, 不丢弃日志
+    DROP_NEWEST,    // 丢弃新的日志
+    DROP_OLDEST,    // 丢弃缓冲区中最旧的日志, 给新的日志腾出空间
+    DROP_BY_LEVEL,  // 按级别丢弃: 缓冲区用到1/2时丢弃新的DEBUG, 3/4时丢弃新的INFO, 满时WARN以上的日志挤掉缓冲区中
+                    // 最旧的DEBUG/INFO, 没有可以挤掉的日志时短暂等待后台线程写出
+};
+
+constexpr int LOG_LEVEL_COUNT = static_cast<int>(LogLevel::FATAL) + 1;
+
+// 因为缓冲区满丢弃的日志数目, 按级别统计
+struct LogDropStats
+{
+    uint64_t dropped[LOG_LEVEL_COUNT] = {};
+
+    uint64_t total() const
+    {
+        uint64_t sum = 0;
+        for (uint64_t count : dropped)
+        {
+            sum += count;
+        }
+        return sum;
+    }
+};
+
 class AsyncLogger
 {
 public:
@@ -26,18 +109,7 @@ public:
 
     AsyncLogger &operator=(AsyncLogger &&) = delete;
 
-    ~AsyncLogger()
-    {
-        block_queue_.stop();
-        if (worker_.joinable())
-        {
-            worker_.join();
-        }
-        if (fp_)
-        {
-            fclose(fp_);
-        }
-    }
+    ~AsyncLogger();
 
 public:
     // 获取 AsyncLogger 的唯一单例
@@ -47,57 +119,309 @@ public:
         return instance;
     }
 
+    // 设置日志文件的分割和保留策略, 需要在init()之前调用
+    void setRotation(const LogRotation &rotation) { rotation_ = rotation; }
+
+    // 设置缓冲区满时的处理方式, 需要在init()之前调用
+    void setOverflow(LogOverflow overflow) { overflow_ = overflow; }
+
+    // 设置写日志文件的方式, 需要在init()之前调用
+    void setSink(LogSink sink) { sink_ = sink; }
+
+    // 到后台线程最近一次写文件为止丢弃的日志数目
+    LogDropStats dropStats() const;
+
+    // 等待后台线程写出调用之前输出的所有日志, 再把日志文件刷到磁盘
+    void sync();
+
     // 初始化logger
+    // file_max_line小于等于0时不按日志条数分割
+    // 每个线程的缓冲区可以存放大约block_queue_size条日志(按每条AVERAGE_LINE_LEN字节计算)
     void init(LogLevel filter_level, const std::string &log_path, const std::string &log_filename,
-              int file_max_line, int block_queue_size);
+              int file_max_line, int block_queue_size, LogFormat format = LogFormat::TEXT);
 
     // 输出日志
-    void log(LogLevel level, const char *fmt, ...);
+    void log(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+    // 二进制模式: 输出编号为format_id的格式字符串和参数
+    template <typename... Args>
+    void logBinary(LogLevel level, uint32_t format_id, const Args &... args);
+
+    // 登记一个LOG_*调用点的格式字符串, 返回编号; fmt和file必须是字符串字面量
+    uint32_t registerFormat(const char *fmt, const char *file, int line);
+
+    // 级别为level的日志是否需要输出, 不需要访问单例
+    static bool enabled(LogLevel level)
+    {
+        return static_cast<int>(level) >= enabled_level_.load(std::memory_order_relaxed);
+    }
+
+    // 是否使用二进制格式
+    static bool binary()
+    {
+        return binary_.load(std::memory_order_relaxed);
+    }
+
+public:
+    static constexpr int FLUSH_INTERVAL_MS = 200;       // 后台线程至少每隔200ms写一次文件
+    static constexpr size_t AVERAGE_LINE_LEN = 128;
+    static constexpr int DROP_REPORT_INTERVAL_MS = 1000; // 丢弃日志时至多每秒在日志中报告一次
+    static constexpr int OVERFLOW_WAIT_MS = 100;        // DROP_BY_LEVEL: WARN以上的日志最多等待后台线程写出100ms
 
 private:
+    static constexpr int LOG_FILE_MAX_LINE_LEN = 4096;
+    static constexpr int STR_TIME_LEN = 50;
+    static constexpr size_t MIN_BUFFER_CAPACITY = 16 * 1024;
+    static constexpr size_t PREALLOCATE_CHUNK = 4 * 1024 * 1024;
+    static constexpr size_t MAP_CHUNK = 4 * 1024 * 1024;    // LogSink::MMAP每次映射的大小, 页大小的整数倍
+
+    // 一个线程的日志缓冲区, 输出日志的线程写入, 后台线程读出
+    struct ThreadBuffer
+    {
+        explicit ThreadBuffer(size_t capacity);
+
+        std::unique_ptr<char[]> data;
+        size_t mask;                                 // 容量是2的幂, 位置与mask得到下标
+        alignas(64) std::atomic<uint64_t> head{0};   // 写入的位置, 只由输出日志的线程修改
+        alignas(64) std::atomic<uint64_t> tail{0};   // 写出的位置, 只由后台线程修改
+        std::atomic<uint64_t> records{0};            // 写入的日志条数, 在head之前更新
+        std::atomic<bool> retired{false};            // 线程已经退出, 写完剩余的日志后释放
+        std::atomic<bool> claimed{false};            // 可以丢弃最旧的日志时, 输出日志的线程和后台线程修改tail之前获取
+        std::atomic<uint64_t> dropped[LOG_LEVEL_COUNT] = {};  // 丢弃的日志条数, 只由输出日志的线程修改
+        uint64_t drained_records = 0;                // 后台线程已经写出的日志条数
+
+        // 以下只由输出日志的线程访问
+        alignas(64) time_t cached_second = -1;       // 时间前缀对应的秒
+        int prefix_len = 0;
+        char prefix[STR_TIME_LEN];                   // "%Y-%m-%d %H:%M:%S "
+        char line[LOG_FILE_MAX_LINE_LEN + 2];        // 格式化一行日志
+        std::string kept;                            // dropLowLevel()暂存保留的日志
+    };
+
+    // 登记的格式字符串
+    struct FormatSite
+    {
+        const char *fmt;
+        const char *file;
+        int line;
+    };
+
+    // 线程退出时把缓冲区交给后台线程回收
+    struct LocalBuffer
+    {
+        ThreadBuffer *p_buffer = nullptr;
+
+        ~LocalBuffer();
+    };
+
     AsyncLogger()
       : opened_(false),
         filter_level_(LogLevel::INFO),
         log_path_(),
         log_suffix_(),
         log_file_max_lineno_(0),
-        block_queue_(),
-        fp_(nullptr),
-        day_lineno_(1),
+        format_(LogFormat::TEXT),
+        rotation_(),
+        rotator_(),
+        overflow_(LogOverflow::BLOCK),
+        sink_(LogSink::WRITE),
+        buffer_capacity_(0),
+        flush_bytes_(0),
+        buffers_(),
+        draining_(),
+        iovecs_(),
+        formats_(),
+        formats_written_(0),
+        preamble_(),
+        staging_(),
+        report_(),
+        retired_dropped_(),
+        reported_dropped_(),
+        last_report_(),
+        dropped_(),
+        stopped_(false),
+        wakeup_(false),
+        sync_requests_(0),
+        synced_(0),
+        now_tm_(),
+        fd_(-1),
+        log_filename_(),
+        file_index_(0),
+        file_lines_(0),
+        file_bytes_(0),
+        preallocated_(0),
+        preallocate_failed_(false),
+        p_map_(nullptr),
+        map_offset_(0),
         worker_(),
-        lock_()
+        lock_(),
+        formats_lock_(),
+        wakeup_cond_(),
+        space_cond_()
     {}
 
+    // 当前线程的缓冲区, 第一次调用时创建
+    ThreadBuffer *localBuffer();
+
+    // 把一条日志复制到缓冲区, 缓冲区满时按overflow_等待或者丢弃
+    void append(ThreadBuffer *p_buffer, LogLevel level, const char *line, size_t len);
+
+    // 缓冲区放不下len字节时按overflow_处理, 可以写入时返回true并更新tail
+    bool overflow(ThreadBuffer *p_buffer, LogLevel level, uint64_t head, size_t len, uint64_t &tail);
+
+    // 丢弃最旧的日志直到tail不小于min_tail, 后台线程正在读取这个缓冲区时返回false
+    bool dropOldest(ThreadBuffer *p_buffer, uint64_t min_tail, uint64_t &tail);
+
+    // 从最旧的日志开始只丢弃DEBUG/INFO, 保留的日志保持顺序移到后面, 直到tail不小于min_tail
+    // 后台线程正在读取这个缓冲区, 或者DEBUG/INFO不够时不修改缓冲区, 返回false
+    bool dropLowLevel(ThreadBuffer *p_buffer, uint64_t min_tail, uint64_t &tail);
+
+    // 缓冲区中从pos开始的一条日志的长度和级别
+    void recordAt(const ThreadBuffer *p_buffer, uint64_t pos, uint64_t head, size_t &size, int &level) const;
+
+    // 统计count条丢弃的日志
+    static void countDrop(ThreadBuffer *p_buffer, int level, uint64_t count = 1)
+    {
+        auto &counter = p_buffer->dropped[level];
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    // 汇总丢弃的日志数目, 超过报告间隔时把新丢弃的条数编码到report_
+    void reportDrops();
+
+    // 在record开头填写二进制记录的记录头
+    static void fillRecordHeader(char *record, size_t size, LogRecordType type, LogLevel level, uint32_t format_id);
+
+    // 二进制模式: 把还没有写入当前文件的格式字符串编码到preamble_
+    void encodeFormats();
+
+    // 唤醒后台线程
+    void wakeup();
+
     // 异步线程执行函数
     void threadFunc();
 
+    // 把所有缓冲区中的日志写入文件, 释放已经退出的线程的缓冲区
+    void drain();
+
+    // 写完iovecs_中的所有数据, 返回写入的字节数
+    size_t writeAll();
+
+    // LogSink::MMAP: 从iovecs_[index]开始复制到映射中, 返回复制的字节数; 无法映射时停下, 剩下的用writev(2)写出
+    size_t copyToMap(size_t &index);
+
+    // LogSink::MMAP: 分配并映射包含文件位置pos的MAP_CHUNK, 失败时改用writev(2)从pos开始写
+    bool mapChunk(size_t pos);
+
+    // LogSink::MMAP: 解除当前映射
+    void unmapChunk();
+
+    // 把日志文件刷到磁盘
+    void syncFile();
+
+    // 关闭当前日志文件(如果有), 打开新的日志文件
     void openLogfile();
 
-    int appendTimestamp(char *start, int len, const struct tm &log_tm);
+    // 释放当前日志文件没有用到的预先分配的空间, 关闭文件
+    void closeLogfile();
+
+    // 在写入bytes字节之前, 预先分配之后的空间
+    void preallocate(size_t bytes);
 
-    int appendLogLevel(char *start, int len, LogLevel level);
+    static int appendLogLevel(char *start, LogLevel level);
 
+    static std::atomic<bool> binary_;
 private:
-    static constexpr int LOG_FILE_MAX_LINE_LEN = 4096;
-    static constexpr int STR_TIME_LEN = 50;
+    static constexpr int LOG_DISABLED = static_cast<int>(LogLevel::FATAL) + 1;
+
+    static std::atomic<int> enabled_level_;     // 需要输出的最低级别, 没有开启日志时为LOG_DISABLED
 
     bool opened_;                    // 日志是否开启
     LogLevel filter_level_;           // 显示的最低日志级别
     std::string log_path_;           // 日志文件存放路径
     std::string log_suffix_;         // 日志文件后缀名
-    int log_file_max_lineno_;        // 单个日志文件最多存放的日志记录数目
-    BlockQueue<std::vector<char>> block_queue_;      // 存放需要写入磁盘的日志文件
-    struct tm now_tm_;                     // 当前时间
-    FILE *fp_;                             // 日志文件指针
-    int day_lineno_;                       // 当天的下一条日志序号
-    std::thread worker_;                   // 从阻塞队列取数据写入磁盘
+    int log_file_max_lineno_;        // 单个日志文件最多存放的日志记录数目(按批次检查, 可能多出最后一批)
+    LogFormat format_;               // 日志文件的格式
+    LogRotation rotation_;           // 日志文件的分割和保留策略
+    LogRotator rotator_;             // 压缩和清理不再写入的日志文件
+    LogOverflow overflow_;           // 缓冲区满时的处理方式
+    LogSink sink_;                   // 写日志文件的方式
+    size_t buffer_capacity_;         // 每个线程的缓冲区大小
+    size_t flush_bytes_;             // 缓冲区积累到这个大小时唤醒后台线程
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;   // 所有线程的缓冲区, 由lock_保护
+    std::vector<std::pair<ThreadBuffer *, uint64_t>> draining_;   // 后台线程本次写出的缓冲区以及写到的位置
+    std::vector<struct iovec> iovecs_;                     // 后台线程本次写出的数据
+    std::vector<FormatSite> formats_;                      // 登记的格式字符串, 编号从1开始, 由formats_lock_保护
+    size_t formats_written_;                               // 已经写入当前文件的格式字符串数目
+    std::string preamble_;                                 // 本次写在日志之前的FORMAT记录
+    std::string staging_;                                  // 可以丢弃最旧的日志时, 本次从缓冲区复制出的日志
+    std::string report_;                                   // 本次写在日志之后的丢弃报告
+    uint64_t retired_dropped_[LOG_LEVEL_COUNT];            // 已经释放的缓冲区丢弃的日志数目
+    uint64_t reported_dropped_[LOG_LEVEL_COUNT];           // 已经写入日志的丢弃数目
+    std::chrono::steady_clock::time_point last_report_;    // 上次报告丢弃数目的时间
+    std::atomic<uint64_t> dropped_[LOG_LEVEL_COUNT];       // 最近一次汇总的丢弃数目, 供dropStats()读取
+    bool stopped_;                         // 停止后台线程, 由lock_保护
+    bool wakeup_;                          // 需要立即写文件, 由lock_保护
+    uint64_t sync_requests_;               // sync()的调用次数, 由lock_保护
+    uint64_t synced_;                      // 后台线程已经完成的sync()次数, 由lock_保护
+    struct tm now_tm_;                     // 当前日志文件的日期
+    int fd_;                               // 日志文件
+    std::string log_filename_;             // 当前日志文件的路径
+    int file_index_;                       // 当天的下一个日志文件的序号
+    int file_lines_;                       // 当前日志文件的日志数目
+    size_t file_bytes_;                    // 当前日志文件的大小
+    size_t preallocated_;                  // 当前日志文件预先分配到的位置
+    bool preallocate_failed_;              // 当前日志文件预先分配失败, 不再尝试
+    char *p_map_;                          // LogSink::MMAP: 当前映射的MAP_CHUNK, 无法映射时为nullptr
+    size_t map_offset_;                    // 当前映射在文件中的位置
+    std::thread worker_;                   // 从缓冲区取数据写入磁盘
     mutable std::mutex lock_;              // 互斥锁
+    std::mutex formats_lock_;              // 保护formats_
+    std::condition_variable wakeup_cond_;  // 唤醒后台线程
+    std::condition_variable space_cond_;   // 后台线程写出了数据, 缓冲区有空间, 或者完成了sync()
 };
 
-#define LOG_DEBUG(fmt, ...) AsyncLogger::getInstance().log(LogLevel::DEBUG, fmt, ## __VA_ARGS__);
-#define LOG_INFO(fmt, ...) AsyncLogger::getInstance().log(LogLevel::INFO, fmt, ## __VA_ARGS__);
-#define LOG_WARN(fmt, ...) AsyncLogger::getInstance().log(LogLevel::WARN, fmt,  __VA_ARGS__);
-#define LOG_ERROR(fmt, ...) AsyncLogger::getInstance().log(LogLevel::ERROR, fmt, ## __VA_ARGS__);
-#define LOG_FATAL(fmt, ...) AsyncLogger::getInstance().log(LogLevel::FATAL, fmt, ## __VA_ARGS__);
+template <typename... Args>
+void AsyncLogger::logBinary(LogLevel level, uint32_t format_id, const Args &... args)
+{
+    if(!opened_ || level < filter_level_)
+    {
+        return;
+    }
+    ThreadBuffer *p_buffer = localBuffer();
+    char *record = p_buffer->line;
+    LogEncoder encoder(record + sizeof(LogRecordHeader), record + sizeof(p_buffer->line));
+    (encoder.put(args), ...);
+    size_t size = encoder.position() - record;
+    fillRecordHeader(record, size, LogRecordType::EVENT, level, format_id);
+    append(p_buffer, level, record, size);
+}
+
+// 编译时和运行时的级别检查都在计算参数之前, 被过滤的日志不会计算参数
+// 二进制模式下每个调用点用局部静态变量记录格式字符串的编号, ""fmt保证格式字符串是字面量
+#define LOG_AT(level, fmt, ...)                                                        \
+    do                                                                                 \
+    {                                                                                  \
+        if (static_cast<int>(level) >= LOG_MIN_LEVEL &&                                \
+            __builtin_expect(AsyncLogger::enabled(level), 0))                          \
+        {                                                                              \
+            if (AsyncLogger::binary())                                                 \
+            {                                                                          \
+                static const uint32_t log_format_id =                                  \
+                    AsyncLogger::getInstance().registerFormat("" fmt, __FILE__, __LINE__); \
+                AsyncLogger::getInstance().logBinary(level, log_format_id, ## __VA_ARGS__); \
+            }                                                                          \
+            else                                                                       \
+            {                                                                          \
+                AsyncLogger::getInstance().log(level, fmt, ## __VA_ARGS__);            \
+            }                                                                          \
+        }                                                                              \
+    } while (0)
+
+#define LOG_DEBUG(fmt, ...) LOG_AT(LogLevel::DEBUG, fmt, ## __VA_ARGS__)
+#define LOG_INFO(fmt, ...) LOG_AT(LogLevel::INFO, fmt, ## __VA_ARGS__)
+#define LOG_WARN(fmt, ...) LOG_AT(LogLevel::WARN, fmt, ## __VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LOG_AT(LogLevel::ERROR, fmt, ## __VA_ARGS__)
+#define LOG_FATAL(fmt, ...) LOG_AT(LogLevel::FATAL, fmt, ## __VA_ARGS__)
 
 #endif
@@ -0,0 +1,166 @@
+// 二进制日志格式: 调用线程只复制格式字符串的编号和参数的原始字节, 由DecodeLog离线格式化成文本
+//
+// 文件布局:
+// -> LogFileHeader                                 // 每个日志文件开头
+// -> 记录: LogRecordHeader + 内容, 按写入的顺序排列
+//    FORMAT: uint32_t行号, 格式字符串\0, 文件名\0    // 在使用它的EVENT记录之前写入, 每个文件重新写一次
+//    EVENT:  参数, 每个参数是LogArgType加上值         // format_id是FORMAT记录中的编号
+//    TEXT:   格式化好的文本(没有换行)                  // 没有通过LOG_*宏输出的日志
+//
+// 参数的编码:
+// -> INT/UINT/POINTER: 8字节, DOUBLE: 8字节double
+// -> STRING: uint16_t长度加上内容, 没有结尾的\0
+// 记录的长度受行缓冲区限制, 放不下的参数被丢弃, 解码时显示为<?>
+
+#ifndef HTTPSERVER_LOGGER_BINARY_LOG_H
+#define HTTPSERVER_LOGGER_BINARY_LOG_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+constexpr char LOG_BINARY_MAGIC[8] = {'H', 'S', 'B', 'I', 'N', 'L', 'O', 'G'};
+constexpr uint32_t LOG_BINARY_VERSION = 1;
+
+struct LogFileHeader
+{
+    char magic[8];              // LOG_BINARY_MAGIC
+    uint32_t version;           // LOG_BINARY_VERSION
+    uint32_t reserved;
+};
+
+enum class LogRecordType : uint16_t
+{
+    FORMAT = 1,
+    EVENT = 2,
+    TEXT = 3,
+};
+
+struct LogRecordHeader
+{
+    uint32_t size;              // 包括记录头
+    uint16_t type;              // LogRecordType
+    uint16_t level;             // LogLevel
+    uint32_t format_id;
+    uint32_t reserved;
+    int64_t timestamp_ns;       // CLOCK_REALTIME
+};
+
+enum class LogArgType : uint8_t
+{
+    INT = 1,
+    UINT = 2,
+    DOUBLE = 3,
+    STRING = 4,
+    POINTER = 5,
+};
+
+// 日志级别的文本前缀, 文本日志和解码后的二进制日志相同
+inline std::string_view logLevelPrefix(int level)
+{
+    static constexpr std::string_view prefixes[] = {
+        "[DEBUG] : ",
+        "[INFO] : ",
+        "[WARN] : ",
+        "[ERROR] : ",
+        "[FATAL] : ",
+    };
+    return level >= 0 && level < 5 ? prefixes[level] : std::string_view("[?] : ");
+}
+
+// 把日志参数按原始字节写入[begin, end), 空间不够时丢弃之后的参数
+class LogEncoder
+{
+public:
+    LogEncoder(char *begin, char *end)
+      : pos_(begin),
+        end_(end)
+    {}
+
+    template <typename T>
+    void put(const T &value);
+
+    // 写到的位置
+    char *position() const { return pos_; }
+
+private:
+    template <typename T>
+    void putValue(LogArgType type, T value)
+    {
+        if (pos_ + 1 + sizeof(value) > end_)
+        {
+            pos_ = end_;
+            return;
+        }
+        *pos_++ = static_cast<char>(type);
+        memcpy(pos_, &value, sizeof(value));
+        pos_ += sizeof(value);
+    }
+
+    void putString(const char *str, size_t len)
+    {
+        if (pos_ + 1 + sizeof(uint16_t) > end_)
+        {
+            pos_ = end_;
+            return;
+        }
+        // 超长的字符串截断
+        uint16_t str_len = static_cast<uint16_t>(std::min<size_t>({len, UINT16_MAX,
+                                                                    static_cast<size_t>(end_ - pos_) - 1 - sizeof(uint16_t)}));
+        *pos_++ = static_cast<char>(LogArgType::STRING);
+        memcpy(pos_, &str_len, sizeof(str_len));
+        pos_ += sizeof(str_len);
+        memcpy(pos_, str, str_len);
+        pos_ += str_len;
+    }
+
+private:
+    char *pos_;
+    char *end_;
+};
+
+template <typename T>
+void LogEncoder::put(const T &value)
+{
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, char *> || std::is_same_v<U, const char *>)
+    {
+        const char *str = value;
+        str = str ? str : "(null)";
+        putString(str, strlen(str));
+    }
+    else if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>)
+    {
+        putString(value.data(), value.size());
+    }
+    else if constexpr (std::is_enum_v<U>)
+    {
+        put(static_cast<std::underlying_type_t<U>>(value));
+    }
+    else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+    {
+        putValue(LogArgType::INT, static_cast<int64_t>(value));
+    }
+    else if constexpr (std::is_integral_v<U>)
+    {
+        putValue(LogArgType::UINT, static_cast<uint64_t>(value));
+    }
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+        putValue(LogArgType::DOUBLE, static_cast<double>(value));
+    }
+    else if constexpr (std::is_pointer_v<U>)
+    {
+        putValue(LogArgType::POINTER, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+    }
+    else
+    {
+        static_assert(std::is_pointer_v<U>, "unsupported log argument type");
+    }
+}
+
+#endif
@@ -1,17 +1,95 @@
+// 有界阻塞队列: 一个互斥锁加两个条件变量, 支持任意多个生产者和消费者
+// 存储默认是std::queue(std::deque, 按块分配), 也可以用固定容量的环形缓冲区RingBuffer, 入队出队不分配内存:
+// -> BlockQueue<std::string> queue(1024);
+// -> BlockQueue<std::string, RingBuffer<std::string>> ring_queue(1024);
+// 批量操作每批只加一次锁: putAll()放入一段元素, drainTo()取出当前所有的元素
+// 单生产者或者单消费者的场景可以使用LockFreeQueue.h中的无锁队列, 接口相同
+
 #ifndef HTTPSERVER_LOGGER_BLOCK_QUEUE
 #define HTTPSERVER_LOGGER_BLOCK_QUEUE
 
 #include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+// 固定容量的环形缓冲区, 接口与std::queue相同; T需要可以默认构造, 出队的位置被赋值为T()释放资源
 template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(size_t capacity = 0)
+      : slots_(capacity),
+        head_(0),
+        size_(0)
+    {}
+
+    bool empty() const { return size_ == 0; }
+
+    size_t size() const { return size_; }
+
+    size_t capacity() const { return slots_.size(); }
+
+    T &front() { return slots_[head_]; }
+
+    template <typename U>
+    void push(U &&value)
+    {
+        assert(size_ < slots_.size());
+        size_t pos = head_ + size_;
+        slots_[pos < slots_.size() ? pos : pos - slots_.size()] = std::forward<U>(value);
+        ++size_;
+    }
+
+    template <typename... Args>
+    void emplace(Args &&... args)
+    {
+        push(T(std::forward<Args>(args)...));
+    }
+
+    void pop()
+    {
+        slots_[head_] = T();
+        head_ = head_ + 1 < slots_.size() ? head_ + 1 : 0;
+        --size_;
+    }
+
+    // 扩大容量, 保持元素的顺序
+    void reserve(size_t capacity)
+    {
+        if (capacity <= slots_.size())
+        {
+            return;
+        }
+        std::vector<T> slots(capacity);
+        for (size_t i = 0; i < size_; ++i)
+        {
+            size_t pos = head_ + i;
+            slots[i] = std::move(slots_[pos < slots_.size() ? pos : pos - slots_.size()]);
+        }
+        slots_.swap(slots);
+        head_ = 0;
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t head_;           // 队头的下标
+    size_t size_;           // 元素个数
+};
+
+template <typename T, typename Queue = std::queue<T>>
 class BlockQueue
 {
 public:
+    // capacity小于等于0时不限制容量(RingBuffer必须指定容量)
     explicit BlockQueue(int capacity = 0)
-      : queue_(),
+      : queue_(makeQueue(capacity)),
         capacity_(capacity),
         stopped_(false),
         lock_(),
@@ -37,11 +115,22 @@ public:
 
     void put(T &&other)
     {
-        add(other);
+        add(std::move(other));
     }
 
+    // 依次移动[first, last)中的元素到队列, 队列满时等待; 返回放入的个数, 队列停止时少于全部
+    template <typename It>
+    size_t putAll(It first, It last);
+
+    // 取出队头的元素, 队列为空时等待, 队列停止时直接返回
     void take(T &t);
 
+    // 最多等待timeout_ms毫秒, 超时或者队列停止时返回false
+    bool take(T &t, int timeout_ms);
+
+    // 不等待, 把当前的元素(最多max_items个)按顺序追加到out, 返回取出的个数
+    size_t drainTo(std::vector<T> &out, size_t max_items = SIZE_MAX);
+
     void stop()
     {
         {
@@ -83,14 +172,33 @@ public:
 
     void setCapactity(int capacity)
     {
+        std::lock_guard<std::mutex> guard(lock_);
         assert(capacity >= capacity_);
+        if constexpr (std::is_same_v<Queue, RingBuffer<T>>)
+        {
+            queue_.reserve(capacity);
+        }
         capacity_ = capacity;
+        not_full_cond_.notify_all();
     }
 
 private:
+    static Queue makeQueue(int capacity)
+    {
+        if constexpr (std::is_same_v<Queue, RingBuffer<T>>)
+        {
+            assert(capacity > 0);
+            return Queue(capacity);
+        }
+        else
+        {
+            return Queue();
+        }
+    }
+
     template<typename U>
     void add(U &&arg);
-    
+
     bool unlockedEmpty() const
     {
         return queue_.empty();
@@ -98,11 +206,11 @@ private:
 
     bool unlockedFull() const
     {
-        return queue_.size() == capacity_;
+        return capacity_ > 0 && static_cast<int>(queue_.size()) >= capacity_;
     }
 
 private:
-    std::queue<T> queue_;      
+    Queue queue_;
     int capacity_;                            // 队列的容量
     bool stopped_;                            // 队列是否停止工作
     mutable std::mutex lock_;                 // 锁住队列
@@ -110,8 +218,8 @@ private:
     std::condition_variable not_full_cond_;   // 队列没满
 };
 
-template<typename T>
-void BlockQueue<T>::take(T &t)
+template<typename T, typename Queue>
+void BlockQueue<T, Queue>::take(T &t)
 {
     std::unique_lock<std::mutex> guard(lock_);
     not_empty_cond_.wait(guard, [this]()
@@ -124,12 +232,81 @@ void BlockQueue<T>::take(T &t)
     }
     t = std::move(queue_.front());
     queue_.pop();
+    guard.unlock();
     not_full_cond_.notify_one();
 }
 
-template<typename T>
+template<typename T, typename Queue>
+bool BlockQueue<T, Queue>::take(T &t, int timeout_ms)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    bool ready = not_empty_cond_.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this]()
+    {
+        return stopped_ || !unlockedEmpty();
+    });
+    if (!ready || stopped_)
+    {
+        return false;
+    }
+    t = std::move(queue_.front());
+    queue_.pop();
+    guard.unlock();
+    not_full_cond_.notify_one();
+    return true;
+}
+
+template<typename T, typename Queue>
+size_t BlockQueue<T, Queue>::drainTo(std::vector<T> &out, size_t max_items)
+{
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        while (count < max_items && !unlockedEmpty())
+        {
+            out.push_back(std::move(queue_.front()));
+            queue_.pop();
+            ++count;
+        }
+    }
+    // 可能空出了多个位置
+    if (count > 0)
+    {
+        not_full_cond_.notify_all();
+    }
+    return count;
+}
+
+template<typename T, typename Queue>
+template<typename It>
+size_t BlockQueue<T, Queue>::putAll(It first, It last)
+{
+    size_t count = 0;
+    while (first != last)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            not_full_cond_.wait(guard, [this]()
+            {
+                return stopped_ || !unlockedFull();
+            });
+            if (stopped_)
+            {
+                return count;
+            }
+            // 一次加锁放入所有能放下的元素
+            for (; first != last && !unlockedFull(); ++first, ++count)
+            {
+                queue_.push(std::move(*first));
+            }
+        }
+        not_empty_cond_.notify_all();
+    }
+    return count;
+}
+
+template<typename T, typename Queue>
 template<typename U>
-void BlockQueue<T>::add(U &&arg)
+void BlockQueue<T, Queue>::add(U &&arg)
 {
     std::unique_lock<std::mutex> guard(lock_);
     not_full_cond_.wait(guard, [this]()
@@ -141,6 +318,7 @@ void BlockQueue<T>::add(U &&arg)
         return;
     }
     queue_.emplace(std::forward<U>(arg));
+    guard.unlock();
     not_empty_cond_.notify_one();
 }
 
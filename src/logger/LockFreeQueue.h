@@ -0,0 +1,536 @@
+// 有界无锁队列, 接口与BlockQueue相同, 容量向上取整到2的幂:
+// -> SpscQueue<T>: 单生产者单消费者, 两个位置各自只由一方修改, 入队出队各一次原子写
+// -> MpscQueue<T>: 多生产者单消费者, 每个槽位带序号, 生产者用CAS抢占位置(Vyukov的有界队列)
+// 队列空或者满时先短暂让出CPU, 再在QueueWaiter上等待; 没有线程等待时入队出队不加锁, 不调用系统调用
+// T需要可以默认构造, 出队的槽位被赋值为T()释放资源
+// -> MpscQueue<Task> queue(1024);
+// -> queue.put(std::move(task));              // 任意线程
+// -> queue.take(task, 100);                   // 只在一个线程上取出
+
+#ifndef HTTPSERVER_LOGGER_LOCK_FREE_QUEUE_H
+#define HTTPSERVER_LOGGER_LOCK_FREE_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// 无锁队列空或者满时的等待: 等待的线程先登记再检查条件, 通知的一方只在有线程登记时才加锁
+class QueueWaiter
+{
+public:
+    QueueWaiter()
+      : waiters_(0),
+        lock_(),
+        cond_()
+    {}
+
+    // 等待ready()为true, timeout_ms小于0时一直等待; 超时返回false
+    template <typename Pred>
+    bool wait(Pred ready, int timeout_ms = -1)
+    {
+        // 对方通常很快就会放入或者取出, 先让出几次CPU
+        for (int i = 0; i < SPIN_COUNT; ++i)
+        {
+            if (ready())
+            {
+                return true;
+            }
+            std::this_thread::yield();
+        }
+        // 登记和检查之间的全屏障与notify()中的配对: 要么对方看到登记, 要么这里看到对方的修改
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool result = true;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            if (timeout_ms < 0)
+            {
+                cond_.wait(guard, ready);
+            }
+            else
+            {
+                result = cond_.wait_for(guard, std::chrono::milliseconds(timeout_ms), ready);
+            }
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    // 修改队列之后调用
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0)
+        {
+            // 加锁保证等待的线程不在检查条件和开始等待之间
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+            }
+            cond_.notify_all();
+        }
+    }
+
+private:
+    static constexpr int SPIN_COUNT = 8;
+
+    std::atomic<int> waiters_;
+    std::mutex lock_;
+    std::condition_variable cond_;
+};
+
+// 不小于capacity的2的幂
+inline size_t queueCapacity(int capacity)
+{
+    size_t rounded = 2;
+    while (rounded < static_cast<size_t>(capacity))
+    {
+        rounded *= 2;
+    }
+    return rounded;
+}
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity)
+      : slots_(queueCapacity(capacity)),
+        mask_(slots_.size() - 1),
+        head_(0),
+        tail_(0),
+        stopped_(false),
+        not_empty_(),
+        not_full_()
+    {}
+
+    SpscQueue(const SpscQueue &) = delete;
+
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+public:
+    // 以下只在生产者线程调用
+    void put(const T &other) { add(other); }
+
+    void put(T &&other) { add(std::move(other)); }
+
+    // 队列满时返回false, 不移动other
+    template <typename U>
+    bool tryPut(U &&other)
+    {
+        if (!push(std::forward<U>(other)))
+        {
+            return false;
+        }
+        not_empty_.notify();
+        return true;
+    }
+
+    template <typename It>
+    size_t putAll(It first, It last);
+
+    // 以下只在消费者线程调用
+    void take(T &t) { take(t, -1); }
+
+    bool take(T &t, int timeout_ms);
+
+    bool tryTake(T &t)
+    {
+        if (!pop(t))
+        {
+            return false;
+        }
+        not_full_.notify();
+        return true;
+    }
+
+    size_t drainTo(std::vector<T> &out, size_t max_items = SIZE_MAX);
+
+    // 任意线程
+    void stop()
+    {
+        stopped_.store(true, std::memory_order_release);
+        not_empty_.notify();
+        not_full_.notify();
+    }
+
+    bool stopped() const { return stopped_.load(std::memory_order_acquire); }
+
+    int size() const
+    {
+        return static_cast<int>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+    }
+
+    int capacity() const { return static_cast<int>(slots_.size()); }
+
+    bool empty() const { return size() == 0; }
+
+    bool full() const { return size() >= capacity(); }
+
+private:
+    template <typename U>
+    void add(U &&other);
+
+    template <typename U>
+    bool push(U &&other)
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == slots_.size())
+        {
+            return false;
+        }
+        slots_[head & mask_] = std::forward<U>(other);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &t)
+    {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        t = std::move(slots_[tail & mask_]);
+        slots_[tail & mask_] = T();
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<uint64_t> head_;   // 下一个写入的位置, 只由生产者修改
+    alignas(64) std::atomic<uint64_t> tail_;   // 下一个读出的位置, 只由消费者修改
+    alignas(64) std::atomic<bool> stopped_;
+    QueueWaiter not_empty_;                    // 消费者等待队列不为空
+    QueueWaiter not_full_;                     // 生产者等待队列没满
+};
+
+template <typename T>
+class MpscQueue
+{
+public:
+    explicit MpscQueue(int capacity)
+      : cells_(new Cell[queueCapacity(capacity)]),
+        mask_(queueCapacity(capacity) - 1),
+        enqueue_pos_(0),
+        dequeue_pos_(0),
+        stopped_(false),
+        not_empty_(),
+        not_full_()
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+public:
+    // 以下可以在任意线程调用
+    void put(const T &other) { add(other); }
+
+    void put(T &&other) { add(std::move(other)); }
+
+    // 队列满时返回false, 不移动other
+    template <typename U>
+    bool tryPut(U &&other)
+    {
+        if (!push(std::forward<U>(other)))
+        {
+            return false;
+        }
+        not_empty_.notify();
+        return true;
+    }
+
+    template <typename It>
+    size_t putAll(It first, It last);
+
+    void stop()
+    {
+        stopped_.store(true, std::memory_order_release);
+        not_empty_.notify();
+        not_full_.notify();
+    }
+
+    bool stopped() const { return stopped_.load(std::memory_order_acquire); }
+
+    int size() const
+    {
+        size_t dequeue_pos = dequeue_pos_.load(std::memory_order_acquire);
+        size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+        return enqueue_pos > dequeue_pos ? static_cast<int>(enqueue_pos - dequeue_pos) : 0;
+    }
+
+    int capacity() const { return static_cast<int>(mask_ + 1); }
+
+    bool empty() const { return size() == 0; }
+
+    // 下一个位置的槽位还没有被消费者释放
+    bool full() const
+    {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].sequence.load(std::memory_order_acquire) < pos;
+    }
+
+    // 以下只在消费者线程调用
+    void take(T &t) { take(t, -1); }
+
+    bool take(T &t, int timeout_ms);
+
+    bool tryTake(T &t)
+    {
+        if (!pop(t))
+        {
+            return false;
+        }
+        not_full_.notify();
+        return true;
+    }
+
+    size_t drainTo(std::vector<T> &out, size_t max_items = SIZE_MAX);
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;   // 等于位置时可以写入, 等于位置+1时可以读出
+        T value;
+    };
+
+    template <typename U>
+    void add(U &&other);
+
+    template <typename U>
+    bool push(U &&other)
+    {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell *p_cell;
+        while (true)
+        {
+            p_cell = &cells_[pos & mask_];
+            size_t sequence = p_cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                // 抢占这个位置, 失败时pos更新为最新的位置
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // 槽位还没有被读出, 队列满
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        p_cell->value = std::forward<U>(other);
+        p_cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool readable() const
+    {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    bool pop(T &t)
+    {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell &cell = cells_[pos & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            // 空, 或者抢到位置的生产者还没有写完
+            return false;
+        }
+        t = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;   // 下一个抢占的位置, 生产者用CAS修改
+    alignas(64) std::atomic<size_t> dequeue_pos_;   // 下一个读出的位置, 只由消费者修改
+    alignas(64) std::atomic<bool> stopped_;
+    QueueWaiter not_empty_;                         // 消费者等待队列不为空
+    QueueWaiter not_full_;                          // 生产者等待队列没满
+};
+
+template <typename T>
+template <typename U>
+void SpscQueue<T>::add(U &&other)
+{
+    while (!stopped() && !push(std::forward<U>(other)))
+    {
+        not_full_.wait([this]() {
+            return stopped() || !full();
+        });
+    }
+    not_empty_.notify();
+}
+
+template <typename T>
+bool SpscQueue<T>::take(T &t, int timeout_ms)
+{
+    while (!stopped())
+    {
+        if (tryTake(t))
+        {
+            return true;
+        }
+        if (!not_empty_.wait([this]() { return stopped() || !empty(); }, timeout_ms))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+template <typename It>
+size_t SpscQueue<T>::putAll(It first, It last)
+{
+    size_t count = 0;
+    while (first != last && !stopped())
+    {
+        // 写入所有能放下的元素, 只发布一次位置
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t end = tail_.load(std::memory_order_acquire) + slots_.size();
+        uint64_t pos = head;
+        for (; first != last && pos < end; ++first, ++pos)
+        {
+            slots_[pos & mask_] = std::move(*first);
+        }
+        if (pos == head)
+        {
+            not_full_.wait([this]() {
+                return stopped() || !full();
+            });
+            continue;
+        }
+        head_.store(pos, std::memory_order_release);
+        count += pos - head;
+        not_empty_.notify();
+    }
+    return count;
+}
+
+template <typename T>
+size_t SpscQueue<T>::drainTo(std::vector<T> &out, size_t max_items)
+{
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    size_t count = std::min<uint64_t>(head - tail, max_items);
+    for (uint64_t pos = tail; pos < tail + count; ++pos)
+    {
+        out.push_back(std::move(slots_[pos & mask_]));
+        slots_[pos & mask_] = T();
+    }
+    if (count > 0)
+    {
+        tail_.store(tail + count, std::memory_order_release);
+        not_full_.notify();
+    }
+    return count;
+}
+
+template <typename T>
+template <typename U>
+void MpscQueue<T>::add(U &&other)
+{
+    while (!stopped() && !push(std::forward<U>(other)))
+    {
+        not_full_.wait([this]() {
+            return stopped() || !full();
+        });
+    }
+    not_empty_.notify();
+}
+
+template <typename T>
+bool MpscQueue<T>::take(T &t, int timeout_ms)
+{
+    while (!stopped())
+    {
+        if (tryTake(t))
+        {
+            return true;
+        }
+        if (!not_empty_.wait([this]() { return stopped() || readable(); }, timeout_ms))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+template <typename It>
+size_t MpscQueue<T>::putAll(It first, It last)
+{
+    size_t count = 0;
+    size_t notified = 0;
+    while (first != last && !stopped())
+    {
+        if (push(std::move(*first)))
+        {
+            ++first;
+            ++count;
+            continue;
+        }
+        // 等待之前让消费者看到已经放入的元素
+        if (notified < count)
+        {
+            not_empty_.notify();
+            notified = count;
+        }
+        not_full_.wait([this]() {
+            return stopped() || !full();
+        });
+    }
+    if (notified < count)
+    {
+        not_empty_.notify();
+    }
+    return count;
+}
+
+template <typename T>
+size_t MpscQueue<T>::drainTo(std::vector<T> &out, size_t max_items)
+{
+    size_t count = 0;
+    T t;
+    while (count < max_items && pop(t))
+    {
+        out.push_back(std::move(t));
+        ++count;
+    }
+    if (count > 0)
+    {
+        not_full_.notify();
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,354 @@
+#include <logger/LogDecoder.h>
+#include <logger/BinaryLog.h>
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using std::string;
+
+namespace
+{
+
+// 按printf的转换说明spec格式化一个值, 追加到out
+template <typename T>
+void appendFormatted(string &out, const string &spec, T value)
+{
+    int len = std::snprintf(nullptr, 0, spec.data(), value);
+    if (len <= 0)
+    {
+        return;
+    }
+    size_t start = out.size();
+    out.resize(start + len + 1);
+    std::snprintf(&out[start], len + 1, spec.data(), value);
+    out.resize(start + len);
+}
+
+// 编码的一个参数
+struct Arg
+{
+    LogArgType type;
+    uint64_t bits;          // INT/UINT/POINTER的值, DOUBLE的位模式
+    string str;             // STRING的内容
+
+    int64_t asInt() const
+    {
+        if (type == LogArgType::DOUBLE)
+        {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return static_cast<int64_t>(value);
+        }
+        return static_cast<int64_t>(bits);
+    }
+
+    double asDouble() const
+    {
+        if (type == LogArgType::DOUBLE)
+        {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        return type == LogArgType::INT ? static_cast<double>(static_cast<int64_t>(bits)) : static_cast<double>(bits);
+    }
+};
+
+// 读取下一个参数, 没有剩余的参数或者数据不完整返回false
+bool nextArg(const char *&args, const char *end, Arg &arg)
+{
+    if (args >= end)
+    {
+        return false;
+    }
+    arg.type = static_cast<LogArgType>(*args++);
+    if (arg.type == LogArgType::STRING)
+    {
+        uint16_t len;
+        if (end - args < static_cast<ptrdiff_t>(sizeof(len)))
+        {
+            return false;
+        }
+        memcpy(&len, args, sizeof(len));
+        args += sizeof(len);
+        if (end - args < len)
+        {
+            return false;
+        }
+        arg.str.assign(args, len);
+        args += len;
+        return true;
+    }
+    if (end - args < static_cast<ptrdiff_t>(sizeof(arg.bits)))
+    {
+        return false;
+    }
+    memcpy(&arg.bits, args, sizeof(arg.bits));
+    args += sizeof(arg.bits);
+    return true;
+}
+
+}
+
+bool LogDecoder::decodeFile(const std::string &path, const LineCallBack &output)
+{
+    // gzread(3)透明地读取压缩过(.gz)和没有压缩的文件
+    gzFile in = gzopen(path.data(), "rb");
+    if (!in)
+    {
+        std::fprintf(stderr, "open %s: %s\n", path.data(), strerror(errno));
+        return false;
+    }
+    string data;
+    char chunk[64 * 1024];
+    int read_len;
+    while ((read_len = gzread(in, chunk, sizeof(chunk))) > 0)
+    {
+        data.append(chunk, read_len);
+    }
+    // 被截断的压缩文件按已经解压的部分解码
+    gzclose(in);
+    LogFileHeader header;
+    if (data.size() < sizeof(header))
+    {
+        std::fprintf(stderr, "%s: not a binary log file\n", path.data());
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, LOG_BINARY_MAGIC, sizeof(header.magic)) != 0 || header.version != LOG_BINARY_VERSION)
+    {
+        std::fprintf(stderr, "%s: not a binary log file or unsupported version\n", path.data());
+        return false;
+    }
+    // 每个文件都重新写入了格式字符串
+    formats_.clear();
+    decode(data.data() + sizeof(header), data.size() - sizeof(header), output);
+    return true;
+}
+
+size_t LogDecoder::decode(const char *data, size_t len, const LineCallBack &output)
+{
+    size_t pos = 0;
+    LogRecordHeader header;
+    string line;
+    while (len - pos >= sizeof(header))
+    {
+        memcpy(&header, data + pos, sizeof(header));
+        if (header.size < sizeof(header) || header.size > len - pos)
+        {
+            break;
+        }
+        const char *payload = data + pos + sizeof(header);
+        size_t payload_len = header.size - sizeof(header);
+        pos += header.size;
+
+        string message;
+        const Format *p_format = nullptr;
+        switch (static_cast<LogRecordType>(header.type))
+        {
+            case LogRecordType::FORMAT:
+            {
+                // 行号, 格式字符串\0, 文件名\0
+                Format format;
+                if (payload_len < sizeof(format.line))
+                {
+                    ++errors_;
+                    continue;
+                }
+                memcpy(&format.line, payload, sizeof(format.line));
+                const char *strs = payload + sizeof(format.line);
+                size_t strs_len = payload_len - sizeof(format.line);
+                format.fmt.assign(strs, strnlen(strs, strs_len));
+                size_t file_start = std::min(strs_len, format.fmt.size() + 1);
+                format.file.assign(strs + file_start, strnlen(strs + file_start, strs_len - file_start));
+                formats_[header.format_id] = std::move(format);
+                continue;
+            }
+            case LogRecordType::EVENT:
+            {
+                auto it = formats_.find(header.format_id);
+                if (it == formats_.end())
+                {
+                    ++errors_;
+                    message = "<unknown format " + std::to_string(header.format_id) + ">";
+                }
+                else
+                {
+                    p_format = &it->second;
+                    message = format(p_format->fmt, payload, payload_len);
+                }
+                break;
+            }
+            case LogRecordType::TEXT:
+            {
+                message.assign(payload, payload_len);
+                break;
+            }
+            default:
+            {
+                ++errors_;
+                continue;
+            }
+        }
+
+        // 与文本模式相同的前缀: "%Y-%m-%d %H:%M:%S [LEVEL] : "
+        time_t seconds = header.timestamp_ns / 1000000000;
+        struct tm log_tm;
+        localtime_r(&seconds, &log_tm);
+        char str_time[32];
+        size_t time_len = strftime(str_time, sizeof(str_time), "%Y-%m-%d %H:%M:%S ", &log_tm);
+        line.assign(str_time, time_len);
+        line += logLevelPrefix(header.level);
+        line += message;
+        if (show_source_ && p_format)
+        {
+            line += " (" + p_format->file + ":" + std::to_string(p_format->line) + ")";
+        }
+        output(line);
+    }
+    return pos;
+}
+
+std::string LogDecoder::format(const std::string &fmt, const char *args, size_t len)
+{
+    const char *end = args + len;
+    string out;
+    Arg arg;
+    size_t i = 0;
+    while (i < fmt.size())
+    {
+        char c = fmt[i];
+        if (c != '%')
+        {
+            out += c;
+            ++i;
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+        {
+            out += '%';
+            i += 2;
+            continue;
+        }
+
+        // 转换说明: 标志, 宽度, 精度, 长度修饰符, 转换字符
+        // 参数统一编码成64位, 长度修饰符替换成与编码一致的类型
+        string spec = "%";
+        size_t j = i + 1;
+        while (j < fmt.size() && std::strchr("-+ #0'", fmt[j]))
+        {
+            spec += fmt[j++];
+        }
+        bool bad = false;
+        for (int part = 0; part < 2; ++part)
+        {
+            // 第0次是宽度, 第1次是精度
+            if (part == 1)
+            {
+                if (j >= fmt.size() || fmt[j] != '.')
+                {
+                    break;
+                }
+                spec += fmt[j++];
+            }
+            if (j < fmt.size() && fmt[j] == '*')
+            {
+                ++j;
+                if (nextArg(args, end, arg))
+                {
+                    spec += std::to_string(arg.asInt());
+                }
+                else
+                {
+                    bad = true;
+                }
+                continue;
+            }
+            while (j < fmt.size() && fmt[j] >= '0' && fmt[j] <= '9')
+            {
+                spec += fmt[j++];
+            }
+        }
+        while (j < fmt.size() && std::strchr("hlLqjzt", fmt[j]))
+        {
+            ++j;
+        }
+        if (j >= fmt.size())
+        {
+            out.append(fmt, i, string::npos);
+            break;
+        }
+        char conversion = fmt[j];
+        i = j + 1;
+        if (conversion == 'n')
+        {
+            continue;
+        }
+        if (bad || !nextArg(args, end, arg))
+        {
+            // 参数在编码时因为记录长度被丢弃
+            out += "<?>";
+            continue;
+        }
+        switch (conversion)
+        {
+            case 'd':
+            case 'i':
+            {
+                appendFormatted(out, spec + "lld", static_cast<long long>(arg.asInt()));
+                break;
+            }
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            {
+                appendFormatted(out, spec + "ll" + conversion, static_cast<unsigned long long>(arg.asInt()));
+                break;
+            }
+            case 'c':
+            {
+                appendFormatted(out, spec + conversion, static_cast<int>(arg.asInt()));
+                break;
+            }
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+            {
+                appendFormatted(out, spec + conversion, arg.asDouble());
+                break;
+            }
+            case 's':
+            {
+                if (arg.type != LogArgType::STRING)
+                {
+                    ++errors_;
+                    out += "<?>";
+                    break;
+                }
+                appendFormatted(out, spec + conversion, arg.str.data());
+                break;
+            }
+            case 'p':
+            {
+                appendFormatted(out, spec + conversion, reinterpret_cast<void *>(static_cast<uintptr_t>(arg.bits)));
+                break;
+            }
+            default:
+            {
+                ++errors_;
+                out += "<?>";
+                break;
+            }
+        }
+    }
+    return out;
+}
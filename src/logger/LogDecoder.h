@@ -0,0 +1,55 @@
+// 把二进制日志文件(格式见BinaryLog.h)解码成与文本模式相同的文本
+// -> LogDecoder decoder;
+// -> decoder.decodeFile("./log/xxx.log", [](const std::string &line) { puts(line.data()); });
+
+#ifndef HTTPSERVER_LOGGER_LOG_DECODER_H
+#define HTTPSERVER_LOGGER_LOG_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+class LogDecoder
+{
+public:
+    using LineCallBack = std::function<void(const std::string &line)>;
+
+public:
+    // show_source为true时在每条日志后面加上输出日志的源文件和行号
+    explicit LogDecoder(bool show_source = false)
+      : show_source_(show_source),
+        formats_(),
+        errors_(0)
+    {}
+
+public:
+    // 解码一个日志文件(可以是压缩过的.gz文件), 每条日志调用一次output(没有换行)
+    // 不是二进制日志文件或者读取失败返回false, 文件末尾不完整的记录被忽略(进程在写入时退出)
+    bool decodeFile(const std::string &path, const LineCallBack &output);
+
+    // 解码一段数据: 从文件头之后开始的连续记录, 返回完整解码的字节数
+    size_t decode(const char *data, size_t len, const LineCallBack &output);
+
+    // 无法解码的记录数目(没有登记的格式字符串, 参数不匹配)
+    size_t errors() const { return errors_; }
+
+private:
+    struct Format
+    {
+        std::string fmt;
+        std::string file;
+        uint32_t line;
+    };
+
+    // 按格式字符串和编码的参数格式化一条日志
+    std::string format(const std::string &fmt, const char *args, size_t len);
+
+private:
+    bool show_source_;
+    std::unordered_map<uint32_t, Format> formats_;  // 当前文件中登记的格式字符串
+    size_t errors_;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include <logger/LogRotator.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+namespace
+{
+
+constexpr size_t COMPRESS_CHUNK = 256 * 1024;
+
+// ioprio_set(2)没有glibc封装
+constexpr int IOPRIO_WHO_PROCESS = 1;
+constexpr int IOPRIO_CLASS_IDLE = 3;
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+
+}
+
+LogRotator::~LogRotator()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        stopped_ = true;
+    }
+    cond_.notify_all();
+    if (worker_.joinable())
+    {
+        worker_.join();
+    }
+}
+
+void LogRotator::start(const std::string &log_path, const std::string &log_suffix, const LogRotation &rotation)
+{
+    log_path_ = log_path;
+    log_suffix_ = log_suffix;
+    rotation_ = rotation;
+    if (rotation_.compress)
+    {
+        worker_ = std::thread(&LogRotator::threadFunc, this);
+    }
+}
+
+void LogRotator::rotated(const std::string &path, const std::string &current)
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        current_ = current;
+        if (rotation_.compress)
+        {
+            pending_.push_back(path);
+        }
+    }
+    if (rotation_.compress)
+    {
+        // 压缩后再按压缩过的大小计算保留策略
+        cond_.notify_one();
+        return;
+    }
+    enforceRetention();
+}
+
+void LogRotator::threadFunc()
+{
+    // 压缩只占用空闲的CPU和磁盘带宽, 不影响处理请求
+    pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    if (::setpriority(PRIO_PROCESS, tid, 19) < 0)
+    {
+        std::perror("setpriority()");
+    }
+    if (::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+    {
+        std::perror("ioprio_set()");
+    }
+    while (true)
+    {
+        string path;
+        {
+            unique_lock<mutex> guard(lock_);
+            cond_.wait(guard, [this]() {
+                return stopped_ || !pending_.empty();
+            });
+            if (stopped_)
+            {
+                break;
+            }
+            path = std::move(pending_.front());
+            pending_.pop_front();
+        }
+        compress(path);
+        enforceRetention();
+    }
+}
+
+bool LogRotator::compress(const std::string &path)
+{
+    int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        // 等待压缩时可能已经被保留策略删除
+        if (errno == ENOENT)
+        {
+            return false;
+        }
+        std::fprintf(stderr, "open(): %s(%s)\n", strerror(errno), path.data());
+        return false;
+    }
+    // 先写入临时文件, 完成后再改名, 进程退出时不会留下不完整的压缩文件
+    string gz_path = path + ".gz";
+    string tmp_path = gz_path + ".tmp";
+    gzFile gz = gzopen(tmp_path.data(), "wb");
+    if (!gz)
+    {
+        std::fprintf(stderr, "gzopen(): %s(%s)\n", strerror(errno), tmp_path.data());
+        ::close(fd);
+        return false;
+    }
+    vector<char> chunk(COMPRESS_CHUNK);
+    bool ok = true;
+    while (true)
+    {
+        ssize_t read_len = ::read(fd, chunk.data(), chunk.size());
+        if (read_len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_len <= 0)
+        {
+            ok = read_len == 0;
+            break;
+        }
+        if (gzwrite(gz, chunk.data(), static_cast<unsigned>(read_len)) != read_len)
+        {
+            ok = false;
+            break;
+        }
+    }
+    ::close(fd);
+    ok = gzclose(gz) == Z_OK && ok;
+    if (!ok || ::rename(tmp_path.data(), gz_path.data()) < 0)
+    {
+        std::fprintf(stderr, "compress %s failed\n", path.data());
+        ::unlink(tmp_path.data());
+        return false;
+    }
+    ::unlink(path.data());
+    return true;
+}
+
+bool LogRotator::isLogFile(const std::string &name) const
+{
+    auto ends_with = [&name](const string &suffix) {
+        return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return !name.empty() && name[0] >= '0' && name[0] <= '9' &&
+           (ends_with(log_suffix_) || ends_with(log_suffix_ + ".gz"));
+}
+
+void LogRotator::enforceRetention()
+{
+    if (rotation_.max_files <= 0 && rotation_.max_total_bytes == 0)
+    {
+        return;
+    }
+    lock_guard<mutex> guard(retention_lock_);
+    string current;
+    {
+        lock_guard<mutex> current_guard(lock_);
+        current = current_;
+    }
+
+    struct LogFile
+    {
+        string path;
+        size_t size;
+    };
+    vector<LogFile> files;
+    DIR *p_dir = ::opendir(log_path_.data());
+    if (!p_dir)
+    {
+        std::perror(("::opendir() " + log_path_).data());
+        return;
+    }
+    while (struct dirent *p_entry = ::readdir(p_dir))
+    {
+        string name = p_entry->d_name;
+        if (!isLogFile(name))
+        {
+            continue;
+        }
+        string path = log_path_ + "/" + name;
+        struct stat file_stat;
+        if (::stat(path.data(), &file_stat) < 0 || !S_ISREG(file_stat.st_mode))
+        {
+            continue;
+        }
+        // 按实际占用的磁盘空间计算, 包括正在写入的文件预先分配的空间
+        files.push_back({path, static_cast<size_t>(file_stat.st_blocks) * 512});
+    }
+    ::closedir(p_dir);
+
+    // 文件名以时间和序号开头, 从新到旧排列
+    std::sort(files.begin(), files.end(), [](const LogFile &lhs, const LogFile &rhs) {
+        return lhs.path > rhs.path;
+    });
+    size_t total = 0;
+    int count = 0;
+    for (auto &file : files)
+    {
+        total += file.size;
+        ++count;
+        bool over = (rotation_.max_files > 0 && count > rotation_.max_files) ||
+                    (rotation_.max_total_bytes > 0 && total > rotation_.max_total_bytes);
+        if (over && file.path != current)
+        {
+            ::unlink(file.path.data());
+        }
+    }
+}
@@ -0,0 +1,89 @@
+// 处理不再写入的日志文件: 在低优先级的后台线程上用gzip压缩, 再按保留策略删除最旧的日志文件
+//
+// 日志文件名以时间和序号开头("%Y_%m_%d-%H_%M_%S-序号"), 按文件名排序就是写入的顺序
+// 保留策略只处理日志目录中这种格式, 以日志后缀(或者加上.gz)结尾的文件, 当前正在写入的文件不会被删除
+// -> LogRotator rotator;
+// -> rotator.start("./log", ".log", rotation);
+// -> rotator.rotated("./log/2024_01_01-00_00_00-0000.log", "./log/2024_01_01-00_10_00-0001.log");
+
+#ifndef HTTPSERVER_LOGGER_LOG_ROTATOR_H
+#define HTTPSERVER_LOGGER_LOG_ROTATOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 日志文件的分割和保留策略, 0表示不限制
+struct LogRotation
+{
+    size_t max_file_bytes = 64 * 1024 * 1024;   // 单个日志文件的大小上限, 超过后写入新文件
+    bool preallocate = true;                    // 用fallocate(2)在写入位置之前预先分配空间
+    int max_files = 32;                         // 保留的日志文件数目(包括压缩过的)
+    size_t max_total_bytes = 1024UL * 1024 * 1024;  // 保留的日志文件总大小
+    bool compress = true;                       // 压缩不再写入的日志文件
+};
+
+class LogRotator
+{
+public:
+    LogRotator()
+      : log_path_(),
+        log_suffix_(),
+        rotation_(),
+        current_(),
+        pending_(),
+        stopped_(false),
+        worker_(),
+        lock_(),
+        retention_lock_(),
+        cond_()
+    {}
+
+    LogRotator(const LogRotator &) = delete;
+
+    LogRotator(LogRotator &&) = delete;
+
+    LogRotator &operator=(const LogRotator &) = delete;
+
+    LogRotator &operator=(LogRotator &&) = delete;
+
+    // 停止后台线程, 还没有压缩的文件保持原样
+    ~LogRotator();
+
+public:
+    // 开启压缩时创建后台线程
+    void start(const std::string &log_path, const std::string &log_suffix, const LogRotation &rotation);
+
+    // 日志文件path不再写入, 之后写入current
+    void rotated(const std::string &path, const std::string &current);
+
+    // 按保留策略删除最旧的日志文件
+    void enforceRetention();
+
+    // 把path压缩成path.gz, 成功后删除path
+    static bool compress(const std::string &path);
+
+private:
+    // 后台线程执行函数
+    void threadFunc();
+
+    // 是否是日志文件, 包括压缩过的
+    bool isLogFile(const std::string &name) const;
+
+private:
+    std::string log_path_;
+    std::string log_suffix_;
+    LogRotation rotation_;
+    std::string current_;                   // 正在写入的日志文件, 由lock_保护
+    std::deque<std::string> pending_;       // 等待压缩的文件, 由lock_保护
+    bool stopped_;
+    std::thread worker_;
+    std::mutex lock_;
+    std::mutex retention_lock_;             // 日志线程和后台线程都会删除文件
+    std::condition_variable cond_;
+};
+
+#endif
@@ -0,0 +1,142 @@
+// 只能移动的任务对象, 可调用对象保存在固定大小的内联存储中, 构造和移动都不分配内存
+//
+// 可调用对象超过INLINE_SIZE时编译失败, 而不是像std::function一样退回到堆上
+// 任务可以带有TaskGuard, 线程池取出任务时丢弃已经取消或者过期的任务, 不执行也不占用工作线程
+// -> Task task([this, wp_conn]() { onRead(wp_conn); });
+// -> Task task([this, wp_conn]() { onRead(wp_conn); }, TaskGuard{&generation, generation.load(), deadline_ns});
+// -> task();
+
+#ifndef HTTPSERVER_POOL_TASK_H
+#define HTTPSERVER_POOL_TASK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 任务的有效条件
+// -> 取消: *p_generation不再等于generation, 如关闭连接时递增该连接的代数
+// -> 过期: steady_clock的当前时间(纳秒)超过deadline_ns, 0表示没有期限
+// p_generation指向的计数需要比线程池活得更久
+struct TaskGuard
+{
+    const std::atomic<uint32_t> *p_generation = nullptr;
+    uint32_t generation = 0;
+    int64_t deadline_ns = 0;
+
+    bool cancelled() const { return p_generation && p_generation->load(std::memory_order_relaxed) != generation; }
+
+    bool expired(int64_t now_ns) const { return deadline_ns != 0 && now_ns > deadline_ns; }
+};
+
+class Task
+{
+public:
+    static constexpr size_t INLINE_SIZE = 48;  // 足够保存this指针加上一个weak_ptr以及少量其它捕获
+
+public:
+    Task() noexcept
+      : p_ops_(nullptr)
+    {}
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same<std::decay_t<F>, Task>::value>>
+    Task(F &&func, const TaskGuard &guard = TaskGuard())
+      : p_ops_(&OpsOf<std::decay_t<F>>::ops),
+        guard_(guard)
+    {
+        using Func = std::decay_t<F>;
+        static_assert(sizeof(Func) <= INLINE_SIZE, "task captures exceed Task::INLINE_SIZE");
+        static_assert(alignof(Func) <= alignof(std::max_align_t), "task captures are over-aligned");
+        static_assert(std::is_nothrow_move_constructible<Func>::value, "task captures must be nothrow movable");
+        new (storage_) Func(std::forward<F>(func));
+    }
+
+    Task(const Task &) = delete;
+
+    Task(Task &&other) noexcept
+      : p_ops_(other.p_ops_),
+        guard_(other.guard_)
+    {
+        if (p_ops_)
+        {
+            p_ops_->move(storage_, other.storage_);
+            other.p_ops_ = nullptr;
+        }
+    }
+
+    Task &operator=(const Task &) = delete;
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.p_ops_)
+            {
+                other.p_ops_->move(storage_, other.storage_);
+                p_ops_ = other.p_ops_;
+                other.p_ops_ = nullptr;
+            }
+            guard_ = other.guard_;
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        reset();
+    }
+
+public:
+    void operator()() { p_ops_->invoke(storage_); }
+
+    explicit operator bool() const { return p_ops_ != nullptr; }
+
+    const TaskGuard &guard() const { return guard_; }
+
+    // 销毁保存的可调用对象, 释放它捕获的资源
+    void reset() noexcept
+    {
+        if (p_ops_)
+        {
+            p_ops_->destroy(storage_);
+            p_ops_ = nullptr;
+        }
+        guard_ = TaskGuard();
+    }
+
+private:
+    // 按可调用对象的类型生成的操作表
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src);    // 移动构造到dst并销毁src
+        void (*destroy)(void *storage);
+    };
+
+    template <typename Func>
+    struct OpsOf
+    {
+        static void invoke(void *storage) { (*static_cast<Func *>(storage))(); }
+
+        static void move(void *dst, void *src)
+        {
+            new (dst) Func(std::move(*static_cast<Func *>(src)));
+            static_cast<Func *>(src)->~Func();
+        }
+
+        static void destroy(void *storage) { static_cast<Func *>(storage)->~Func(); }
+
+        static constexpr Ops ops = {&invoke, &move, &destroy};
+    };
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+    const Ops *p_ops_;
+    TaskGuard guard_;
+};
+
+#endif
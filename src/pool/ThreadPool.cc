@@ -1,33 +1,582 @@
 #include "ThreadPool.h"
 
-void ThreadPool::threadFunc()
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+namespace
+{
+
+// 当前线程所属的线程池以及在其中的序号, 不是工作线程时为空
+thread_local ThreadPool *tl_pool = nullptr;
+thread_local size_t tl_index = 0;
+
+// *addr仍然等于expected时休眠, 直到被唤醒或者超时(timeout为空时不超时)
+// 超时返回false
+bool futexWait(std::atomic<uint32_t> *addr, uint32_t expected, const struct timespec *timeout = nullptr)
+{
+    long ret = ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+    return !(ret < 0 && errno == ETIMEDOUT);
+}
+
+void futexWake(std::atomic<uint32_t> *addr, int count)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+// 选择窃取对象的伪随机数(xorshift), 每个线程独立
+uint32_t nextRandom()
+{
+    thread_local uint32_t state = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state)) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+}
+
+ThreadPool::ThreadPool(int min_threads, int max_threads, std::chrono::milliseconds idle_timeout)
+  : workers_(),
+    min_threads_(std::max(min_threads, 1)),
+    idle_timeout_(idle_timeout),
+    scale_lock_(),
+    active_(0),
+    last_grow_ns_(0),
+    grown_(0),
+    shrunk_(0),
+    max_wait_ns_(0),
+    cancelled_(0),
+    expired_(0),
+    inject_lock_(),
+    lanes_(),
+    inject_size_(0),
+    injected_count_(0),
+    running_(true),
+    idle_lock_(),
+    idle_(),
+    idle_count_(0)
+{
+    size_t slots = std::max<size_t>(min_threads_, std::max(max_threads, 1));
+    // 先建好所有槽位, 工作线程启动后就可能窃取其它槽位的队列
+    for (size_t i = 0; i < slots; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+    idle_.reserve(slots);
+    for (Lane &lane : lanes_)
+    {
+        lane.tasks.resize(INJECT_CAPACITY);
+    }
+    std::lock_guard<std::mutex> guard(scale_lock_);
+    for (size_t i = 0; i < min_threads_; ++i)
+    {
+        startWorker();
+    }
+}
+
+void ThreadPool::shutdown()
+{
+    std::vector<std::thread> threads;
+    {
+        // 之后不会再启动新线程, 正在退出的线程也不会再修改槽位
+        std::lock_guard<std::mutex> guard(scale_lock_);
+        if (!running_.load())
+        {
+            return;
+        }
+        running_.store(false);
+        for (auto &p_worker : workers_)
+        {
+            if (p_worker->thread.joinable())
+            {
+                threads.push_back(std::move(p_worker->thread));
+            }
+        }
+    }
+    for (auto &p_worker : workers_)
+    {
+        p_worker->notified.store(1);
+        futexWake(&p_worker->notified, INT_MAX);
+    }
+    // 工作线程引用各自的队列, 必须等它们退出后才能释放
+    // 队列中剩余的任务随节点所在的内存块以及注入队列一起销毁
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+ThreadPoolStats ThreadPool::stats() const
+{
+    ThreadPoolStats stats;
+    stats.threads = active_.load();
+    stats.idle = idle_count_.load();
+    stats.queued = injected_count_.load();
+    stats.grown = grown_.load();
+    stats.shrunk = shrunk_.load();
+    stats.max_wait_us = static_cast<uint64_t>(max_wait_ns_.load() / 1000);
+    stats.cancelled = cancelled_.load();
+    stats.expired = expired_.load();
+    return stats;
+}
+
+void ThreadPool::addTasks(Task *tasks, size_t count, TaskPriority priority)
+{
+    if (count == 0 || !running_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    int64_t oldest_ns = 0;
+    if (tl_pool == this && priority == TaskPriority::INTERACTIVE)
+    {
+        // 工作线程上产生的任务放入自己的队列, 空闲的线程可以窃取
+        for (size_t i = 0; i < count; ++i)
+        {
+            pushLocal(tl_index, std::move(tasks[i]));
+        }
+    }
+    else
+    {
+        int64_t now_ns = nowNs();
+        std::lock_guard<std::mutex> guard(inject_lock_);
+        oldest_ns = oldestInjected();
+        Lane &lane = lanes_[static_cast<size_t>(priority)];
+        if (lane.size + count > lane.tasks.size())
+        {
+            // 扩容到2的幂, 按队列顺序搬到新数组的开头
+            size_t capacity = lane.tasks.size();
+            while (capacity < lane.size + count)
+            {
+                capacity *= 2;
+            }
+            std::vector<InjectedTask> bigger(capacity);
+            for (size_t i = 0; i < lane.size; ++i)
+            {
+                bigger[i] = std::move(lane.tasks[(lane.head + i) & (lane.tasks.size() - 1)]);
+            }
+            lane.tasks.swap(bigger);
+            lane.head = 0;
+        }
+        size_t mask = lane.tasks.size() - 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            InjectedTask &slot = lane.tasks[(lane.head + lane.size + i) & mask];
+            slot.task = std::move(tasks[i]);
+            slot.enqueue_ns = now_ns;
+        }
+        lane.size += count;
+        inject_size_ += count;
+        injected_count_.store(inject_size_, std::memory_order_relaxed);
+    }
+    notify(count);
+    if (oldest_ns > 0)
+    {
+        // 所有线程都阻塞时没有线程会取注入队列, 由提交者检查是否需要扩容
+        int64_t now_ns = nowNs();
+        checkGrow(now_ns - oldest_ns, now_ns);
+    }
+}
+
+void ThreadPool::checkGrow(int64_t wait_ns, int64_t now_ns)
+{
+    int64_t max_wait_ns = max_wait_ns_.load(std::memory_order_relaxed);
+    while (wait_ns > max_wait_ns &&
+           !max_wait_ns_.compare_exchange_weak(max_wait_ns, wait_ns, std::memory_order_relaxed))
+    {
+    }
+    if (wait_ns < std::chrono::nanoseconds(GROW_WAIT).count() ||
+        idle_count_.load() > 0 || active_.load() >= workers_.size())
+    {
+        return;
+    }
+    int64_t last_ns = last_grow_ns_.load(std::memory_order_relaxed);
+    if (now_ns - last_ns < std::chrono::nanoseconds(GROW_INTERVAL).count() ||
+        !last_grow_ns_.compare_exchange_strong(last_ns, now_ns, std::memory_order_relaxed))
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(scale_lock_);
+    if (startWorker())
+    {
+        grown_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool ThreadPool::startWorker()
+{
+    if (!running_.load() || active_.load() >= workers_.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        Worker &worker = *workers_[i];
+        if (worker.running)
+        {
+            continue;
+        }
+        // 之前在这个槽位上的线程已经退出了循环, 不再访问槽位
+        if (worker.thread.joinable())
+        {
+            worker.thread.join();
+        }
+        worker.running = true;
+        active_.fetch_add(1);
+        worker.thread = std::thread(&ThreadPool::threadFunc, this, i);
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::retire(size_t index)
+{
+    std::lock_guard<std::mutex> guard(scale_lock_);
+    if (!running_.load() || active_.load() <= min_threads_ || !removeIdle(index))
+    {
+        return false;
+    }
+    // 空闲线程的本地队列一定为空, 槽位中的任务节点留给之后的线程
+    workers_[index]->running = false;
+    active_.fetch_sub(1);
+    shrunk_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void ThreadPool::pushLocal(size_t index, Task &&task)
+{
+    Worker &worker = *workers_[index];
+    TaskNode *p_node = allocNode(worker);
+    p_node->task = std::move(task);
+    worker.deque.push(p_node);
+}
+
+void ThreadPool::threadFunc(size_t index)
+{
+    tl_pool = this;
+    tl_index = index;
+    while (running_.load(std::memory_order_acquire))
+    {
+        TaskNode *p_node = findTask(index);
+        if (p_node)
+        {
+            // 在本地队列中等待期间也可能被取消或者过期
+            int64_t now_ns = 0;
+            if (!discard(p_node->task, now_ns))
+            {
+                p_node->task();
+            }
+            // 立即释放任务捕获的资源(如连接的引用), 节点留待复用
+            p_node->task.reset();
+            releaseNode(p_node);
+            continue;
+        }
+        if (!park(index))
+        {
+            break;
+        }
+    }
+    tl_pool = nullptr;
+}
+
+ThreadPool::TaskNode *ThreadPool::findTask(size_t index)
+{
+    if (TaskNode *p_node = workers_[index]->deque.pop())
+    {
+        return p_node;
+    }
+    if (TaskNode *p_node = takeInjected(index))
+    {
+        return p_node;
+    }
+    return steal(index);
+}
+
+ThreadPool::TaskNode *ThreadPool::takeInjected(size_t index)
 {
-    while (true)
+    if (injected_count_.load(std::memory_order_relaxed) == 0)
+    {
+        return nullptr;
+    }
+    Worker &worker = *workers_[index];
+    TaskNode *batch[INJECT_BATCH];
+    size_t count = 0;
+    int64_t oldest_ns = 0;
+    int64_t now_ns = 0;
     {
-        std::function<void()> task;
-        // 缩小临界区
+        std::lock_guard<std::mutex> guard(inject_lock_);
+        oldest_ns = oldestInjected();
+        while (count < INJECT_BATCH && inject_size_ > 0)
         {
-            std::unique_lock<std::mutex> guard(lock_);
-            while (task_queue_.empty() && isRunning_)
+            size_t priority = pickLane();
+            Lane &lane = lanes_[priority];
+            Task &task = lane.tasks[lane.head].task;
+            lane.head = (lane.head + 1) & (lane.tasks.size() - 1);
+            --lane.size;
+            --inject_size_;
+            if (discard(task, now_ns))
             {
-                cond_.wait(guard);
+                // 不占用这一批的位置, 立即释放捕获的资源(如连接的weak_ptr)
+                task.reset();
+                continue;
             }
-            if (!isRunning_)
+            TaskNode *p_node = allocNode(worker);
+            p_node->task = std::move(task);
+            batch[count++] = p_node;
+            if (priority != static_cast<size_t>(TaskPriority::INTERACTIVE))
             {
+                // 长任务放在这一批的最后, 不让同一批的小任务在本地队列中等它执行完
                 break;
             }
-            task = std::move(task_queue_.front());
-            task_queue_.pop();
         }
-        task();
+        injected_count_.store(inject_size_, std::memory_order_relaxed);
+    }
+    if (count == 0)
+    {
+        return nullptr;
+    }
+    now_ns = nowNs();
+    checkGrow(now_ns - oldest_ns, now_ns);
+    // 第一个立即执行, 其余逆序放入本地队列, 从底部取出时仍然按提交的顺序
+    for (size_t i = count - 1; i > 0; --i)
+    {
+        worker.deque.push(batch[i]);
+    }
+    if (count > 1)
+    {
+        notify(1);
+    }
+    return batch[0];
+}
+
+size_t ThreadPool::pickLane()
+{
+    // 平滑加权轮询: 每个非空队列的权重累加到credit上, 选择credit最大的队列并减去非空队列的权重之和
+    // 权重为8:2:1时, 三个队列都非空的每11个任务中依次取出8, 2, 1个, 并且交错而不是连续取出
+    size_t best = TASK_PRIORITIES;
+    int total = 0;
+    for (size_t i = 0; i < TASK_PRIORITIES; ++i)
+    {
+        Lane &lane = lanes_[i];
+        if (lane.size == 0)
+        {
+            // 空队列不积累权重, 重新有任务时不会连续占用
+            lane.credit = 0;
+            continue;
+        }
+        lane.credit += LANE_WEIGHTS[i];
+        total += LANE_WEIGHTS[i];
+        if (best == TASK_PRIORITIES || lane.credit > lanes_[best].credit)
+        {
+            best = i;
+        }
+    }
+    lanes_[best].credit -= total;
+    return best;
+}
+
+int64_t ThreadPool::oldestInjected() const
+{
+    int64_t oldest_ns = 0;
+    for (const Lane &lane : lanes_)
+    {
+        if (lane.size > 0 && (oldest_ns == 0 || lane.tasks[lane.head].enqueue_ns < oldest_ns))
+        {
+            oldest_ns = lane.tasks[lane.head].enqueue_ns;
+        }
+    }
+    return oldest_ns;
+}
+
+bool ThreadPool::discard(const Task &task, int64_t &now_ns)
+{
+    const TaskGuard &guard = task.guard();
+    if (guard.cancelled())
+    {
+        cancelled_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (guard.deadline_ns != 0)
+    {
+        if (now_ns == 0)
+        {
+            now_ns = nowNs();
+        }
+        if (guard.expired(now_ns))
+        {
+            expired_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+ThreadPool::TaskNode *ThreadPool::steal(size_t index)
+{
+    size_t n = workers_.size();
+    size_t start = nextRandom() % n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t victim = (start + i) % n;
+        if (victim == index)
+        {
+            continue;
+        }
+        if (TaskNode *p_node = workers_[victim]->deque.steal())
+        {
+            return p_node;
+        }
+    }
+    return nullptr;
+}
+
+ThreadPool::TaskNode *ThreadPool::allocNode(Worker &worker)
+{
+    if (!worker.free_nodes)
+    {
+        // 取回其它线程归还的全部节点, 只有所属线程取出, 不存在ABA问题
+        worker.free_nodes = worker.remote_free.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (!worker.free_nodes)
+    {
+        worker.chunks.emplace_back(new TaskNode[NODE_CHUNK]);
+        TaskNode *chunk = worker.chunks.back().get();
+        for (size_t i = 0; i < NODE_CHUNK; ++i)
+        {
+            chunk[i].owner = &worker;
+            chunk[i].next = i + 1 < NODE_CHUNK ? &chunk[i + 1] : nullptr;
+        }
+        worker.free_nodes = chunk;
+    }
+    TaskNode *p_node = worker.free_nodes;
+    worker.free_nodes = p_node->next;
+    return p_node;
+}
+
+void ThreadPool::releaseNode(TaskNode *p_node)
+{
+    Worker &owner = *p_node->owner;
+    if (tl_pool == this && workers_[tl_index].get() == &owner)
+    {
+        p_node->next = owner.free_nodes;
+        owner.free_nodes = p_node;
+        return;
+    }
+    TaskNode *head = owner.remote_free.load(std::memory_order_relaxed);
+    do
+    {
+        p_node->next = head;
+    } while (!owner.remote_free.compare_exchange_weak(head, p_node, std::memory_order_release,
+                                                      std::memory_order_relaxed));
+}
+
+bool ThreadPool::hasWork() const
+{
+    if (injected_count_.load(std::memory_order_relaxed) > 0)
+    {
+        return true;
+    }
+    for (const auto &p_worker : workers_)
+    {
+        if (!p_worker->deque.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::park(size_t index)
+{
+    Worker &worker = *workers_[index];
+    worker.notified.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(idle_lock_);
+        idle_.push_back(index);
+        idle_count_.fetch_add(1);
+    }
+    // 登记之后再确认一次: 提交者放入任务后检查idle_count_, 看到0说明这里的检查一定能看到新任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (hasWork() || !running_.load())
+    {
+        // 已经被提交者取出时等待它发出的唤醒, 否则迟到的唤醒会落在下一次park()上,
+        // 那时新登记的idle_项不会被移除
+        if (!removeIdle(index))
+        {
+            while (worker.notified.load(std::memory_order_acquire) == 0)
+            {
+                futexWait(&worker.notified, 0);
+            }
+        }
+        return true;
+    }
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(idle_timeout_);
+    struct timespec timeout;
+    timeout.tv_sec = seconds.count();
+    timeout.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(idle_timeout_ - seconds).count();
+    while (worker.notified.load(std::memory_order_acquire) == 0)
+    {
+        // 空闲超时后尝试退出, 线程数已经是下限或者刚好被唤醒时继续等待
+        if (!futexWait(&worker.notified, 0, &timeout) &&
+            worker.notified.load(std::memory_order_acquire) == 0 && retire(index))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ThreadPool::removeIdle(size_t index)
+{
+    std::lock_guard<std::mutex> guard(idle_lock_);
+    for (size_t i = 0; i < idle_.size(); ++i)
+    {
+        if (idle_[i] == index)
+        {
+            idle_[i] = idle_.back();
+            idle_.pop_back();
+            idle_count_.fetch_sub(1);
+            return true;
+        }
     }
+    return false;
 }
 
-ThreadPool::~ThreadPool()
+void ThreadPool::notify(size_t count)
 {
+    // 没有空闲线程时只有一次读, 不修改共享的缓存行
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_count_.load() == 0)
     {
-        std::unique_lock<std::mutex> guard(lock_);
-        isRunning_ = false;
+        return;
+    }
+    Worker *woken[INJECT_BATCH];
+    while (count > 0)
+    {
+        size_t n = 0;
+        {
+            std::lock_guard<std::mutex> guard(idle_lock_);
+            while (n < count && n < INJECT_BATCH && !idle_.empty())
+            {
+                woken[n++] = workers_[idle_.back()].get();
+                idle_.pop_back();
+                idle_count_.fetch_sub(1);
+            }
+        }
+        if (n == 0)
+        {
+            return;
+        }
+        // 在锁外发出唤醒
+        for (size_t i = 0; i < n; ++i)
+        {
+            woken[i]->notified.store(1, std::memory_order_release);
+            futexWake(&woken[i]->notified, 1);
+        }
+        count -= n;
     }
-    cond_.notify_all();
 }
@@ -1,28 +1,80 @@
+// 工作窃取线程池
+//
+// 每个工作线程有自己的任务队列(WorkStealingDeque):
+// -> 工作线程上提交的任务放入自己队列的底部, 从底部取出, 不需要加锁
+// -> 其它线程(如事件循环)提交的任务按优先级放入全局的注入队列(环形数组), 工作线程本地队列为空时批量取回
+// -> 本地队列和注入队列都为空时, 从随机选择的工作线程队列的顶部窃取
+// -> 找不到任务时登记为空闲并在自己的futex上休眠, 提交任务时只在有空闲线程时取出并唤醒一个
+//
+// 注入队列按优先级(TaskPriority)分为几条通道, 按权重平滑加权轮询取出, 低优先级的任务不会饿死:
+// -> 一批任务中可以有多个INTERACTIVE任务, BULK/BACKGROUND任务每批最多一个并且放在最后,
+//    长时间运行的任务不会堵在本地队列中小任务的前面, 空闲的线程会先窃取它
+// -> 工作线程上提交的INTERACTIVE任务放入本地队列, 其它优先级的任务同样进入注入队列参与调度
+//
+// 带有TaskGuard的任务在从注入队列取出时和执行之前检查, 已经取消或者过期的任务直接丢弃并计数
+//
+// 任务(Task)保存在内联存储中, 本地队列中的任务节点由工作线程回收复用, 稳定运行时提交任务不分配内存
+//
+// 线程数在[min_threads, max_threads]之间伸缩:
+// -> 没有空闲线程并且注入队列中最早的任务等待超过GROW_WAIT时增加一个线程(提交者和工作线程都会检查)
+// -> 工作线程空闲超过IDLE_TIMEOUT并且线程数多于min_threads时退出
+// 析构或者shutdown()时等待所有工作线程退出
+//
+// -> ThreadPool pool(2, 16);
+// -> pool.addTask([]{ ... });
+// -> pool.addTasks(tasks, count);      // 一次加锁提交多个任务, 按任务数唤醒空闲线程
+// -> pool.addTask([]{ ... }, TaskPriority::BULK);
+
 #ifndef HTTPSERVER_POOL_THREAD_POOL_H
 #define HTTPSERVER_POOL_THREAD_POOL_H
 
+#include <pool/Task.h>
+#include <pool/WorkStealingDeque.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <condition_variable>
-#include <queue>
-#include <functional>
 #include <thread>
+#include <utility>
+#include <vector>
 
-class ThreadPool
+// 任务的优先级, 每个优先级有自己的注入队列
+enum class TaskPriority
+{
+    INTERACTIVE = 0,    // 对延迟敏感的短任务, 如解析请求, 发送小响应
+    BULK,               // 长时间占用线程的任务, 如发送大文件
+    BACKGROUND,         // 可以推迟的后台任务
+};
+
+constexpr size_t TASK_PRIORITIES = 3;
+
+// 线程池的运行状态, 用来确定合适的线程数
+struct ThreadPoolStats
 {
+    size_t threads;         // 当前的工作线程数
+    size_t idle;            // 其中空闲的线程数
+    size_t queued;          // 注入队列中等待的任务数
+    uint64_t grown;         // 累计增加线程的次数
+    uint64_t shrunk;        // 累计空闲退出的线程数
+    uint64_t max_wait_us;   // 观察到的注入队列最长等待时间(微秒)
+    uint64_t cancelled;     // 累计丢弃的已取消任务数
+    uint64_t expired;       // 累计丢弃的过期任务数
+};
 
+class ThreadPool
+{
 public:
+    // 固定线程数
     explicit ThreadPool(int threads_num)
-    : isRunning_(true),
-      lock_(),
-      cond_(),
-      task_queue_()
-    {
-        for (int i = 0; i < threads_num; ++i)
-        {
-            std::thread t(&ThreadPool::threadFunc, this);
-            t.detach();
-        }
-    }
+      : ThreadPool(threads_num, threads_num)
+    {}
+
+    // 线程数在[min_threads, max_threads]之间伸缩, 启动时创建min_threads个线程
+    // 空闲超过idle_timeout的线程退出, 至少保留一个线程
+    ThreadPool(int min_threads, int max_threads, std::chrono::milliseconds idle_timeout = IDLE_TIMEOUT);
 
     ThreadPool(const ThreadPool &) = delete;
 
@@ -32,26 +84,173 @@ public:
 
     ThreadPool &operator=(ThreadPool &&) = delete;
 
-    ~ThreadPool();
+    ~ThreadPool()
+    {
+        shutdown();
+    }
 
-    template <typename Task>
-    void addTask(Task &&task)
+public:
+    // 提交任务, 在本线程池的工作线程上调用时放入该线程自己的队列
+    template <typename F>
+    void addTask(F &&task, TaskPriority priority = TaskPriority::INTERACTIVE)
     {
-        {
-            std::unique_lock<std::mutex> guard(lock_);
-            task_queue_.emplace(std::forward<Task>(task));
-        }
-        cond_.notify_one();
+        Task t(std::forward<F>(task));
+        addTasks(&t, 1, priority);
     }
 
-    void threadFunc();
+    // 提交tasks[0, count)中的任务(移出), 非工作线程只加一次锁, 最多唤醒count个空闲线程
+    void addTasks(Task *tasks, size_t count, TaskPriority priority = TaskPriority::INTERACTIVE);
+
+    // 通知所有工作线程退出并等待, 没有执行的任务被丢弃, 之后提交的任务也被丢弃
+    // 在任务引用的对象销毁之前调用
+    void shutdown();
+
+    // 当前的工作线程数
+    size_t size() const { return active_.load(std::memory_order_relaxed); }
+
+    size_t minThreads() const { return min_threads_; }
+
+    size_t maxThreads() const { return workers_.size(); }
+
+    ThreadPoolStats stats() const;
+
+public:
+    static constexpr size_t INJECT_BATCH = 32;          // 工作线程从注入队列一次最多取回的任务数
+    static constexpr size_t INJECT_CAPACITY = 1024;     // 每条注入队列的初始容量, 满时翻倍
+    static constexpr int LANE_WEIGHTS[TASK_PRIORITIES] = {8, 2, 1};     // 各优先级被取出的任务数之比
+    static constexpr size_t NODE_CHUNK = 256;           // 工作线程每次分配的任务节点数
+
+    static constexpr std::chrono::microseconds GROW_WAIT{2000};         // 任务等待超过2ms并且没有空闲线程时扩容
+    static constexpr std::chrono::milliseconds GROW_INTERVAL{10};       // 两次扩容的最小间隔, 避免突发时一次创建过多线程
+    static constexpr std::chrono::seconds IDLE_TIMEOUT{30};             // 空闲超过30s的线程退出
 
 private:
+    struct Worker;
+
+    // 本地队列中的任务, 由分配它的工作线程回收
+    struct TaskNode
+    {
+        Task task;
+        Worker *owner;
+        TaskNode *next;     // 空闲链表
+    };
+
+    // 注入队列中的任务以及提交的时间
+    struct InjectedTask
+    {
+        Task task;
+        int64_t enqueue_ns = 0;
+    };
+
+    // 一个优先级的注入队列: 环形数组, 容量为2的幂
+    struct Lane
+    {
+        std::vector<InjectedTask> tasks;
+        size_t head = 0;
+        size_t size = 0;
+        int credit = 0;     // 平滑加权轮询的当前权重
+    };
+
+    // 工作线程的槽位, 按max_threads预先创建, 线程退出后槽位(以及队列和任务节点)留给之后的线程
+    struct alignas(64) Worker
+    {
+        WorkStealingDeque<TaskNode> deque;
+        std::atomic<uint32_t> notified{0};              // futex: 被唤醒后置为1
+
+        TaskNode *free_nodes = nullptr;                 // 只有所属线程访问
+        std::atomic<TaskNode *> remote_free{nullptr};   // 其它线程执行完归还的节点(无锁栈)
+        std::vector<std::unique_ptr<TaskNode[]>> chunks;
+
+        std::thread thread;                             // 在scale_lock_下修改
+        bool running = false;                           // 在scale_lock_下修改
+    };
+
+    void threadFunc(size_t index);
+
+    static int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 注入队列中最早的任务等待了wait_ns, 需要时增加一个线程
+    void checkGrow(int64_t wait_ns, int64_t now_ns);
+
+    // 在空闲的槽位上启动工作线程, 需要持有scale_lock_
+    bool startWorker();
+
+    // 空闲超时的线程尝试退出, 线程数不能少于min_threads, 返回是否应该退出
+    bool retire(size_t index);
+
+    // 把任务放入工作线程自己的队列
+    void pushLocal(size_t index, Task &&task);
+
+    // 依次从本地队列, 注入队列, 其它工作线程获取任务
+    TaskNode *findTask(size_t index);
+
+    // 从注入队列取回一批任务, 返回其中一个, 其余放入本地队列
+    TaskNode *takeInjected(size_t index);
+
+    // * 持有inject_lock_调用
+    // 按权重选择下一个取出任务的非空队列, 所有队列都为空时不能调用
+    size_t pickLane();
+
+    // * 持有inject_lock_调用
+    // 注入队列中最早的任务的提交时间, 都为空时返回0
+    int64_t oldestInjected() const;
+
+    // 任务已经取消或者过期时计数并返回true, 需要时读取当前时间并保存到now_ns(0表示还没有读取)
+    bool discard(const Task &task, int64_t &now_ns);
+
+    // 从随机位置开始尝试窃取每个工作线程的任务
+    TaskNode *steal(size_t index);
+
+    // * 所属工作线程调用
+    TaskNode *allocNode(Worker &worker);
+
+    // 执行完的节点归还给分配它的工作线程
+    void releaseNode(TaskNode *p_node);
+
+    // 是否有任务可以执行(估计值)
+    bool hasWork() const;
+
+    // 没有任务时休眠, 直到有新的任务或者线程池关闭
+    // 空闲超时并且可以退出时返回false
+    bool park(size_t index);
+
+    // 从空闲列表中移除, 已经被唤醒者取出时返回false
+    bool removeIdle(size_t index);
+
+    // 唤醒最多count个空闲的工作线程
+    void notify(size_t count);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t min_threads_;
+    std::chrono::milliseconds idle_timeout_;
+
+    std::mutex scale_lock_;                 // 启动/退出线程
+    std::atomic<size_t> active_;            // 运行中的工作线程数
+    std::atomic<int64_t> last_grow_ns_;
+    std::atomic<uint64_t> grown_;
+    std::atomic<uint64_t> shrunk_;
+    std::atomic<int64_t> max_wait_ns_;
+    std::atomic<uint64_t> cancelled_;
+    std::atomic<uint64_t> expired_;
+
+    // 注入队列: 每个优先级一条
+    std::mutex inject_lock_;
+    Lane lanes_[TASK_PRIORITIES];
+    size_t inject_size_;                    // 所有注入队列中的任务数
+    std::atomic<size_t> injected_count_;   // 不加锁检查注入队列是否为空
+
+    std::atomic<bool> running_;
 
-    bool isRunning_;   // 是否运行
-    std::mutex lock_;  // 互斥量
-    std::condition_variable cond_;  // 条件变量
-    std::queue<std::function<void()>> task_queue_;  // 任务队列
+    // 休眠/唤醒: 工作线程先登记到空闲列表, 再次确认没有任务后在自己的notified上futex_wait
+    // 提交任务后检查idle_count_, 有空闲线程时取出并唤醒, 每次唤醒对应一个确实在休眠的线程
+    std::mutex idle_lock_;
+    std::vector<size_t> idle_;              // 空闲的工作线程序号
+    alignas(64) std::atomic<size_t> idle_count_;
 };
 
 #endif
@@ -0,0 +1,161 @@
+// 工作窃取双端队列(Chase-Lev), 保存指向任务的指针
+//
+// 只有所属的线程在底部push()/pop(), 其它线程可以同时从顶部steal()
+// 参考: Lê, Pop, Cohen, Zappa Nardelli. Correct and Efficient Work-Stealing for Weak Memory Models. PPoPP 2013
+//
+// -> deque.push(p_task);           // 所属线程
+// -> T *p_task = deque.pop();      // 所属线程, 后进先出
+// -> T *p_task = deque.steal();    // 任意线程, 先进先出, 与其它线程竞争失败时返回nullptr
+
+#ifndef HTTPSERVER_POOL_WORK_STEALING_DEQUE_H
+#define HTTPSERVER_POOL_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+template <typename T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = INITIAL_CAPACITY)
+      : top_(0),
+        bottom_(0),
+        array_(),
+        retired_()
+    {
+        retired_.emplace_back(new Array(capacity));
+        array_.store(retired_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+
+    WorkStealingDeque(WorkStealingDeque &&) = delete;
+
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    WorkStealingDeque &operator=(WorkStealingDeque &&) = delete;
+
+    ~WorkStealingDeque() = default;
+
+public:
+    // * 所属线程调用
+    // 放入底部, 数组满时扩容
+    void push(T *item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array *array = array_.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(array->capacity) - 1)
+        {
+            array = grow(array, t, b);
+        }
+        array->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // * 所属线程调用
+    // 从底部取出, 为空时返回nullptr
+    T *pop()
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *array = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            // 已经为空
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = array->get(b);
+        if (t == b)
+        {
+            // 最后一个元素, 与窃取的线程竞争
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // * 任意线程调用
+    // 从顶部窃取, 为空或者竞争失败时返回nullptr
+    T *steal()
+    {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+        Array *array = array_.load(std::memory_order_acquire);
+        T *item = array->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // 元素数目的估计值, 其它线程同时修改时可能不准确
+    size_t size() const
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+public:
+    static constexpr size_t INITIAL_CAPACITY = 256;
+
+private:
+    // 容量为2的幂的环形数组, 下标对容量取模
+    struct Array
+    {
+        explicit Array(size_t capacity)
+          : capacity(capacity),
+            mask(capacity - 1),
+            items(new std::atomic<T *>[capacity])
+        {}
+
+        T *get(int64_t idx) const { return items[idx & mask].load(std::memory_order_relaxed); }
+
+        void put(int64_t idx, T *item) { items[idx & mask].store(item, std::memory_order_relaxed); }
+
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<std::atomic<T *>[]> items;
+    };
+
+    // 容量翻倍, 旧数组可能仍在被窃取的线程读取, 保留到队列销毁
+    Array *grow(Array *array, int64_t t, int64_t b)
+    {
+        retired_.emplace_back(new Array(array->capacity * 2));
+        Array *bigger = retired_.back().get();
+        for (int64_t i = t; i < b; ++i)
+        {
+            bigger->put(i, array->get(i));
+        }
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    // 窃取的线程修改top_, 所属线程修改bottom_, 放在不同的缓存行避免伪共享
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    std::atomic<Array *> array_;
+    std::vector<std::unique_ptr<Array>> retired_;   // 所有分配过的数组, 只有所属线程修改
+};
+
+#endif
@@ -1,7 +1,18 @@
 #include "Epoller.h"
 
+#include <sys/timerfd.h>
+
 #include <cassert>
 
+Epoller::Epoller(int max_ep_events)
+  : epfd_(::epoll_create1(0)),
+    timer_fd_(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    timer_expire_ms_(-1),
+    ep_events_ret_(1024)
+{
+    addFd(timer_fd_, EPOLLIN);
+}
+
 bool Epoller::addFd(int fd, uint32_t events)
 {
     struct epoll_event ep_event = {0};
@@ -46,3 +57,32 @@ uint32_t Epoller::getEventsOf(int idx) const
     assert(idx >= 0 && idx <= ep_events_ret_.size());
     return ep_events_ret_[idx].events;
 }
+
+bool Epoller::setTimer(int64_t expire_ms)
+{
+    if (expire_ms == timer_expire_ms_)
+    {
+        return true;
+    }
+    // 绝对时间, 已经过去的时间立即到期; 全为0时停止定时器(开机后的单调时间不会是0)
+    struct itimerspec spec = {};
+    if (expire_ms >= 0)
+    {
+        spec.it_value.tv_sec = expire_ms / 1000;
+        spec.it_value.tv_nsec = (expire_ms % 1000) * 1000000;
+    }
+    if (::timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0)
+    {
+        return false;
+    }
+    timer_expire_ms_ = expire_ms;
+    return true;
+}
+
+void Epoller::clearTimer()
+{
+    uint64_t expirations;
+    ssize_t ret = ::read(timer_fd_, &expirations, sizeof(expirations));
+    (void)ret;
+    timer_expire_ms_ = -1;
+}
@@ -1,18 +1,24 @@
+// epoll实例以及一个CLOCK_MONOTONIC的timerfd
+// timerfd在构造时注册到epoll, 定时器到期时wait()返回它的可读事件, 事件循环不再依赖epoll_wait(2)的超时
+// -> epoller.setTimer(wheel.nextExpireMs());
+// -> int n = epoller.wait(-1);
+// -> if (epoller.getFdOf(i) == epoller.timerFd()) { epoller.clearTimer(); wheel.checkAndHandleTimer(); }
+
 #ifndef HTTPSERVER_SERVER_EPOLLER_H
 #define HTTPSERVER_SERVER_EPOLLER_H
 
 #include <sys/epoll.h>
 #include <unistd.h>
 
+#include <cstdint>
+
 #include <vector>
 #include <mutex>
 
 class Epoller
 {
 public:
-    explicit Epoller(int max_ep_events = 1024)
-      : epfd_(::epoll_create1(0)),
-        ep_events_ret_(1024) {}
+    explicit Epoller(int max_ep_events = 1024);
 
     Epoller(const Epoller &) = delete;
 
@@ -24,6 +30,7 @@ public:
 
     ~Epoller()
     {
+        ::close(timer_fd_);
         ::close(epfd_);
     }
 
@@ -40,8 +47,22 @@ public:
 
     uint32_t getEventsOf(int idx) const;
 
+    // 一次wait()最多返回的事件数
+    size_t maxEvents() const { return ep_events_ret_.size(); }
+
+    int timerFd() const { return timer_fd_; }
+
+    // 在CLOCK_MONOTONIC的expire_ms(毫秒)时让timerFd()可读, 小于0时停止
+    // 与当前设置的时间相同时不调用timerfd_settime(2)
+    bool setTimer(int64_t expire_ms);
+
+    // 读出timerfd的到期次数, 之后需要重新setTimer()
+    void clearTimer();
+
 private:
     int epfd_;
+    int timer_fd_;
+    int64_t timer_expire_ms_;   // 当前设置的到期时间, -1表示没有设置
 
     std::vector<struct epoll_event> ep_events_ret_;
 };
@@ -4,10 +4,12 @@
 
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <signal.h>
 
+#include <chrono>
 #include <cstring>
 #include <string>
 
@@ -19,17 +21,46 @@ using std::string;
 using std::mutex;
 using std::lock_guard;
 
+namespace
+{
+
+int reload_event_fd = -1;   // 信号处理函数只能调用异步信号安全的函数, 通过eventfd通知事件循环
+
+void onSighup(int)
+{
+    int saved_errno = errno;
+    uint64_t one = 1;
+    ssize_t ret = ::write(reload_event_fd, &one, sizeof(one));
+    (void)ret;
+    errno = saved_errno;
+}
+
+}
+
 Server::Server(uint16_t port,
-               int threads_num,
+               int min_threads, int max_threads,
+               int max_disk_threads,
                bool open_log, LogLevel filter_level, const std::string &log_path,
-               const std::string &log_suffix, int file_max_line, int block_queue_size)
+               const std::string &log_suffix, int file_max_line, int block_queue_size,
+               LogFormat log_format)
   : is_running_(false),
     port_(port),
     listen_sock_(-1),
+    https_listen_sock_(-1),
+    p_tls_ctx_(),
+    zerocopy_threshold_(0),
+    reload_fd_(-1),
+    snapshot_path_(),
+    snapshot_options_(),
+    timeouts_(),
+    p_conn_pool_(make_shared<HttpConnPool>(MAX_POOLED_HTTP_CONNS)),
     sock_to_http_(),
-    p_thread_pool_(new ThreadPool(threads_num)),
+    conn_slots_(new ConnSlot[CONN_SLOTS]),
+    p_thread_pool_(new ThreadPool(min_threads, max_threads)),
+    ready_tasks_(),
+    p_disk_pool_(new ThreadPool(1, max_disk_threads)),
     p_epoller_(new Epoller),
-    timer_manager_(),
+    timing_wheel_(),
     listen_epoll_events_(0),
     conn_epoll_events_(0),
     lock_()
@@ -37,13 +68,17 @@ Server::Server(uint16_t port,
     // 是否开启日志
     if (open_log)
     {
-        AsyncLogger::getInstance().init(filter_level, log_path, log_suffix, file_max_line, block_queue_size);
+        AsyncLogger::getInstance().init(filter_level, log_path, log_suffix, file_max_line, block_queue_size, log_format);
     }
 
     LOG_INFO("====================Server Init===================");
 
     // 设置额外需要监视的事件
     initSocketEvents();
+    for (auto &tasks : ready_tasks_)
+    {
+        tasks.reserve(p_epoller_->maxEvents());
+    }
 
     LOG_INFO("socket events inited");
 
@@ -57,19 +92,92 @@ Server::Server(uint16_t port,
 
 Server::~Server()
 {
+    // 先等待工作线程退出, 之后不会再有任务访问连接, epoller等成员
+    // I/O线程会向磁盘线程提交任务, 按这个顺序关闭
+    p_thread_pool_->shutdown();
+    p_disk_pool_->shutdown();
+    // 连接的关闭回调使用epoller, 时间轮和conn_slots_, 它们在sock_to_http_之后声明, 会先析构
+    // 在这里关闭剩余的连接
+    sock_to_http_.clear();
     LOG_INFO("server closed");
     ::close(listen_sock_);
+    if (https_listen_sock_ >= 0)
+    {
+        ::close(https_listen_sock_);
+    }
+    if (reload_fd_ >= 0)
+    {
+        ::signal(SIGHUP, SIG_DFL);
+        ::close(reload_fd_);
+    }
     is_running_ = false;
 }
 
+bool Server::listenHttps(uint16_t port, const std::string &cert_file, const std::string &key_file)
+{
+    std::unique_ptr<TlsContext> p_tls_ctx(new TlsContext);
+    if (!p_tls_ctx->init(cert_file, key_file))
+    {
+        LOG_ERROR("https disabled: can not load certificate %s", cert_file.data());
+        return false;
+    }
+    int sock = createListenSock(port);
+    if (sock < 0)
+    {
+        return false;
+    }
+    p_tls_ctx_ = std::move(p_tls_ctx);
+    https_listen_sock_ = sock;
+    LOG_INFO("https listen socket create successfully, port: %d", port);
+    return true;
+}
+
+bool Server::useSnapshot(const std::string &path, const SnapshotOptions &options)
+{
+    auto snapshot = Snapshot::open(path, options);
+    if (!snapshot)
+    {
+        LOG_ERROR("snapshot disabled, serve resources directory");
+        return false;
+    }
+    HttpConn::setSnapshot(std::move(snapshot));
+    snapshot_path_ = path;
+    snapshot_options_ = options;
+    if (reload_fd_ >= 0)
+    {
+        return true;
+    }
+    // 收到SIGHUP时重新加载快照
+    reload_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reload_fd_ < 0 || !p_epoller_->addFd(reload_fd_, EPOLLIN))
+    {
+        LOG_ERROR("snapshot reload disabled: %s", strerror(errno));
+        return true;
+    }
+    reload_event_fd = reload_fd_;
+    struct sigaction act;
+    std::memset(&act, 0, sizeof(act));
+    act.sa_handler = onSighup;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    if (sigaction(SIGHUP, &act, nullptr) < 0)
+    {
+        LOG_ERROR("sigaction(): %s", strerror(errno));
+    }
+    return true;
+}
+
 void Server::run()
 {
     LOG_INFO("server is running");
+    timing_wheel_.add(REPORT_STATS_SECONDS * 1000, [this](){
+        reportStats();
+    }, REPORT_STATS_SECONDS * 1000);
     while (is_running_)
     {
-        // 获取即将过期定时器的剩余时间
-        int timeout_ms = timer_manager_.millisecondsToNextExpired();
-        int ret = p_epoller_->wait(timeout_ms);
+        // 定时器到期时timerfd可读, 不需要epoll_wait(2)的超时
+        p_epoller_->setTimer(timing_wheel_.nextExpireMs());
+        int ret = p_epoller_->wait(-1);
         if (ret < 0)
         {
             if (errno == EINTR)
@@ -79,21 +187,39 @@ void Server::run()
             LOG_FATAL("server crashed: %s", strerror(errno));
             is_running_ = false;
         }
+        // 本轮事件刷新连接的定时器时都以现在为起点, 不再每次读取时钟
+        timing_wheel_.updateTime();
+        bool timer_expired = false;
         for (int i = 0; i < ret; ++i)
         {
             auto fd = p_epoller_->getFdOf(i);
             auto events = p_epoller_->getEventsOf(i);
 
+            if (fd == p_epoller_->timerFd())
+            {
+                // 处理完本轮的读写事件再执行定时器, 避免关闭之后还要处理的连接
+                p_epoller_->clearTimer();
+                timer_expired = true;
+                continue;
+            }
+
             // 监听socket可读
             if (fd == listen_sock_)
             {
-                handleAccept();
+                handleAccept(listen_sock_, nullptr);
+            }
+            else if (fd == https_listen_sock_)
+            {
+                handleAccept(https_listen_sock_, p_tls_ctx_->get());
+            }
+            else if (fd == reload_fd_)
+            {
+                handleReload();
             }
-            // 连接socket出错
+            // 连接socket出错或者有零拷贝完成通知
             else if(events & EPOLLERR || events & EPOLLRDHUP || events & EPOLLHUP)
             {
-                // 关闭HTTP连接
-                closeHttpConn(fd);
+                handleError(fd, events);
             }
             else if(events & EPOLLIN)
             {
@@ -104,8 +230,17 @@ void Server::run()
                 handleWrite(fd);
             }
         }
-        // 检查并处理过期的定时器
-        timer_manager_.checkAndHandleTimer();
+        // 每个优先级一次加锁提交所有就绪连接的任务, 按任务数唤醒空闲的工作线程
+        for (size_t i = 0; i < TASK_PRIORITIES; ++i)
+        {
+            p_thread_pool_->addTasks(ready_tasks_[i].data(), ready_tasks_[i].size(), static_cast<TaskPriority>(i));
+            ready_tasks_[i].clear();
+        }
+        // 处理过期的定时器
+        if (timer_expired)
+        {
+            timing_wheel_.checkAndHandleTimer();
+        }
     }
 }
 
@@ -116,59 +251,71 @@ void Server::initSocketEvents()
 }
 
 bool Server::initListenSock()
+{
+    listen_sock_ = createListenSock(port_);
+    return listen_sock_ >= 0;
+}
+
+int Server::createListenSock(uint16_t port)
 {
     // 创建socket
-    listen_sock_ = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_sock_ < 0)
+    int listen_sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_sock < 0)
     {
-        return false;
+        return -1;
     }
 
     // 绑定地址
     struct sockaddr_in server_addr = {0};
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
-    server_addr.sin_port = ::htons(port_);
+    server_addr.sin_port = ::htons(port);
 
     // 开启重用地址选项, 用来快速重启服务器
     int optval = 1;
-    int ret = ::setsockopt(listen_sock_, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    int ret = ::setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
     if (ret < 0)
     {
         std::perror("::setsockopt()");
-        return false;
+        ::close(listen_sock);
+        return -1;
     }
 
-    if (::bind(listen_sock_, 
+    if (::bind(listen_sock, 
                reinterpret_cast<struct sockaddr*>(&server_addr),
                sizeof(server_addr)) < 0)
     {
         std::perror("::bind()");
-        return false;
+        ::close(listen_sock);
+        return -1;
     }
 
     // 转换成监听socket
-    if (::listen(listen_sock_, 5) < 0)
+    if (::listen(listen_sock, 5) < 0)
     {
         std::perror("::listen()");
-        return false;
+        ::close(listen_sock);
+        return -1;
     }
 
     // 通过 epoll 监视监听socket是否可读
-    if (!p_epoller_->addFd(listen_sock_, listen_epoll_events_ | EPOLLIN))
+    if (!p_epoller_->addFd(listen_sock, listen_epoll_events_ | EPOLLIN))
     {
         std::perror("Epoller::addFd()");
-        return false;
+        ::close(listen_sock);
+        return -1;
     }
 
     // 设置监听socket为非阻塞模式
-    if (!setNonBlocking(listen_sock_))
+    if (!setNonBlocking(listen_sock))
     {
         std::perror("Server::setNonBlocking()");
-        return false;
+        p_epoller_->delFd(listen_sock);
+        ::close(listen_sock);
+        return -1;
     }
 
-    return true;
+    return listen_sock;
 }
 
 bool Server::initSignalHandler()
@@ -184,14 +331,31 @@ bool Server::initSignalHandler()
     return true;
 }
 
+void Server::handleReload()
+{
+    uint64_t count;
+    while (::read(reload_fd_, &count, sizeof(count)) > 0)
+    {
+    }
+    // 新快照映射完成后再替换, 替换之前生成的响应继续引用旧快照
+    auto snapshot = Snapshot::open(snapshot_path_, snapshot_options_);
+    if (!snapshot)
+    {
+        LOG_ERROR("reload snapshot %s failed, keep serving the old one", snapshot_path_.data());
+        return;
+    }
+    HttpConn::setSnapshot(std::move(snapshot));
+    LOG_INFO("snapshot %s reloaded", snapshot_path_.data());
+}
+
 // 处理监听socket的可读事件
-void Server::handleAccept()
+void Server::handleAccept(int listen_sock, SSL_CTX *tls_ctx)
 {
     do
     {
         struct sockaddr_in client_addr;
         socklen_t addrlen = sizeof(client_addr);
-        int conn_sock = ::accept(listen_sock_, (struct sockaddr *)&client_addr, &addrlen);
+        int conn_sock = ::accept(listen_sock, (struct sockaddr *)&client_addr, &addrlen);
 
         if (conn_sock < 0)
         {
@@ -199,33 +363,129 @@ void Server::handleAccept()
             return;
         }
         // todo: 返回的错误信息不是http报文, 不够友好
-        if (sock_to_http_.size() >= MAX_NUMBER_HTTP_CONNS)
+        if (sock_to_http_.size() >= MAX_NUMBER_HTTP_CONNS || conn_sock >= CONN_SLOTS)
         {
-            LOG_DEBUG("to many clients: %d", sock_to_http_.size());
+            LOG_DEBUG("to many clients: %zu", sock_to_http_.size());
             sendError(conn_sock, "http server busy!\n");
             return;
         }
-        addHttpConn(conn_sock, client_addr);
+        addHttpConn(conn_sock, client_addr, tls_ctx);
     } while (listen_epoll_events_ & EPOLLET);
 }
 
 
 void Server::handleRead(int sock)
 {
-    extentTime(sock);
+    // TLS会话发送响应时在等待可读, 交给写任务继续发送
+    if (sock_to_http_.at(sock)->responding())
+    {
+        handleWrite(sock);
+        return;
+    }
+    // 读请求报文的时间从第一个数据到达开始计算, 之后不刷新, 慢速发送请求的客户端不能一直占用连接
+    if (conn_slots_[sock].phase != ConnPhase::READING)
+    {
+        enterPhase(sock, ConnPhase::READING);
+    }
     auto wp_conn = weak_ptr<HttpConn>(sock_to_http_.at(sock));
-    p_thread_pool_->addTask([this, wp_conn](){
+    ready_tasks_[static_cast<size_t>(TaskPriority::INTERACTIVE)].emplace_back([this, wp_conn](){
         onRead(wp_conn);
-    });
+    }, connGuard(sock, timeouts_.read_ms));
 }
 
 void Server::handleWrite(int sock)
 {
-    extentTime(sock);
-    auto wp_conn = weak_ptr<HttpConn>(sock_to_http_.at(sock));
-    p_thread_pool_->addTask([this, wp_conn](){
+    // TLS会话读取请求时在等待可写, 交给读任务继续读取; 握手由写任务转交给读任务
+    auto &p_conn = sock_to_http_.at(sock);
+    if (!p_conn->responding() && !p_conn->handshaking())
+    {
+        handleRead(sock);
+        return;
+    }
+    // 每次可写说明客户端接收了数据, 发送停滞的时间重新计算(惰性刷新, 不移动定时器)
+    if (conn_slots_[sock].phase != ConnPhase::WRITING)
+    {
+        enterPhase(sock, ConnPhase::WRITING);
+    }
+    else
+    {
+        timing_wheel_.refresh(conn_slots_[sock].phase_timer);
+    }
+    auto wp_conn = weak_ptr<HttpConn>(p_conn);
+    // EPOLLONESHOT: 事件触发后没有工作线程在处理该连接, 可以读取响应的状态
+    ready_tasks_[static_cast<size_t>(writePriority(*p_conn))].emplace_back([this, wp_conn](){
         onWrite(wp_conn);
-    });
+    }, connGuard(sock, timeouts_.write_stall_ms));
+}
+
+void Server::handleError(int sock, uint32_t events)
+{
+    auto it = sock_to_http_.find(sock);
+    if (events & (EPOLLRDHUP | EPOLLHUP) || it == sock_to_http_.end() ||
+        !it->second->zeroCopyEnabled() || !it->second->reapZeroCopy())
+    {
+        // 关闭HTTP连接
+        closeHttpConn(sock);
+        return;
+    }
+    // EPOLLONESHOT: 触发后不会有工作线程持有该连接, 可以直接在事件处理线程上释放数据和重新注册事件
+    auto p_conn = it->second;
+    if (p_conn->lingering())
+    {
+        if (!p_conn->zeroCopyPending())
+        {
+            closeHttpConn(sock);
+        }
+        else
+        {
+            p_epoller_->modFd(sock, conn_epoll_events_);
+        }
+    }
+    else if (events & EPOLLIN)
+    {
+        handleRead(sock);
+    }
+    else if (events & EPOLLOUT)
+    {
+        handleWrite(sock);
+    }
+    else
+    {
+        // 恢复触发之前监视的事件
+        p_epoller_->modFd(sock, conn_epoll_events_ | (p_conn->responding() ? waitEvent(*p_conn, EPOLLOUT)
+                                                                            : waitEvent(*p_conn, EPOLLIN)));
+    }
+}
+
+void Server::reportStats()
+{
+    LOG_INFO("stats: %zu clients", sock_to_http_.size());
+    // 线程数长期接近上限或者等待时间长说明需要更多资源, 长期远低于上限说明配置过多
+    auto log_pool = [](const char *name, const ThreadPool &pool) {
+        ThreadPoolStats stats = pool.stats();
+        LOG_INFO("stats: %s threads:%zu/[%zu, %zu] idle:%zu queued:%zu grown:%lu shrunk:%lu max_wait_us:%lu "
+                 "cancelled:%lu expired:%lu",
+                 name, stats.threads, pool.minThreads(), pool.maxThreads(), stats.idle, stats.queued,
+                 stats.grown, stats.shrunk, stats.max_wait_us, stats.cancelled, stats.expired);
+    };
+    log_pool("io pool", *p_thread_pool_);
+    log_pool("disk pool", *p_disk_pool_);
+    if (zerocopy_threshold_ > 0)
+    {
+        // copied占completions的比例高时零拷贝并不划算(如回环设备, 不支持分散聚集的网卡)
+        LOG_INFO("stats: zerocopy sends:%lu bytes:%lu completions:%lu copied:%lu fallbacks:%lu",
+                 ZeroCopyStats::sends.load(), ZeroCopyStats::bytes.load(),
+                 ZeroCopyStats::completions.load(), ZeroCopyStats::copied.load(),
+                 ZeroCopyStats::fallbacks.load());
+    }
+    // 写日志跟不上时丢弃的日志, 丢弃的条数也由日志线程写入日志
+    LogDropStats drops = AsyncLogger::getInstance().dropStats();
+    if (drops.total() > 0)
+    {
+        LOG_INFO("stats: log dropped:%lu debug:%lu info:%lu warn:%lu error:%lu fatal:%lu",
+                 drops.total(), drops.dropped[0], drops.dropped[1], drops.dropped[2], drops.dropped[3],
+                 drops.dropped[4]);
+    }
 }
 
 void Server::onRead(weak_ptr<HttpConn> wp_conn)
@@ -233,6 +493,11 @@ void Server::onRead(weak_ptr<HttpConn> wp_conn)
     auto p_conn = wp_conn.lock();
     if (p_conn)
     {
+        // HTTPS连接先完成TLS握手, 握手完成后客户端可能已经发送了请求, 直接继续读取
+        if (p_conn->handshaking() && !continueHandshake(p_conn))
+        {
+            return;
+        }
         if (p_conn->processRequest())
         {
             LOG_DEBUG("request for client:%d has processed", p_conn->getSock());
@@ -243,7 +508,7 @@ void Server::onRead(weak_ptr<HttpConn> wp_conn)
         else
         {
             // 请求报文没有处理完, 重新注册 EPOLLIN 事件, 防止ET模式下不会再次触发
-            p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | EPOLLIN);
+            p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | waitEvent(*p_conn, EPOLLIN));
         }
     }
 }
@@ -253,39 +518,192 @@ void Server::onWrite(weak_ptr<HttpConn> wp_conn)
     auto p_conn = wp_conn.lock();
     if (p_conn)
     {
+        // TLS握手在等待可写, 交给读任务继续握手
+        if (p_conn->handshaking())
+        {
+            onRead(wp_conn);
+            return;
+        }
         if (p_conn->processResponse())
         {
             LOG_DEBUG("response for client:%d has processed", p_conn->getSock());
             if (p_conn->keepAlive())
             {
+                // 重新注册事件之前切换, 之后事件循环可能立即处理这个连接
+                enterPhase(p_conn->getSock(), ConnPhase::IDLE);
                 p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | EPOLLIN);
             }
+            else if (p_conn->zeroCopyPending())
+            {
+                // 零拷贝发送的数据还被内核引用, 等完成通知到达后再关闭, 只监视EPOLLERR
+                p_conn->setLingering();
+                p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_);
+            }
             else
             {
                 // 与事件处理线程发生条件竞争
                 closeHttpConn(p_conn->getSock());
             }
         }
+        else if (p_conn->waitingForDisk())
+        {
+            // 文件数据不在页缓存中, 交给磁盘线程读入, 工作线程不阻塞在缺页上
+            p_disk_pool_->addTask(Task([this, wp_conn](){
+                onDiskRead(wp_conn);
+            }, connGuard(p_conn->getSock(), timeouts_.write_stall_ms)), writePriority(*p_conn));
+        }
         else
+        {
+            p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | waitEvent(*p_conn, EPOLLOUT));
+        }
+    }
+}
+
+bool Server::continueHandshake(const shared_ptr<HttpConn> &p_conn)
+{
+    switch (p_conn->handshake())
+    {
+        case HandshakeState::DONE:
+        {
+            return true;
+        }
+        case HandshakeState::WANT_READ:
+        {
+            p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | EPOLLIN);
+            return false;
+        }
+        case HandshakeState::WANT_WRITE:
         {
             p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | EPOLLOUT);
+            return false;
+        }
+        default:
+        {
+            LOG_DEBUG("tls handshake with client:%d failed", p_conn->getSock());
+            closeHttpConn(p_conn->getSock());
+            return false;
         }
     }
 }
 
-void Server::addHttpConn(int conn_sock, const struct sockaddr_in &client_addr)
+void Server::onDiskRead(weak_ptr<HttpConn> wp_conn)
+{
+    auto p_conn = wp_conn.lock();
+    if (p_conn)
+    {
+        p_conn->loadResponseData();
+        LOG_DEBUG("file data for client:%d loaded", p_conn->getSock());
+        // 数据已经在页缓存中, 重新注册 EPOLLOUT 继续发送
+        p_epoller_->modFd(p_conn->getSock(), conn_epoll_events_ | EPOLLOUT);
+    }
+}
+
+TaskGuard Server::connGuard(int sock, int timeout_ms) const
+{
+    TaskGuard guard;
+    guard.p_generation = &conn_slots_[sock].generation;
+    guard.generation = conn_slots_[sock].generation.load(std::memory_order_relaxed);
+    // 到这个时间连接的阶段定时器一定已经到期, 任务即使执行也会和关闭连接竞争
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    guard.deadline_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    return guard;
+}
+
+void Server::enterPhase(int sock, ConnPhase phase)
+{
+    ConnSlot &slot = conn_slots_[sock];
+    switch (phase)
+    {
+        case ConnPhase::IDLE:
+        {
+            timing_wheel_.cancel(slot.request_timer);
+            slot.request_timer = 0;
+            timing_wheel_.reset(slot.phase_timer, timeouts_.keep_alive_ms);
+            break;
+        }
+        case ConnPhase::READING:
+        {
+            timing_wheel_.reset(slot.phase_timer, timeouts_.read_ms);
+            if (timeouts_.request_ms > 0 && slot.request_timer == 0)
+            {
+                uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+                slot.request_timer = timing_wheel_.add(timeouts_.request_ms, [this, sock, generation](){
+                    closeExpired(sock, generation, "request");
+                });
+            }
+            break;
+        }
+        case ConnPhase::WRITING:
+        {
+            timing_wheel_.reset(slot.phase_timer, timeouts_.write_stall_ms);
+            break;
+        }
+    }
+    slot.phase = phase;
+}
+
+void Server::closeExpired(int sock, uint32_t generation, const char *reason)
+{
+    // 回调在锁外执行, 到期之后连接可能已经被工作线程关闭, socket也可能被新连接复用
+    if (conn_slots_[sock].generation.load(std::memory_order_relaxed) != generation)
+    {
+        return;
+    }
+    LOG_DEBUG("client:%d %s timeout", sock, reason);
+    closeHttpConn(sock);
+}
+
+uint32_t Server::waitEvent(const HttpConn &conn, uint32_t event)
+{
+    switch (conn.tlsWaiting())
+    {
+        case HandshakeState::WANT_READ:
+        {
+            return EPOLLIN;
+        }
+        case HandshakeState::WANT_WRITE:
+        {
+            return EPOLLOUT;
+        }
+        default:
+        {
+            return event;
+        }
+    }
+}
+
+TaskPriority Server::writePriority(const HttpConn &conn)
+{
+    return conn.pendingBytes() >= BULK_RESPONSE_BYTES ? TaskPriority::BULK : TaskPriority::INTERACTIVE;
+}
+
+void Server::addHttpConn(int conn_sock, const struct sockaddr_in &client_addr, SSL_CTX *tls_ctx)
 {
     LOG_DEBUG("add client, sockfd: %d", conn_sock);
-    timer_manager_.add(conn_sock, ::time(nullptr) + CHECK_CONN_TIME_SLOT_SECONDS,
-                       [this, conn_sock](){
-                           closeHttpConn(conn_sock);
-                       });
-    sock_to_http_.emplace(conn_sock, make_shared<HttpConn>(conn_sock, client_addr, conn_epoll_events_ & EPOLLET));
+    // 新连接等待第一个请求, 与持久连接等待下一个请求使用相同的超时
+    ConnSlot &slot = conn_slots_[conn_sock];
+    uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+    slot.phase = ConnPhase::IDLE;
+    slot.request_timer = 0;
+    slot.phase_timer = timing_wheel_.add(timeouts_.keep_alive_ms, [this, conn_sock, generation](){
+        closeExpired(conn_sock, generation, "idle/read/write");
+    });
+    sock_to_http_.emplace(conn_sock, p_conn_pool_->acquire(conn_sock, client_addr, conn_epoll_events_ & EPOLLET, tls_ctx));
     sock_to_http_.at(conn_sock)->registerCloseCallBack([this, conn_sock](){
+        // 最后一个引用释放时没有其它线程访问连接状态, socket关闭之前不会被新连接复用
+        ConnSlot &slot = conn_slots_[conn_sock];
         p_epoller_->delFd(conn_sock);
-        timer_manager_.cancel(conn_sock);
+        timing_wheel_.cancel(slot.phase_timer);
+        timing_wheel_.cancel(slot.request_timer);
         ::close(conn_sock);
     });
+    // 零拷贝只用于明文连接, 用户态TLS发送的是加密后的副本
+    int optval = 1;
+    if (zerocopy_threshold_ > 0 && !tls_ctx &&
+        ::setsockopt(conn_sock, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) == 0)
+    {
+        sock_to_http_.at(conn_sock)->enableZeroCopy(zerocopy_threshold_);
+    }
     p_epoller_->addFd(conn_sock, EPOLLIN | conn_epoll_events_);
     setNonBlocking(conn_sock);
 }
@@ -294,6 +712,8 @@ void Server::closeHttpConn(int sock)
 {
     lock_guard<mutex> guard(lock_);
     LOG_DEBUG("erase client:%d from container", sock);
+    // socket关闭之前递增, 复用这个socket的新连接不会和旧连接的任务以及定时器混淆
+    conn_slots_[sock].generation.fetch_add(1, std::memory_order_relaxed);
     sock_to_http_.erase(sock);
 }
 
@@ -303,12 +723,6 @@ void Server::sendError(int sock, const std::string &msg)
     ::close(sock);
 }
 
-void Server::extentTime(int sock)
-{
-    assert(sock_to_http_.count(sock) > 0);
-    timer_manager_.adjustTime(sock, ::time(nullptr) + CHECK_CONN_TIME_SLOT_SECONDS);
-}
-
 bool Server::setNonBlocking(int fd)
 {
     int old_fd_flags = ::fcntl(fd, F_GETFL);
@@ -4,23 +4,39 @@
 #include <pool/ThreadPool.h>
 #include <server/Epoller.h>
 #include <http/HttpConn.h>
-#include <timer/TimerManager.h>
+#include <http/HttpConnPool.h>
+#include <timer/TimingWheel.h>
 #include <logger/AsyncLogger.h>
+#include <tls/TlsContext.h>
+#include <snapshot/Snapshot.h>
 
+#include <atomic>
 #include <cstdint>
 #include <unordered_map>
 #include <vector>
 #include <memory>
 
+// 连接在各个阶段的超时时间(毫秒), 超时后关闭连接, 0表示不限制(keep_alive_ms, read_ms, write_stall_ms不能为0)
+struct ConnTimeouts
+{
+    int keep_alive_ms = 15000;      // 新连接或者持久连接等待下一个请求
+    int read_ms = 10000;            // 从收到请求(或者TLS握手)的第一个数据开始, 读完整个请求报文
+    int write_stall_ms = 10000;     // 发送响应时客户端持续没有接收数据
+    int request_ms = 300000;        // 一个请求从开始读取到响应发送完成
+};
+
 class Server
 {
 public:
     Server(uint16_t port,
-           // I/O线程池配置
-           int threads_num,
+           // I/O线程池的线程数范围, 根据任务等待时间和空闲时间伸缩
+           int min_threads, int max_threads,
+           // 读取冷文件数据的最大线程数
+           int max_disk_threads,
            // 日志配置
            bool open_log, LogLevel filter_level, const std::string &log_path,
-           const std::string &log_suffix, int file_max_line, int block_queue_size);
+           const std::string &log_suffix, int file_max_line, int block_queue_size,
+           LogFormat log_format = LogFormat::TEXT);
 
     Server(const Server &) = delete;
     Server(Server &&) = delete;
@@ -31,6 +47,22 @@ public:
     ~Server();
 
 public:
+    // 在port上额外监听HTTPS连接, 需要在run()之前调用
+    // 证书或私钥加载失败返回false, 不影响HTTP监听
+    bool listenHttps(uint16_t port, const std::string &cert_file, const std::string &key_file);
+
+    // 从打包的静态资源快照提供服务(格式见 snapshot/Snapshot.h), 需要在run()之前调用
+    // 收到SIGHUP时重新映射path并原子替换, 新快照加载失败时继续使用旧快照
+    // 快照加载失败返回false, 此时从资源目录提供服务
+    bool useSnapshot(const std::string &path, const SnapshotOptions &options);
+
+    // 对HTTP连接开启MSG_ZEROCOPY, 连续的共享数据达到threshold字节时零拷贝发送, 需要在run()之前调用
+    // 零拷贝需要锁定页并处理完成通知, 只有较大的发送才划算, 通过定期输出的统计信息评估效果
+    void enableZeroCopy(size_t threshold) { zerocopy_threshold_ = threshold; }
+
+    // 设置连接各个阶段的超时时间, 需要在run()之前调用
+    void setTimeouts(const ConnTimeouts &timeouts) { timeouts_ = timeouts; }
+
     // 运行服务器
     void run();
 
@@ -41,21 +73,35 @@ private:
     // 初始化监听socket
     bool initListenSock();
 
+    // 创建监听port的非阻塞socket并交给epoll监视, 失败返回-1
+    int createListenSock(uint16_t port);
+
     bool initSignalHandler();
 
 private:
-    // 处理监听socket的可读事件
-    void handleAccept();
+    // 处理SIGHUP: 重新加载静态资源快照
+    void handleReload();
+
+private:
+    // 处理监听socket的可读事件, tls_ctx不为空时接受的是HTTPS连接
+    void handleAccept(int listen_sock, SSL_CTX *tls_ctx);
 
-    // 处理连接socket的可读事件
+    // 处理连接socket的可读事件, 生成的任务在本轮事件处理完后提交
     void handleRead(int sock);
 
-    // 处理连接socket的可写事件
+    // 处理连接socket的可写事件, 生成的任务在本轮事件处理完后提交
     void handleWrite(int sock);
 
+    // 处理连接socket的出错事件
+    // 开启零拷贝的连接通过EPOLLERR通知发送完成, 读取完成通知后继续监视原来的事件, 真正出错时关闭连接
+    void handleError(int sock, uint32_t events);
+
+    // 定期输出服务器的统计信息
+    void reportStats();
+
 private:
     // 添加一个Http连接实例
-    void addHttpConn(int conn_sock, const struct sockaddr_in &client_addr);
+    void addHttpConn(int conn_sock, const struct sockaddr_in &client_addr, SSL_CTX *tls_ctx);
 
     // 删除Server维护的某个Http连接实例
     void closeHttpConn(int sock);
@@ -67,30 +113,85 @@ private:
     // 写任务
     void onWrite(std::weak_ptr<HttpConn> wp_conn);
 
+    // 推进HTTPS连接的TLS握手, 握手完成返回true
+    // 否则已经根据握手状态重新注册事件或者关闭了连接
+    bool continueHandshake(const std::shared_ptr<HttpConn> &p_conn);
+
+    // 读文件任务: 在磁盘线程上把响应需要的文件数据读入页缓存, 然后继续发送
+    void onDiskRead(std::weak_ptr<HttpConn> wp_conn);
+
+    // 连接sock上的读写任务的有效条件: 连接关闭(代数改变)后取消, 超过timeout_ms后过期
+    // timeout_ms是连接当前阶段的超时时间, 过期的任务被丢弃后连接由定时器关闭
+    TaskGuard connGuard(int sock, int timeout_ms) const;
+
+    // 发送响应的任务的优先级: 剩余数据达到BULK_RESPONSE_BYTES的大文件为BULK, 其余为INTERACTIVE
+    // 错误响应, 304以及小文件都很小, 不会被大文件的发送拖慢
+    static TaskPriority writePriority(const HttpConn &conn);
+
+    // 读写没有完成时重新注册的事件: 默认是event, TLS会话可能需要等待相反方向的事件
+    static uint32_t waitEvent(const HttpConn &conn, uint32_t event);
+
 private:
     // 服务器直接给客户端发送错误信息并关闭socket
     // !!! 应该在accept(2)后直接执行, 不要操作已经绑定到HttpConn对象的socket
     void sendError(int sock, const std::string &msg);
 
-    // 延长Http连接对应的定时器过期时间
-    void extentTime(int sock);
+private:
+    // 连接所处的阶段, 每个阶段有自己的超时时间
+    enum class ConnPhase
+    {
+        IDLE,       // 等待请求: keep_alive_ms
+        READING,    // 读请求报文: read_ms, 同时开始计算request_ms
+        WRITING,    // 发送响应: write_stall_ms, 每次可写时刷新
+    };
+
+    // 每个socket上的连接状态, 按socket下标访问
+    // 事件循环和工作线程通过EPOLLONESHOT交替访问同一个连接的状态, 不需要加锁
+    struct ConnSlot
+    {
+        std::atomic<uint32_t> generation{0};   // 关闭连接时递增, 排队中的旧连接任务因此被线程池丢弃
+        ConnPhase phase = ConnPhase::IDLE;
+        TimerId phase_timer = 0;                // 当前阶段的超时
+        TimerId request_timer = 0;              // 整个请求的超时, 没有在处理请求时为0
+    };
+
+    // 切换连接所处的阶段, 重新设置阶段定时器, 开始或者结束整个请求的定时器
+    void enterPhase(int sock, ConnPhase phase);
+
+    // 连接sock的定时器到期: 连接没有被关闭或者替换(代数仍然是generation)时关闭连接
+    void closeExpired(int sock, uint32_t generation, const char *reason);
 
     // 将文件描述符修改为非阻塞模式
     bool setNonBlocking(int fd);
 
 private:
     static constexpr int MAX_NUMBER_HTTP_CONNS = 60000;      // 服务器支持的最大并发数
-    static constexpr int CHECK_CONN_TIME_SLOT_SECONDS = 60;  // 服务器每隔60s定时检查不活跃的连接
+    static constexpr int MAX_POOLED_HTTP_CONNS = 4096;       // 连接对象池最多保留的空闲对象
+    static constexpr int REPORT_STATS_SECONDS = 60;          // 服务器每隔60s输出一次统计信息
+    static constexpr int CONN_SLOTS = MAX_NUMBER_HTTP_CONNS + 1024;  // 连接socket的上限, 更大的socket直接拒绝
+    static constexpr size_t BULK_RESPONSE_BYTES = 256 * 1024; // 剩余数据达到256KiB的响应按BULK优先级发送
 
     bool                              is_running_;           // 是否运行服务器
 
     uint16_t                          port_;
     int                               listen_sock_;
+    int                               https_listen_sock_;    // 没有开启HTTPS时为-1
+    std::unique_ptr<TlsContext>       p_tls_ctx_;
+    size_t                            zerocopy_threshold_;   // 0表示不使用零拷贝
+    int                               reload_fd_;            // SIGHUP处理函数通过eventfd通知事件循环, 没有使用快照时为-1
+    std::string                       snapshot_path_;
+    SnapshotOptions                   snapshot_options_;
+    ConnTimeouts                      timeouts_;
+    std::shared_ptr<HttpConnPool>     p_conn_pool_;          // 复用关闭的连接对象
     std::unordered_map<int, std::shared_ptr<HttpConn>> sock_to_http_;  // 连接socket到http连接对象的映射
+    // 在线程池之前构造, 线程池关闭之后才析构, 任务中的TaskGuard引用其中的代数
+    std::unique_ptr<ConnSlot[]>       conn_slots_;
 
     std::unique_ptr<ThreadPool>       p_thread_pool_;
+    std::vector<Task>                 ready_tasks_[TASK_PRIORITIES];  // 一次epoll_wait(2)产生的读写任务, 按优先级在处理完所有事件后一起提交
+    std::unique_ptr<ThreadPool>       p_disk_pool_;          // 专门处理可能阻塞在磁盘上的文件读取
     std::unique_ptr<Epoller>          p_epoller_;
-    TimerManager timer_manager_;
+    TimingWheel                       timing_wheel_;         // 连接的超时以及定期任务
 
     uint32_t listen_epoll_events_;      // 监听socket需要监视的EPOLL事件
     uint32_t conn_epoll_events_;        // 连接socket需要监视的固定事件
@@ -0,0 +1,162 @@
+#include <snapshot/Snapshot.h>
+#include <logger/AsyncLogger.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+using std::shared_ptr;
+using std::string;
+
+Snapshot::Snapshot(shared_ptr<FileHandle> file, const char *base, size_t len)
+  : file_(std::move(file)),
+    base_(base),
+    len_(len),
+    header_(reinterpret_cast<const SnapshotHeader *>(base)),
+    seeds_(nullptr),
+    entries_(nullptr),
+    strings_(nullptr)
+{}
+
+Snapshot::~Snapshot()
+{
+    ::munmap(const_cast<char *>(base_), len_);
+}
+
+shared_ptr<const Snapshot> Snapshot::open(const string &path, const SnapshotOptions &options)
+{
+    int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("open snapshot %s: %s", path.data(), strerror(errno));
+        return nullptr;
+    }
+    shared_ptr<FileHandle> file(new FileHandle(fd));
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) < 0 || static_cast<size_t>(file_stat.st_size) < sizeof(SnapshotHeader))
+    {
+        LOG_ERROR("snapshot %s is truncated", path.data());
+        return nullptr;
+    }
+    size_t len = file_stat.st_size;
+    int flags = MAP_PRIVATE | (options.populate ? MAP_POPULATE : 0);
+    void *addr = ::mmap(nullptr, len, PROT_READ, flags, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        LOG_ERROR("mmap snapshot %s: %s", path.data(), strerror(errno));
+        return nullptr;
+    }
+    // 大页和锁定内存只是优化, 失败时继续使用普通映射
+    if (options.huge_pages && ::madvise(addr, len, MADV_HUGEPAGE) < 0)
+    {
+        LOG_WARN("madvise(MADV_HUGEPAGE) on snapshot %s: %s", path.data(), strerror(errno));
+    }
+    if (options.lock && ::mlock(addr, len) < 0)
+    {
+        LOG_WARN("mlock snapshot %s: %s", path.data(), strerror(errno));
+    }
+    shared_ptr<Snapshot> snapshot(new Snapshot(std::move(file), static_cast<const char *>(addr), len));
+    if (!snapshot->validate())
+    {
+        LOG_ERROR("snapshot %s is corrupted", path.data());
+        return nullptr;
+    }
+    LOG_INFO("snapshot %s loaded, %u entries, %zu bytes", path.data(), snapshot->size(), len);
+    return snapshot;
+}
+
+bool Snapshot::validate() const
+{
+    const SnapshotHeader &header = *header_;
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.file_size != len_)
+    {
+        return false;
+    }
+    // 范围[offset, offset + size)是否在文件内, 避免相加溢出
+    auto in_file = [this](uint64_t offset, uint64_t size) {
+        return offset <= len_ && size <= len_ - offset;
+    };
+    uint64_t n = header.entry_count;
+    if (!in_file(header.seeds_offset, n * sizeof(int32_t)) ||
+        !in_file(header.entries_offset, n * sizeof(SnapshotEntry)) ||
+        !in_file(header.strings_offset, header.strings_len) ||
+        header.seeds_offset % alignof(int32_t) != 0 ||
+        header.entries_offset % alignof(SnapshotEntry) != 0)
+    {
+        return false;
+    }
+    auto *self = const_cast<Snapshot *>(this);
+    self->seeds_ = reinterpret_cast<const int32_t *>(base_ + header.seeds_offset);
+    self->entries_ = reinterpret_cast<const SnapshotEntry *>(base_ + header.entries_offset);
+    self->strings_ = base_ + header.strings_offset;
+
+    auto in_strings = [&header](uint32_t offset, uint32_t size) {
+        return offset <= header.strings_len && size <= header.strings_len - offset;
+    };
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        const SnapshotEntry &entry = entries_[i];
+        if (!in_strings(entry.path_offset, entry.path_len) ||
+            !in_strings(entry.type_offset, entry.type_len) ||
+            !in_strings(entry.etag_offset, entry.etag_len) ||
+            !in_strings(entry.gzip_etag_offset, entry.gzip_etag_len) ||
+            !in_file(entry.data_offset, entry.data_len) ||
+            !in_file(entry.gzip_offset, entry.gzip_len))
+        {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (seeds_[i] < 0 && static_cast<uint64_t>(-static_cast<int64_t>(seeds_[i]) - 1) >= n)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const SnapshotEntry *Snapshot::find(std::string_view path) const
+{
+    uint32_t n = header_->entry_count;
+    if (n == 0)
+    {
+        return nullptr;
+    }
+    int32_t seed = seeds_[hash(path.data(), path.size(), 0) % n];
+    uint32_t slot = seed < 0 ? static_cast<uint32_t>(-(seed + 1))
+                             : static_cast<uint32_t>(hash(path.data(), path.size(), seed) % n);
+    // 不在快照中的路径也会落到某个槽位上, 需要比较路径确认
+    const SnapshotEntry &entry = entries_[slot];
+    if (entry.path_len != path.size() ||
+        std::memcmp(strings_ + entry.path_offset, path.data(), path.size()) != 0)
+    {
+        return nullptr;
+    }
+    return &entry;
+}
+
+shared_ptr<const char> Snapshot::data(const SnapshotEntry &entry, bool gzip) const
+{
+    // 别名构造: 指向映射中的资源内容, 引用计数记在快照上
+    return shared_ptr<const char>(shared_from_this(), base_ + (gzip ? entry.gzip_offset : entry.data_offset));
+}
+
+uint64_t Snapshot::hash(const char *data, size_t len, uint32_t seed)
+{
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    // FNV的低位分布较差, 取模之前再混合一次
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
@@ -0,0 +1,130 @@
+// 打包的静态资源快照: 一个文件包含所有资源, 启动时映射, 每次请求只需要一次哈希查找
+//
+// 文件布局(所有偏移都相对文件开头):
+// -> SnapshotHeader
+// -> int32_t seeds[entry_count]            // 完美哈希每个桶的种子
+// -> SnapshotEntry entries[entry_count]    // 按完美哈希的槽位排列
+// -> 字符串区                               // 路径, Content-Type, ETag
+// -> 数据区                                 // 资源内容以及可选的gzip版本, 按SNAPSHOT_ALIGN对齐
+//
+// 查找: 先用种子0找到桶, 再用桶的种子找到槽位, 比较槽位上的路径确认命中
+// -> seed = seeds[hash(path, 0) % n]
+// -> slot = seed < 0 ? -seed - 1 : hash(path, seed) % n     // 只有一个键的桶直接记录槽位
+//
+// 部署: 生成新快照后rename(2)覆盖旧文件, 再给服务器发送SIGHUP, 正在发送的响应继续引用旧快照的映射
+
+#ifndef HTTPSERVER_SNAPSHOT_SNAPSHOT_H
+#define HTTPSERVER_SNAPSHOT_SNAPSHOT_H
+
+#include <buffer/SegmentChain.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct SnapshotHeader
+{
+    char magic[8];              // SNAPSHOT_MAGIC
+    uint32_t version;           // SNAPSHOT_VERSION
+    uint32_t entry_count;
+    uint64_t seeds_offset;
+    uint64_t entries_offset;
+    uint64_t strings_offset;
+    uint64_t strings_len;
+    uint64_t file_size;
+};
+
+struct SnapshotEntry
+{
+    uint32_t path_offset;       // 字符串的偏移相对字符串区
+    uint32_t path_len;
+    uint32_t type_offset;
+    uint32_t type_len;
+    uint32_t etag_offset;
+    uint32_t etag_len;
+    uint32_t gzip_etag_offset;  // gzip版本的强校验ETag与原始内容不同
+    uint32_t gzip_etag_len;     // 没有gzip版本时为0
+    uint64_t mtime;             // 源文件的修改时间
+    uint64_t data_offset;
+    uint64_t data_len;
+    uint64_t gzip_offset;
+    uint64_t gzip_len;          // 0表示没有gzip版本
+};
+
+// 映射快照的方式
+struct SnapshotOptions
+{
+    bool populate = false;      // MAP_POPULATE: 映射时预先读入所有页
+    bool huge_pages = false;    // MADV_HUGEPAGE: 减少TLB缺失, 需要内核支持文件映射的透明大页
+    bool lock = false;          // mlock(2): 常驻内存, 受RLIMIT_MEMLOCK限制
+};
+
+class Snapshot : public std::enable_shared_from_this<Snapshot>
+{
+public:
+    Snapshot(const Snapshot &) = delete;
+
+    Snapshot(Snapshot &&) = delete;
+
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    Snapshot &operator=(Snapshot &&) = delete;
+
+    ~Snapshot();
+
+public:
+    // 映射并校验快照文件, 失败返回nullptr
+    static std::shared_ptr<const Snapshot> open(const std::string &path, const SnapshotOptions &options);
+
+    // 查找资源, 不存在返回nullptr
+    const SnapshotEntry *find(std::string_view path) const;
+
+    std::string_view path(const SnapshotEntry &entry) const { return stringAt(entry.path_offset, entry.path_len); }
+
+    std::string_view contentType(const SnapshotEntry &entry) const { return stringAt(entry.type_offset, entry.type_len); }
+
+    // 资源内容(gzip为true时是压缩版本)的ETag
+    std::string_view etag(const SnapshotEntry &entry, bool gzip) const
+    {
+        return gzip ? stringAt(entry.gzip_etag_offset, entry.gzip_etag_len) : stringAt(entry.etag_offset, entry.etag_len);
+    }
+
+    // 资源内容(gzip为true时是压缩版本), 与快照共享所有权, 快照被替换后仍然有效
+    std::shared_ptr<const char> data(const SnapshotEntry &entry, bool gzip) const;
+
+    // 快照文件, 用来检查资源内容是否在页缓存中
+    const std::shared_ptr<FileHandle> &file() const { return file_; }
+
+    uint32_t size() const { return header_->entry_count; }
+
+public:
+    // 完美哈希使用的哈希函数(FNV-1a), seed不同得到不同的哈希函数
+    static uint64_t hash(const char *data, size_t len, uint32_t seed);
+
+public:
+    static constexpr char SNAPSHOT_MAGIC[8] = {'H', 'S', 'N', 'A', 'P', 'S', 'H', 'T'};
+    static constexpr uint32_t SNAPSHOT_VERSION = 2;
+    static constexpr uint64_t SNAPSHOT_ALIGN = 64;     // 资源内容的对齐字节数
+
+private:
+    Snapshot(std::shared_ptr<FileHandle> file, const char *base, size_t len);
+
+    // 检查头部以及所有条目引用的范围都在文件内
+    bool validate() const;
+
+    std::string_view stringAt(uint32_t offset, uint32_t len) const { return std::string_view(strings_ + offset, len); }
+
+private:
+    std::shared_ptr<FileHandle> file_;
+    const char *base_;                  // 映射的起始地址
+    size_t len_;
+
+    const SnapshotHeader *header_;
+    const int32_t *seeds_;
+    const SnapshotEntry *entries_;
+    const char *strings_;
+};
+
+#endif
@@ -0,0 +1,315 @@
+#include <snapshot/SnapshotBuilder.h>
+#include <snapshot/Snapshot.h>
+#include <http/HttpResponse.h>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+bool SnapshotBuilder::addDirectory(const string &root)
+{
+    // 待遍历的目录, 保存相对root的路径
+    vector<string> dirs = {""};
+    while (!dirs.empty())
+    {
+        string dir = dirs.back();
+        dirs.pop_back();
+        DIR *p_dir = ::opendir((root + dir).data());
+        if (!p_dir)
+        {
+            std::perror(("::opendir() " + root + dir).data());
+            return false;
+        }
+        while (struct dirent *p_entry = ::readdir(p_dir))
+        {
+            string name = p_entry->d_name;
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+            string path = dir + "/" + name;
+            struct stat file_stat;
+            if (::stat((root + path).data(), &file_stat) < 0)
+            {
+                continue;
+            }
+            if (S_ISDIR(file_stat.st_mode))
+            {
+                dirs.push_back(path);
+                continue;
+            }
+            if (!S_ISREG(file_stat.st_mode))
+            {
+                continue;
+            }
+            std::ifstream in(root + path, std::ios::binary);
+            std::ostringstream content;
+            content << in.rdbuf();
+            if (!in)
+            {
+                std::fprintf(stderr, "can not read %s\n", (root + path).data());
+                ::closedir(p_dir);
+                return false;
+            }
+            // 与直接从目录提供服务时一样根据后缀名确定类型
+            string type;
+            auto pos = name.find_last_of('.');
+            if (pos != string::npos && HttpResponse::suffix_to_type.count(name.substr(pos + 1)))
+            {
+                type = HttpResponse::suffix_to_type[name.substr(pos + 1)];
+            }
+            addAsset(path, content.str(), type, file_stat.st_mtime);
+        }
+        ::closedir(p_dir);
+    }
+    return true;
+}
+
+void SnapshotBuilder::addAsset(const string &path, string content, const string &type, uint64_t mtime)
+{
+    Asset asset;
+    asset.path = path;
+    asset.type = type;
+    asset.mtime = mtime;
+    // 强校验ETag: 内容长度以及内容的哈希
+    char etag[64];
+    std::snprintf(etag, sizeof(etag), "\"%zx-%016llx\"", content.size(),
+                  static_cast<unsigned long long>(Snapshot::hash(content.data(), content.size(), 0)));
+    asset.etag = etag;
+    if (content.size() >= GZIP_MIN_SIZE && compressible(type))
+    {
+        string compressed = gzip(content);
+        // 压缩效果不明显时不保存压缩版本
+        if (!compressed.empty() && compressed.size() < content.size() * 9 / 10)
+        {
+            asset.gzip = std::move(compressed);
+            // 不同的内容编码必须使用不同的强校验ETag
+            asset.gzip_etag = asset.etag.substr(0, asset.etag.size() - 1) + "-gz\"";
+        }
+    }
+    asset.content = std::move(content);
+    assets_.push_back(std::move(asset));
+}
+
+bool SnapshotBuilder::buildIndex(vector<int32_t> &seeds, vector<uint32_t> &slots) const
+{
+    uint32_t n = assets_.size();
+    seeds.assign(n, 0);
+    slots.assign(n, UINT32_MAX);
+    vector<vector<uint32_t>> buckets(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        const string &path = assets_[i].path;
+        buckets[Snapshot::hash(path.data(), path.size(), 0) % n].push_back(i);
+    }
+    // 先处理键多的桶, 此时空闲槽位多, 容易找到种子
+    vector<uint32_t> order(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    size_t idx = 0;
+    for (; idx < n && buckets[order[idx]].size() > 1; ++idx)
+    {
+        const vector<uint32_t> &bucket = buckets[order[idx]];
+        vector<uint32_t> bucket_slots;
+        uint32_t seed = 1;
+        for (; seed < MAX_SEED; ++seed)
+        {
+            bucket_slots.clear();
+            for (uint32_t asset_idx : bucket)
+            {
+                const string &path = assets_[asset_idx].path;
+                uint32_t slot = Snapshot::hash(path.data(), path.size(), seed) % n;
+                if (slots[slot] != UINT32_MAX ||
+                    std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end())
+                {
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (bucket_slots.size() == bucket.size())
+            {
+                break;
+            }
+        }
+        if (seed == MAX_SEED)
+        {
+            return false;
+        }
+        seeds[order[idx]] = seed;
+        for (size_t i = 0; i < bucket.size(); ++i)
+        {
+            slots[bucket_slots[i]] = bucket[i];
+        }
+    }
+    // 只有一个键的桶直接记录槽位
+    uint32_t free_slot = 0;
+    for (; idx < n && buckets[order[idx]].size() == 1; ++idx)
+    {
+        while (slots[free_slot] != UINT32_MAX)
+        {
+            ++free_slot;
+        }
+        slots[free_slot] = buckets[order[idx]][0];
+        seeds[order[idx]] = -static_cast<int32_t>(free_slot) - 1;
+    }
+    return true;
+}
+
+bool SnapshotBuilder::write(const string &path) const
+{
+    vector<int32_t> seeds;
+    vector<uint32_t> slots;
+    if (!buildIndex(seeds, slots))
+    {
+        std::fprintf(stderr, "can not build perfect hash index\n");
+        return false;
+    }
+    uint32_t n = assets_.size();
+    auto align = [](uint64_t offset, uint64_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Snapshot::SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = Snapshot::SNAPSHOT_VERSION;
+    header.entry_count = n;
+    header.seeds_offset = sizeof(SnapshotHeader);
+    header.entries_offset = align(header.seeds_offset + n * sizeof(int32_t), alignof(SnapshotEntry));
+
+    // 字符串区以及每个条目的位置
+    string strings;
+    vector<SnapshotEntry> entries(n);
+    auto add_string = [&strings](const string &s, uint32_t &offset, uint32_t &len) {
+        offset = strings.size();
+        len = s.size();
+        strings += s;
+    };
+    for (uint32_t slot = 0; slot < n; ++slot)
+    {
+        const Asset &asset = assets_[slots[slot]];
+        SnapshotEntry &entry = entries[slot];
+        std::memset(&entry, 0, sizeof(entry));
+        add_string(asset.path, entry.path_offset, entry.path_len);
+        add_string(asset.type, entry.type_offset, entry.type_len);
+        add_string(asset.etag, entry.etag_offset, entry.etag_len);
+        add_string(asset.gzip_etag, entry.gzip_etag_offset, entry.gzip_etag_len);
+        entry.mtime = asset.mtime;
+    }
+    header.strings_offset = header.entries_offset + n * sizeof(SnapshotEntry);
+    header.strings_len = strings.size();
+
+    // 数据区: 每个资源内容按SNAPSHOT_ALIGN对齐
+    uint64_t offset = header.strings_offset + header.strings_len;
+    for (uint32_t slot = 0; slot < n; ++slot)
+    {
+        const Asset &asset = assets_[slots[slot]];
+        SnapshotEntry &entry = entries[slot];
+        offset = align(offset, Snapshot::SNAPSHOT_ALIGN);
+        entry.data_offset = offset;
+        entry.data_len = asset.content.size();
+        offset += entry.data_len;
+        if (!asset.gzip.empty())
+        {
+            offset = align(offset, Snapshot::SNAPSHOT_ALIGN);
+            entry.gzip_offset = offset;
+            entry.gzip_len = asset.gzip.size();
+            offset += entry.gzip_len;
+        }
+    }
+    header.file_size = offset;
+
+    // 写入临时文件, 完整落盘后再替换目标文件, 服务器不会映射到写了一半的快照
+    string tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        std::perror(("::open() " + tmp_path).data());
+        return false;
+    }
+    auto write_at = [fd](const void *data, size_t len, uint64_t offset) {
+        const char *p = static_cast<const char *>(data);
+        while (len > 0)
+        {
+            ssize_t ret = ::pwrite(fd, p, len, offset);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += ret;
+            len -= ret;
+            offset += ret;
+        }
+        return true;
+    };
+    bool ok = ::ftruncate(fd, header.file_size) == 0 &&
+              write_at(&header, sizeof(header), 0) &&
+              write_at(seeds.data(), n * sizeof(int32_t), header.seeds_offset) &&
+              write_at(entries.data(), n * sizeof(SnapshotEntry), header.entries_offset) &&
+              write_at(strings.data(), strings.size(), header.strings_offset);
+    for (uint32_t slot = 0; ok && slot < n; ++slot)
+    {
+        const Asset &asset = assets_[slots[slot]];
+        ok = write_at(asset.content.data(), asset.content.size(), entries[slot].data_offset) &&
+             write_at(asset.gzip.data(), asset.gzip.size(), entries[slot].gzip_offset);
+    }
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp_path.data(), path.data()) < 0)
+    {
+        std::perror(("write snapshot " + path).data());
+        ::unlink(tmp_path.data());
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotBuilder::compressible(const string &type)
+{
+    return type.compare(0, 5, "text/") == 0 ||
+           type == "application/javascript" ||
+           type == "application/json" ||
+           type == "image/svg+xml";
+}
+
+string SnapshotBuilder::gzip(const string &content)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // windowBits加16生成gzip格式而不是zlib格式
+    if (::deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return "";
+    }
+    string compressed(::deflateBound(&stream, content.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(content.data()));
+    stream.avail_in = content.size();
+    stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+    stream.avail_out = compressed.size();
+    int ret = ::deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    ::deflateEnd(&stream);
+    return ret == Z_STREAM_END ? compressed : "";
+}
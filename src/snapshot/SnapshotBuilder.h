@@ -0,0 +1,74 @@
+// 生成静态资源快照(格式见 snapshot/Snapshot.h)
+//
+// -> SnapshotBuilder builder;
+// -> builder.addDirectory("../resources");      // 资源路径为相对目录的 /a/b.html
+// -> builder.write("../resources.snap");        // 写入临时文件后rename(2), 替换是原子的
+
+#ifndef HTTPSERVER_SNAPSHOT_SNAPSHOT_BUILDER_H
+#define HTTPSERVER_SNAPSHOT_SNAPSHOT_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SnapshotBuilder
+{
+public:
+    SnapshotBuilder()
+      : assets_()
+    {}
+
+    SnapshotBuilder(const SnapshotBuilder &) = delete;
+
+    SnapshotBuilder(SnapshotBuilder &&) = default;
+
+    SnapshotBuilder &operator=(const SnapshotBuilder &) = delete;
+
+    SnapshotBuilder &operator=(SnapshotBuilder &&) = default;
+
+    ~SnapshotBuilder() = default;
+
+public:
+    // 递归加入root下的所有普通文件, 读取失败返回false
+    bool addDirectory(const std::string &root);
+
+    // 加入一个资源, 可以压缩的类型会同时生成gzip版本
+    void addAsset(const std::string &path, std::string content, const std::string &type, uint64_t mtime);
+
+    // 生成完美哈希索引并写入path, 失败返回false
+    bool write(const std::string &path) const;
+
+    size_t size() const { return assets_.size(); }
+
+public:
+    static constexpr size_t GZIP_MIN_SIZE = 256;           // 小于256字节的资源不压缩
+    static constexpr uint32_t MAX_SEED = 1u << 24;          // 为一个桶搜索种子的上限
+
+private:
+    struct Asset
+    {
+        std::string path;
+        std::string type;
+        std::string etag;
+        std::string gzip_etag;  // 原始内容的ETag加上-gz后缀
+        uint64_t mtime;
+        std::string content;
+        std::string gzip;       // 为空表示没有gzip版本
+    };
+
+private:
+    // 为每个桶找到把桶中的键映射到空闲槽位的种子, slots[i]为放在槽位i的资源下标
+    bool buildIndex(std::vector<int32_t> &seeds, std::vector<uint32_t> &slots) const;
+
+    // 是否值得为该类型生成gzip版本(图片等已经压缩过的格式不值得)
+    static bool compressible(const std::string &type);
+
+    // gzip格式压缩, 失败返回空串
+    static std::string gzip(const std::string &content);
+
+private:
+    std::vector<Asset> assets_;
+};
+
+#endif
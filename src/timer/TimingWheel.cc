@@ -0,0 +1,323 @@
+#include <timer/TimingWheel.h>
+
+#include <time.h>
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+using std::lock_guard;
+using std::mutex;
+
+TimingWheel::TimingWheel()
+  : entries_(),
+    free_head_(-1),
+    heads_(),
+    level_count_(),
+    size_(0),
+    current_tick_(nowMs()),
+    now_tick_(current_tick_),
+    fired_(),
+    running_(),
+    lock_()
+{
+    std::fill(std::begin(heads_), std::end(heads_), -1);
+}
+
+int64_t TimingWheel::nowMs()
+{
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+void TimingWheel::updateTime()
+{
+    int64_t now = nowMs();
+    lock_guard<mutex> guard(lock_);
+    now_tick_ = now;
+}
+
+TimerId TimingWheel::add(int timeout_ms, const TimeOutCallBack &callback, int interval_ms)
+{
+    lock_guard<mutex> guard(lock_);
+    int index = free_head_;
+    if (index != -1)
+    {
+        free_head_ = entries_[index].next;
+    }
+    else
+    {
+        index = static_cast<int>(entries_.size());
+        entries_.emplace_back();
+    }
+    Entry &entry = entries_[index];
+    entry.timeout_ms = timeout_ms;
+    entry.interval_ms = interval_ms;
+    entry.expire_tick = now_tick_ + timeout_ms;
+    entry.callback = callback;
+    TimerId id = (static_cast<TimerId>(entry.generation) << 32) | static_cast<uint32_t>(index);
+    schedule(index);
+    return id;
+}
+
+bool TimingWheel::reset(TimerId id, int timeout_ms)
+{
+    lock_guard<mutex> guard(lock_);
+    int index = find(id);
+    if (index == -1)
+    {
+        return false;
+    }
+    Entry &entry = entries_[index];
+    int64_t expire_tick = now_tick_ + timeout_ms;
+    entry.timeout_ms = timeout_ms;
+    if (expire_tick < entry.expire_tick)
+    {
+        // 提前到期: 所在的槽可能晚于新的到期时间, 需要立即重新放入
+        unlink(index);
+        entry.expire_tick = expire_tick;
+        schedule(index);
+    }
+    else
+    {
+        entry.expire_tick = expire_tick;
+    }
+    return true;
+}
+
+void TimingWheel::refresh(TimerId id)
+{
+    lock_guard<mutex> guard(lock_);
+    int index = find(id);
+    if (index == -1)
+    {
+        return;
+    }
+    // 只记录新的到期时间, 定时器所在的槽到达时再重新放入
+    Entry &entry = entries_[index];
+    entry.expire_tick = now_tick_ + entry.timeout_ms;
+}
+
+void TimingWheel::cancel(TimerId id)
+{
+    lock_guard<mutex> guard(lock_);
+    int index = find(id);
+    if (index == -1)
+    {
+        return;
+    }
+    unlink(index);
+    release(index);
+}
+
+int64_t TimingWheel::nextExpireMs() const
+{
+    lock_guard<mutex> guard(lock_);
+    if (size_ == 0)
+    {
+        return -1;
+    }
+    // 每个非空的层中最早需要处理的槽: 第0层是定时器的到期时间, 其它层是把槽中定时器放入低层的时间
+    // 所有层的最小值不晚于任何一个定时器的到期时间
+    int64_t next_tick = INT64_MAX;
+    for (int level = 0; level < LEVELS; ++level)
+    {
+        if (level_count_[level] == 0)
+        {
+            continue;
+        }
+        int shift = SLOT_BITS * level;
+        int64_t base = current_tick_ >> shift;
+        for (int64_t k = base + 1; k <= base + SLOTS; ++k)
+        {
+            if (heads_[level * SLOTS + (k & (SLOTS - 1))] != -1)
+            {
+                next_tick = std::min(next_tick, k << shift);
+                break;
+            }
+        }
+    }
+    return next_tick;
+}
+
+int TimingWheel::millisecondsToNextExpired() const
+{
+    int64_t next_tick = nextExpireMs();
+    if (next_tick < 0)
+    {
+        return -1;
+    }
+    int64_t timeout = next_tick - nowMs();
+    return static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(timeout, INT_MAX)));
+}
+
+void TimingWheel::checkAndHandleTimer()
+{
+    int64_t now = nowMs();
+    {
+        lock_guard<mutex> guard(lock_);
+        now_tick_ = now;
+        advance(now);
+        running_.swap(fired_);
+    }
+    // 回调函数可能关闭连接并取消定时器, 不能持有锁
+    for (auto &callback : running_)
+    {
+        callback();
+    }
+    running_.clear();
+}
+
+size_t TimingWheel::size() const
+{
+    lock_guard<mutex> guard(lock_);
+    return size_;
+}
+
+void TimingWheel::advance(int64_t now_tick)
+{
+    while (current_tick_ < now_tick)
+    {
+        if (size_ == 0)
+        {
+            current_tick_ = now_tick;
+            break;
+        }
+        // 低于最低非空层的槽都是空的, 直接跳到最低非空层的下一个槽边界
+        int lowest = 0;
+        while (level_count_[lowest] == 0)
+        {
+            ++lowest;
+        }
+        int64_t span = int64_t(1) << (SLOT_BITS * lowest);
+        int64_t next = (current_tick_ / span + 1) * span;
+        if (next > now_tick)
+        {
+            current_tick_ = now_tick;
+            break;
+        }
+        current_tick_ = next;
+        // 先把到达边界的高层槽中的定时器放入低层, 再处理第0层当前的槽
+        for (int level = LEVELS - 1; level > 0; --level)
+        {
+            int shift = SLOT_BITS * level;
+            if ((current_tick_ & ((int64_t(1) << shift) - 1)) == 0)
+            {
+                flushSlot(level * SLOTS + ((current_tick_ >> shift) & (SLOTS - 1)));
+            }
+        }
+        flushSlot(current_tick_ & (SLOTS - 1));
+    }
+}
+
+void TimingWheel::flushSlot(int slot)
+{
+    int index = heads_[slot];
+    heads_[slot] = -1;
+    while (index != -1)
+    {
+        Entry &entry = entries_[index];
+        int next = entry.next;
+        entry.prev = -1;
+        entry.next = -1;
+        entry.slot = -1;
+        --level_count_[levelOf(slot)];
+        --size_;
+        schedule(index);
+        index = next;
+    }
+}
+
+void TimingWheel::schedule(int index)
+{
+    Entry &entry = entries_[index];
+    if (entry.expire_tick <= current_tick_)
+    {
+        if (entry.interval_ms <= 0)
+        {
+            fired_.push_back(std::move(entry.callback));
+            release(index);
+            return;
+        }
+        // 重复的定时器按间隔推进, 错过多个周期时只执行一次
+        fired_.push_back(entry.callback);
+        entry.expire_tick = std::max(entry.expire_tick + entry.interval_ms, current_tick_ + 1);
+    }
+    // 到期时间与当前时间的差决定所在的层, 第k层的槽号是到期时间的第k组SLOT_BITS位
+    int64_t delta = entry.expire_tick - current_tick_;
+    int64_t expire = entry.expire_tick;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (int64_t(1) << (SLOT_BITS * (level + 1))))
+    {
+        ++level;
+    }
+    if (delta >= (int64_t(1) << (SLOT_BITS * LEVELS)))
+    {
+        // 超出时间轮的范围, 放在最高层最远的槽, 到达时重新计算
+        expire = current_tick_ + (int64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    }
+    link(index, level * SLOTS + static_cast<int>((expire >> (SLOT_BITS * level)) & (SLOTS - 1)));
+}
+
+int TimingWheel::find(TimerId id) const
+{
+    size_t index = static_cast<uint32_t>(id);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index >= entries_.size() || entries_[index].generation != generation || entries_[index].slot == -1)
+    {
+        return -1;
+    }
+    return static_cast<int>(index);
+}
+
+void TimingWheel::release(int index)
+{
+    Entry &entry = entries_[index];
+    entry.callback = nullptr;
+    // 代数0留给无效的句柄
+    if (++entry.generation == 0)
+    {
+        entry.generation = 1;
+    }
+    entry.next = free_head_;
+    free_head_ = index;
+}
+
+void TimingWheel::link(int index, int slot)
+{
+    Entry &entry = entries_[index];
+    entry.slot = slot;
+    entry.prev = -1;
+    entry.next = heads_[slot];
+    if (entry.next != -1)
+    {
+        entries_[entry.next].prev = index;
+    }
+    heads_[slot] = index;
+    ++level_count_[levelOf(slot)];
+    ++size_;
+}
+
+void TimingWheel::unlink(int index)
+{
+    Entry &entry = entries_[index];
+    assert(entry.slot != -1);
+    if (entry.prev != -1)
+    {
+        entries_[entry.prev].next = entry.next;
+    }
+    else
+    {
+        heads_[entry.slot] = entry.next;
+    }
+    if (entry.next != -1)
+    {
+        entries_[entry.next].prev = entry.prev;
+    }
+    --level_count_[levelOf(entry.slot)];
+    --size_;
+    entry.prev = -1;
+    entry.next = -1;
+    entry.slot = -1;
+}
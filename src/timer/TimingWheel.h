@@ -0,0 +1,144 @@
+// 分层时间轮: 大量定时器的添加, 取消, 刷新都是O(1)
+//
+// 时间取自CLOCK_MONOTONIC, 不受系统时间调整的影响, 以1ms为一格(tick), 共LEVELS层, 每层SLOTS个槽, 第k层的一个槽跨越SLOTS^k格:
+// -> 定时器按到期时间与当前时间的差放入对应层的槽(双向链表)
+// -> 时间推进到第k层槽的边界时, 把该槽中的定时器重新放入更低的层, 第0层的槽到达时定时器到期
+// -> 超出最高层范围的定时器先放在最高层, 到达时重新计算
+//
+// 刷新是惰性的: refresh()只记录新的到期时间, 不移动定时器
+// 定时器所在的槽到达时再比较, 还没有到期的按新的时间重新放入, 频繁活动的连接不会在每次读写时调整位置
+//
+// add()返回定时器的句柄(TimerId), 一个连接可以同时有多个定时器, 也可以有与连接无关的定时器
+// 句柄带有代数, 定时器到期或者取消后旧句柄失效, 对失效的句柄操作没有效果
+// interval_ms大于0的定时器到期后按间隔重复, 直到取消
+// 回调函数在锁外执行, 可以在回调中添加或者取消定时器
+// add()/reset()/refresh()使用缓存的当前时间, 不在每次调用时读取时钟, 事件循环每次被唤醒后调用updateTime()
+// -> TimingWheel wheel;
+// -> wheel.updateTime();                                         // epoll_wait(2)返回后
+// -> TimerId id = wheel.add(60000, [](){ ... });                // 60s后到期
+// -> wheel.refresh(id);                                          // 有活动, 从现在起重新计算60s
+// -> wheel.reset(id, 10000);                                     // 改为从现在起10s后到期
+// -> wheel.cancel(id);
+// -> wheel.add(1000, [](){ ... }, 1000);                         // 每秒执行一次
+// -> epoller.setTimer(wheel.nextExpireMs());                     // 到时间后timerfd可读
+// -> wheel.checkAndHandleTimer();                                // 执行所有到期定时器的回调
+
+#ifndef HTTPSERVER_TIMER_TIMING_WHEEL_H
+#define HTTPSERVER_TIMER_TIMING_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// 定时器句柄, 0表示没有定时器
+using TimerId = uint64_t;
+
+class TimingWheel
+{
+public:
+    using TimeOutCallBack = std::function<void()>;
+
+public:
+    TimingWheel();
+
+    TimingWheel(const TimingWheel &) = delete;
+
+    TimingWheel(TimingWheel &&) = delete;
+
+    TimingWheel &operator=(const TimingWheel &) = delete;
+
+    TimingWheel &operator=(TimingWheel &&) = delete;
+
+    ~TimingWheel() = default;
+
+public:
+    // 读取一次时钟, 之后的add()/reset()/refresh()以这个时间为起点
+    void updateTime();
+
+    // 添加定时器, timeout_ms后到期; interval_ms大于0时之后每隔interval_ms重复
+    TimerId add(int timeout_ms, const TimeOutCallBack &callback, int interval_ms = 0);
+
+    // 修改超时时间为timeout_ms, 从现在起计算, 之后refresh()也使用新的超时时间
+    // 定时器已经失效时返回false
+    bool reset(TimerId id, int timeout_ms);
+
+    // 从现在起重新计算超时时间, 定时器已经失效时没有效果
+    void refresh(TimerId id);
+
+    // 取消定时器, 定时器已经失效时没有效果
+    void cancel(TimerId id);
+
+    // 下一次需要处理定时器的时间(CLOCK_MONOTONIC, 毫秒), 没有定时器返回-1
+    // 可能早于实际的到期时间(需要把高层的定时器放入低层, 或者定时器已经被刷新), 提前处理是安全的
+    int64_t nextExpireMs() const;
+
+    // 到nextExpireMs()的毫秒数, 没有定时器返回-1
+    int millisecondsToNextExpired() const;
+
+    // * 只在一个线程上调用(事件循环)
+    // 更新时间, 推进时间轮并执行所有到期定时器的回调
+    void checkAndHandleTimer();
+
+    // 定时器数目
+    size_t size() const;
+
+public:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;   // 每层64个槽
+    static constexpr int LEVELS = 4;                // 4层可以直接表示2^24ms(约4.6小时)以内的到期时间
+
+    // CLOCK_MONOTONIC的当前时间(毫秒), 与timerfd使用同一个时钟
+    static int64_t nowMs();
+
+private:
+    struct Entry
+    {
+        int prev = -1;              // 所在槽的双向链表(entries_的下标), 空闲时next是空闲链表
+        int next = -1;
+        int slot = -1;              // 所在的槽: level * SLOTS + index, -1表示不在时间轮中
+        uint32_t generation = 1;    // 每次释放后递增, 使旧的句柄失效
+        int timeout_ms = 0;
+        int interval_ms = 0;        // 大于0时重复
+        int64_t expire_tick = 0;    // 到期时间, 惰性刷新只修改它
+        TimeOutCallBack callback;
+    };
+
+    // 句柄对应的定时器下标, 句柄已经失效时返回-1
+    int find(TimerId id) const;
+
+    // 释放不再使用的定时器, 旧句柄失效
+    void release(int index);
+
+    // 推进到now_tick, 到期定时器的回调放入fired_
+    void advance(int64_t now_tick);
+
+    // 把槽中的定时器全部取出, 按各自的到期时间重新放入或者到期
+    void flushSlot(int slot);
+
+    // 定时器已经到期时回调放入fired_(重复的定时器按间隔重新放入), 否则按到期时间放入对应的槽
+    void schedule(int index);
+
+    void link(int index, int slot);
+
+    void unlink(int index);
+
+    static int levelOf(int slot) { return slot >> SLOT_BITS; }
+
+private:
+    std::vector<Entry> entries_;
+    int free_head_;                             // 空闲的定时器链表, -1表示空
+    int heads_[LEVELS * SLOTS];                 // 每个槽的链表头, -1表示空
+    size_t level_count_[LEVELS];                // 每层的定时器数目, 空的层可以直接跳过
+    size_t size_;
+    int64_t current_tick_;                      // 已经处理到的时间
+    int64_t now_tick_;                          // 缓存的当前时间, add()/reset()/refresh()以它为起点
+
+    std::vector<TimeOutCallBack> fired_;        // 本次到期的回调, 在锁外执行
+    std::vector<TimeOutCallBack> running_;
+
+    mutable std::mutex lock_;                   // 连接可能在工作线程上改变状态或者关闭
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <tls/TlsContext.h>
+#include <logger/AsyncLogger.h>
+
+#include <openssl/err.h>
+
+namespace
+{
+
+const unsigned char SESSION_ID_CONTEXT[] = "httpserver";
+
+const char *lastError()
+{
+    return ERR_reason_error_string(ERR_get_error());
+}
+
+}
+
+bool TlsContext::init(const std::string &cert_file, const std::string &key_file)
+{
+    ctx_ = SSL_CTX_new(TLS_server_method());
+    if (!ctx_)
+    {
+        LOG_ERROR("SSL_CTX_new(): %s", lastError());
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx_, cert_file.data()) != 1)
+    {
+        LOG_ERROR("SSL_CTX_use_certificate_chain_file(%s): %s", cert_file.data(), lastError());
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx_, key_file.data(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        LOG_ERROR("SSL_CTX_use_PrivateKey_file(%s): %s", key_file.data(), lastError());
+        return false;
+    }
+
+    // 握手完成后尝试把记录加密交给内核(kTLS), 不支持时OpenSSL自动回退到用户态加密
+    SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+
+    // 非阻塞socket上允许部分写以及重试时缓冲区地址变化
+    SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                           SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                           SSL_MODE_RELEASE_BUFFERS);
+
+    // 会话恢复: TLS1.3以及TLS1.2使用无状态票据, 同时保留服务端会话缓存处理基于会话ID的恢复
+    SSL_CTX_set_session_id_context(ctx_, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx_, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx_, SESSION_TIMEOUT_SECONDS);
+    SSL_CTX_set_num_tickets(ctx_, SESSION_TICKETS_NUM);
+
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef HTTPSERVER_TLS_TLS_CONTEXT_H
+#define HTTPSERVER_TLS_TLS_CONTEXT_H
+
+#include <openssl/ssl.h>
+
+#include <string>
+
+// 服务端TLS配置: 证书, 会话恢复以及内核TLS卸载
+class TlsContext
+{
+public:
+    TlsContext()
+      : ctx_(nullptr)
+    {}
+
+    TlsContext(const TlsContext &) = delete;
+
+    TlsContext(TlsContext &&) = delete;
+
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    TlsContext &operator=(TlsContext &&) = delete;
+
+    ~TlsContext()
+    {
+        if (ctx_)
+        {
+            SSL_CTX_free(ctx_);
+        }
+    }
+
+public:
+    // 加载证书以及私钥, 失败返回false
+    bool init(const std::string &cert_file, const std::string &key_file);
+
+    SSL_CTX *get() const { return ctx_; }
+
+private:
+    static constexpr long SESSION_CACHE_SIZE = 20480;     // 服务端会话缓存的最大数目
+    static constexpr long SESSION_TIMEOUT_SECONDS = 3600; // 会话可以恢复的时间
+    static constexpr size_t SESSION_TICKETS_NUM = 2;      // TLS1.3握手后发送的会话票据数目
+
+    SSL_CTX *ctx_;
+};
+
+#endif
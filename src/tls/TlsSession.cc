@@ -0,0 +1,140 @@
+#include <tls/TlsSession.h>
+#include <logger/AsyncLogger.h>
+
+#include <openssl/err.h>
+
+#include <cerrno>
+
+TlsSession::TlsSession(SSL_CTX *ctx, int conn_sock)
+  : ssl_(SSL_new(ctx)),
+    established_(false),
+    ktls_send_(false),
+    failed_(false),
+    io_state_(HandshakeState::DONE)
+{
+    SSL_set_fd(ssl_, conn_sock);
+    SSL_set_accept_state(ssl_);
+}
+
+HandshakeState TlsSession::handshake()
+{
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1)
+    {
+        established_ = true;
+        ktls_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        LOG_DEBUG("tls handshake done, version: %s, resumed: %d, ktls: %d",
+                  SSL_get_version(ssl_), resumed(), ktls_send_);
+        return HandshakeState::DONE;
+    }
+    switch (SSL_get_error(ssl_, ret))
+    {
+        case SSL_ERROR_WANT_READ:
+        {
+            return HandshakeState::WANT_READ;
+        }
+        case SSL_ERROR_WANT_WRITE:
+        {
+            return HandshakeState::WANT_WRITE;
+        }
+        default:
+        {
+            LOG_DEBUG("SSL_do_handshake(): %s", ERR_reason_error_string(ERR_peek_error()));
+            return HandshakeState::FAILED;
+        }
+    }
+}
+
+ssize_t TlsSession::read(void *buf, size_t len)
+{
+    if (failed_)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    io_state_ = HandshakeState::DONE;
+    ERR_clear_error();
+    errno = 0;
+    int ret = SSL_read(ssl_, buf, static_cast<int>(len));
+    if (ret > 0)
+    {
+        return ret;
+    }
+    return translateError(ret);
+}
+
+ssize_t TlsSession::write(const void *buf, size_t len)
+{
+    if (failed_)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    io_state_ = HandshakeState::DONE;
+    ERR_clear_error();
+    errno = 0;
+    int ret = SSL_write(ssl_, buf, static_cast<int>(len));
+    if (ret > 0)
+    {
+        return ret;
+    }
+    // 与write(2)一致, 不返回0, 否则调用者会一直重试
+    ssize_t result = translateError(ret);
+    if (result == 0)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+    return result;
+}
+
+void TlsSession::shutdown()
+{
+    // 出现致命错误之后不能再调用SSL_shutdown()
+    if (established_ && !failed_)
+    {
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+    }
+}
+
+ssize_t TlsSession::translateError(int ret)
+{
+    switch (SSL_get_error(ssl_, ret))
+    {
+        case SSL_ERROR_ZERO_RETURN:
+        {
+            // 对端发送了close_notify
+            return 0;
+        }
+        case SSL_ERROR_WANT_READ:
+        {
+            io_state_ = HandshakeState::WANT_READ;
+            errno = EAGAIN;
+            return -1;
+        }
+        case SSL_ERROR_WANT_WRITE:
+        {
+            io_state_ = HandshakeState::WANT_WRITE;
+            errno = EAGAIN;
+            return -1;
+        }
+        case SSL_ERROR_SYSCALL:
+        {
+            // errno由底层系统调用设置, 对端直接关闭时errno为0
+            failed_ = true;
+            if (errno == 0)
+            {
+                return 0;
+            }
+            return -1;
+        }
+        default:
+        {
+            failed_ = true;
+            errno = EPROTO;
+            return -1;
+        }
+    }
+}
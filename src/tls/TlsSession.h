@@ -0,0 +1,77 @@
+#ifndef HTTPSERVER_TLS_TLS_SESSION_H
+#define HTTPSERVER_TLS_TLS_SESSION_H
+
+#include <openssl/ssl.h>
+
+#include <sys/types.h>
+
+// TLS握手的推进结果, 也用于表示读写需要等待的事件
+enum class HandshakeState
+{
+    DONE,        // 握手完成
+    WANT_READ,   // 等待socket可读
+    WANT_WRITE,  // 等待socket可写
+    FAILED,      // 握手失败, 需要关闭连接
+};
+
+// 单个连接上的TLS会话, 不拥有socket
+// read()/write()的返回值与read(2)/write(2)一致: 需要等待socket就绪时返回-1并将errno设置为EAGAIN
+// 出现致命错误之后SSL_read()/SSL_write()不再进行系统调用, 之后的read()/write()都返回-1并将errno设置为EPROTO
+class TlsSession
+{
+public:
+    TlsSession(SSL_CTX *ctx, int conn_sock);
+
+    TlsSession(const TlsSession &) = delete;
+
+    TlsSession(TlsSession &&) = delete;
+
+    TlsSession &operator=(const TlsSession &) = delete;
+
+    TlsSession &operator=(TlsSession &&) = delete;
+
+    ~TlsSession()
+    {
+        SSL_free(ssl_);
+    }
+
+public:
+    // 在非阻塞socket上推进握手
+    HandshakeState handshake();
+
+    // 握手是否完成
+    bool established() const { return established_; }
+
+    // 握手时是否复用了之前的会话
+    bool resumed() const { return SSL_session_reused(ssl_) == 1; }
+
+    // 记录加密是否已经卸载到内核, 卸载后可以直接对socket使用writev(2)/sendfile(2)
+    bool ktlsSend() const { return ktls_send_; }
+
+    // 上一次read()/write()返回EAGAIN时等待的事件, WANT_READ或者WANT_WRITE, 否则为DONE
+    // 读取时可能需要先发送数据(例如回应对端的密钥更新), 写入时也可能需要先读取
+    HandshakeState ioState() const { return io_state_; }
+
+    // 读取明文数据
+    ssize_t read(void *buf, size_t len);
+
+    // 写入明文数据, 可能只写入一部分
+    // 返回-1且errno为EAGAIN时, 必须用相同的数据重试
+    ssize_t write(const void *buf, size_t len);
+
+    // 发送close_notify, 不等待对端回应
+    void shutdown();
+
+private:
+    // 把SSL_get_error()的结果转换成errno
+    ssize_t translateError(int ret);
+
+private:
+    SSL *ssl_;
+    bool established_;
+    bool ktls_send_;
+    bool failed_;
+    HandshakeState io_state_;
+};
+
+#endif
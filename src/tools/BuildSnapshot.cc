@@ -0,0 +1,21 @@
+// 把静态资源目录打包成快照: BuildSnapshot <资源目录> <快照文件>
+// 通过 cmake --build <构建目录> --target snapshot 打包 resources 目录
+#include <snapshot/SnapshotBuilder.h>
+
+#include <cstdio>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::fprintf(stderr, "usage: %s <resources dir> <snapshot file>\n", argv[0]);
+        return 1;
+    }
+    SnapshotBuilder builder;
+    if (!builder.addDirectory(argv[1]) || !builder.write(argv[2]))
+    {
+        return 1;
+    }
+    std::printf("%zu assets packed into %s\n", builder.size(), argv[2]);
+    return 0;
+}
@@ -0,0 +1,40 @@
+// 把二进制日志文件解码成文本, 输出到标准输出: DecodeLog [-s] <日志文件>...
+// -s: 在每条日志后面加上输出日志的源文件和行号
+// 多个文件按参数的顺序解码, 每个文件可以单独解码
+#include <logger/LogDecoder.h>
+
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char *argv[])
+{
+    int first = 1;
+    bool show_source = false;
+    if (argc > 1 && std::strcmp(argv[1], "-s") == 0)
+    {
+        show_source = true;
+        ++first;
+    }
+    if (first >= argc)
+    {
+        std::fprintf(stderr, "usage: %s [-s] <log file>...\n", argv[0]);
+        return 1;
+    }
+    LogDecoder decoder(show_source);
+    int ret = 0;
+    for (int i = first; i < argc; ++i)
+    {
+        if (!decoder.decodeFile(argv[i], [](const std::string &line) {
+                std::fwrite(line.data(), 1, line.size(), stdout);
+                std::fputc('\n', stdout);
+            }))
+        {
+            ret = 1;
+        }
+    }
+    if (decoder.errors() > 0)
+    {
+        std::fprintf(stderr, "%zu records could not be decoded\n", decoder.errors());
+    }
+    return ret;
+}
@@ -0,0 +1,117 @@
+// 阻塞队列的吞吐量: 1~32个生产者, 一个消费者, 比较
+// -> BlockQueue(std::queue存储, 原来的实现)和BlockQueue<RingBuffer>
+// -> MpscQueue, 只有一个生产者时还有SpscQueue
+// 每种队列分别测试逐个put()/take()和每批64个的putAll()/drainTo(), 单位是百万个/秒
+// 用法: BenchBlockQueue [每种配置的元素总数, 默认1000000] [队列容量, 默认1024]
+#include <logger/BlockQueue.h>
+#include <logger/LockFreeQueue.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t BATCH = 64;
+
+template <typename T>
+struct QueueTag
+{
+    using type = T;
+};
+
+// 返回每秒处理的百万个元素, 消费者检查取出的总和防止被优化掉
+template <typename Queue>
+double run(int producers, long total, int capacity, bool batch)
+{
+    Queue queue(capacity);
+    long per_producer = total / producers;
+    total = per_producer * producers;
+    auto begin = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, per_producer, batch]() {
+            if (!batch)
+            {
+                for (long i = 0; i < per_producer; ++i)
+                {
+                    queue.put(i);
+                }
+                return;
+            }
+            vector<long> items;
+            for (long i = 0; i < per_producer; i += BATCH)
+            {
+                items.clear();
+                for (long j = i; j < min<long>(i + BATCH, per_producer); ++j)
+                {
+                    items.push_back(j);
+                }
+                queue.putAll(items.begin(), items.end());
+            }
+        });
+    }
+
+    long taken = 0;
+    long sum = 0;
+    vector<long> out;
+    out.reserve(capacity);
+    while (taken < total)
+    {
+        long item = 0;
+        queue.take(item);
+        sum += item;
+        ++taken;
+        if (batch)
+        {
+            out.clear();
+            queue.drainTo(out, BATCH);
+            for (long value : out)
+            {
+                sum += value;
+            }
+            taken += out.size();
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    long expected = (per_producer - 1) * per_producer / 2 * producers;
+    if (sum != expected)
+    {
+        printf("checksum mismatch\n");
+        exit(1);
+    }
+    return total / elapsed.count() / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    long total = argc > 1 ? atol(argv[1]) : 1000000;
+    int capacity = argc > 2 ? atoi(argv[2]) : 1024;
+    printf("%d cpus, %ld items, capacity %d, Mitems/s (single / batch of %zu)\n",
+           static_cast<int>(thread::hardware_concurrency()), total, capacity, BATCH);
+    printf("%-10s %-16s %-16s %-16s %-16s\n", "producers", "deque", "ring", "mpsc", "spsc");
+    for (int producers = 1; producers <= 32; producers *= 2)
+    {
+        auto cell = [&](auto tag) {
+            using Queue = typename decltype(tag)::type;
+            char text[32];
+            snprintf(text, sizeof(text), "%.2f / %.2f", run<Queue>(producers, total, capacity, false),
+                     run<Queue>(producers, total, capacity, true));
+            return string(text);
+        };
+        string deque = cell(QueueTag<BlockQueue<long>>());
+        string ring = cell(QueueTag<BlockQueue<long, RingBuffer<long>>>());
+        string mpsc = cell(QueueTag<MpscQueue<long>>());
+        string spsc = producers == 1 ? cell(QueueTag<SpscQueue<long>>()) : "-";
+        printf("%-10d %-16s %-16s %-16s %-16s\n", producers, deque.data(), ring.data(), mpsc.data(), spsc.data());
+    }
+    return 0;
+}
@@ -1,12 +1,24 @@
+// 测试异步日志: 多个线程同时输出日志, 检查所有日志都写入了文件, 并统计每条日志在调用线程上的平均耗时
+// binary模式下先用LogDecoder解码再检查
+// 用法: TestAsyncLogger [线程数, 默认3] [每个线程每个级别的日志数, 默认10000] [text|binary, 默认text]
 #include <logger/AsyncLogger.h>
+#include <logger/LogDecoder.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
 #include <thread>
-#include <unistd.h>
+#include <vector>
 
 using namespace std;
 
-void doLog()
+void doLog(int count, double *ns_per_log)
 {
-    for (int i = 0; i < 10000; ++i)
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
     {
         LOG_DEBUG("%s:%d:%s, %s", __FILE__, __LINE__, __PRETTY_FUNCTION__, to_string(i).data());
         LOG_INFO("%s:%d:%s, %s", __FILE__, __LINE__, __PRETTY_FUNCTION__, to_string(i).data());
@@ -14,19 +26,102 @@ void doLog()
         LOG_ERROR("%s:%d:%s, %s", __FILE__, __LINE__, __PRETTY_FUNCTION__, to_string(i).data());
         LOG_FATAL("%s:%d:%s, %s", __FILE__, __LINE__, __PRETTY_FUNCTION__, to_string(i).data());
     }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - begin;
+    *ns_per_log = elapsed.count() / (count * 5);
 }
 
-int main()
+int evaluated = 0;
+
+const char *sideEffect()
 {
-    auto &logger = AsyncLogger::getInstance();
-    logger.init(LogLevel::DEBUG, "./log", ".log", 1000, 1024);
-    thread t1(doLog), t2(doLog), t3(doLog);
+    ++evaluated;
+    return "evaluated";
+}
 
-    t1.join();
-    t2.join();
-    t3.join();
+// 日志目录中所有文件的行数, 二进制文件解码后计算, 每一行都应当包含expected
+long countLines(const string &log_path, bool binary, const string &expected)
+{
+    long lines = 0;
+    long mismatched = 0;
+    auto check = [&](const string &line) {
+        ++lines;
+        if (line.find(expected) == string::npos)
+        {
+            if (++mismatched == 1)
+            {
+                printf("unexpected line: %s\n", line.data());
+            }
+        }
+    };
+    LogDecoder decoder;
+    for (auto &entry : filesystem::directory_iterator(log_path))
+    {
+        if (binary)
+        {
+            decoder.decodeFile(entry.path(), check);
+            continue;
+        }
+        ifstream in(entry.path());
+        string line;
+        while (getline(in, line))
+        {
+            check(line);
+        }
+    }
+    return mismatched == 0 && decoder.errors() == 0 ? lines : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 3;
+    int count = argc > 2 ? atoi(argv[2]) : 10000;
+    bool binary = argc > 3 && string(argv[3]) == "binary";
+    const string log_path = "./log";
+    filesystem::remove_all(log_path);
+
+    // 没有开启日志时不计算参数
+    LOG_WARN("before init");
+    LOG_ERROR("before init: %s", sideEffect());
+
+    // 保留所有日志文件, 检查每一条日志
+    LogRotation rotation;
+    rotation.max_files = 0;
+    rotation.max_total_bytes = 0;
+    rotation.compress = false;
+    auto &logger = AsyncLogger::getInstance();
+    logger.setRotation(rotation);
+    logger.init(LogLevel::DEBUG, log_path, ".log", 1000, 1024, binary ? LogFormat::BINARY : LogFormat::TEXT);
+    vector<thread> workers;
+    vector<double> ns_per_log(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(doLog, count, &ns_per_log[i]);
+    }
+    for (auto &t : workers)
+    {
+        t.join();
+    }
 
     this_thread::sleep_for(chrono::seconds(1));
-    
+
+    double average = 0;
+    for (double ns : ns_per_log)
+    {
+        average += ns / threads;
+    }
+    long expected = 5L * count * threads;
+    long lines = countLines(log_path, binary, ":void doLog(int, double*), ");
+    printf("%s, %d threads, %ld logs: %.1f ns/log on the calling thread, %ld lines written\n",
+           binary ? "binary" : "text", threads, expected, average, lines);
+    if (lines != expected)
+    {
+        printf("FAILED: expected %ld lines\n", expected);
+        return 1;
+    }
+    if (evaluated != 0)
+    {
+        printf("FAILED: arguments of disabled logs were evaluated\n");
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,8 +1,14 @@
+// 测试阻塞队列: 先演示多个生产者和消费者, 再检查各种队列的
+// put(T&&)不复制, putAll()/drainTo()保持顺序, 带超时的take(), 以及多个生产者时没有丢失或者重复的元素
 #include <logger/BlockQueue.h>
+#include <logger/LockFreeQueue.h>
 
+#include <chrono>
+#include <cstdio>
 #include <string>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -32,11 +38,142 @@ void consume(BlockQueue<string> &block_queue)
     }
 }
 
+// 统计复制的次数
+struct Counted
+{
+    static int copies;
+
+    int value = 0;
+
+    Counted() = default;
+
+    explicit Counted(int v) : value(v) {}
+
+    Counted(const Counted &other) : value(other.value) { ++copies; }
+
+    Counted(Counted &&other) noexcept : value(other.value) {}
+
+    Counted &operator=(const Counted &other)
+    {
+        value = other.value;
+        ++copies;
+        return *this;
+    }
+
+    Counted &operator=(Counted &&other) noexcept
+    {
+        value = other.value;
+        return *this;
+    }
+};
+
+int Counted::copies = 0;
+
+bool failed = false;
+
+void expect(bool ok, const char *name, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s: %s\n", name, what);
+        failed = true;
+    }
+}
+
+template <typename Queue>
+void check(const char *name, int producers)
+{
+    {
+        Queue queue(16);
+        Counted::copies = 0;
+        Counted item(1);
+        queue.put(std::move(item));
+        queue.take(item);
+        expect(Counted::copies == 0 && item.value == 1, name, "put(T&&) copied the element");
+
+        // 超过容量的一批: putAll分多次放入, 消费者用drainTo取出
+        vector<Counted> batch;
+        for (int i = 0; i < 40; ++i)
+        {
+            batch.emplace_back(i);
+        }
+        vector<Counted> out;
+        thread producer([&]() {
+            queue.putAll(batch.begin(), batch.end());
+        });
+        while (out.size() < batch.size())
+        {
+            Counted first;
+            if (queue.take(first, 1000))
+            {
+                out.push_back(std::move(first));
+                queue.drainTo(out);
+            }
+        }
+        producer.join();
+        bool ordered = Counted::copies == 0;
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            ordered = ordered && out[i].value == static_cast<int>(i);
+        }
+        expect(ordered, name, "putAll()/drainTo() lost order or copied");
+
+        auto begin = chrono::steady_clock::now();
+        bool taken = queue.take(item, 50);
+        auto waited = chrono::steady_clock::now() - begin;
+        expect(!taken && waited >= chrono::milliseconds(50), name, "take() did not time out");
+    }
+
+    // 多个生产者, 一个消费者: 所有元素恰好取出一次
+    Queue queue(64);
+    const int count = 100000;
+    vector<thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < count; ++i)
+            {
+                queue.put(Counted(p * count + i));
+            }
+        });
+    }
+    vector<char> seen(static_cast<size_t>(producers) * count, 0);
+    long duplicates = 0;
+    vector<Counted> out;
+    for (size_t taken = 0; taken < seen.size();)
+    {
+        out.clear();
+        Counted first;
+        if (!queue.take(first, 1000))
+        {
+            break;
+        }
+        out.push_back(std::move(first));
+        queue.drainTo(out);
+        for (auto &c : out)
+        {
+            duplicates += seen[c.value]++ != 0;
+        }
+        taken += out.size();
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    long missing = 0;
+    for (char s : seen)
+    {
+        missing += s == 0;
+    }
+    expect(missing == 0 && duplicates == 0, name, "elements lost or duplicated");
+    printf("%s: %s\n", name, failed ? "FAILED" : "OK");
+}
+
 int main()
 {
     BlockQueue<string> block_queue(10);
 
-    vector<thread> producers(1);
+    vector<thread> producers(3);
     vector<thread> consumers(5);
     for (int i = 0; i < 3; ++i)
     {
@@ -56,5 +193,9 @@ int main()
         consumers[i].join();
     }
 
-    return 0;
-}
\ No newline at end of file
+    check<BlockQueue<Counted>>("BlockQueue", 4);
+    check<BlockQueue<Counted, RingBuffer<Counted>>>("BlockQueue<RingBuffer>", 4);
+    check<SpscQueue<Counted>>("SpscQueue", 1);
+    check<MpscQueue<Counted>>("MpscQueue", 4);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+// 测试HTTPS监听: 自签名证书, 通过回环地址连接两次, 第二次连接使用第一次得到的会话票据, 必须复用会话
+// 每次检查收到完整的响应, 并根据/proc/net/tls_stat报告服务器是用kTLS发送还是回退到用户态加密
+// 最后完成TLS 1.3握手之后发送一个无法解密的记录, 服务器应该关闭连接
+// 先执行 test/gen_cert.sh 生成证书, 再启动 HttpServer
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include <openssl/rand.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+int connectServer()
+{
+    struct sockaddr_in server_addr = {0};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = ::htons(3334);
+    ::inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+    int ret = ::connect(sock, (struct sockaddr *)(&server_addr), sizeof(server_addr));
+    assert(ret >= 0);
+    return sock;
+}
+
+// 内核建立过的kTLS发送端的数目(软件加密和网卡卸载), 内核没有加载tls模块时返回-1
+// 客户端没有开启kTLS, 请求前后的差值来自服务器
+long ktlsTxCount()
+{
+    std::ifstream in("/proc/net/tls_stat");
+    if (!in)
+    {
+        return -1;
+    }
+    long count = 0;
+    std::string name;
+    long value = 0;
+    while (in >> name >> value)
+    {
+        if (name == "TlsTxSw" || name == "TlsTxDevice")
+        {
+            count += value;
+        }
+    }
+    return count;
+}
+
+// 响应是200并且主体的长度等于Content-Length
+bool completeResponse(const std::string &response)
+{
+    size_t header_end = response.find("\r\n\r\n");
+    size_t length_pos = response.find("Content-Length: ");
+    if (response.compare(0, 12, "HTTP/1.1 200") != 0 || header_end == std::string::npos ||
+        length_pos == std::string::npos || length_pos > header_end)
+    {
+        return false;
+    }
+    size_t length = std::strtoul(response.data() + length_pos + 16, nullptr, 10);
+    return response.size() - header_end - 4 == length;
+}
+
+// 发送一次请求并读取完整响应, 返回连接使用的会话, 响应不完整时返回nullptr
+// resumed返回这次连接是否复用了session
+SSL_SESSION *request(SSL_CTX *ctx, SSL_SESSION *session, bool *resumed)
+{
+    long ktls_before = ktlsTxCount();
+    int sock = connectServer();
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, sock);
+    if (session)
+    {
+        SSL_set_session(ssl, session);
+    }
+    if (SSL_connect(ssl) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        return nullptr;
+    }
+
+    const char *msg = "GET /index.html HTTP/1.1\r\n"
+                      "Host: 127.0.0.1\r\n"
+                      "\r\n";
+    SSL_write(ssl, msg, std::strlen(msg));
+
+    std::string response;
+    char buffer[1024];
+    while (true)
+    {
+        int recv_len = SSL_read(ssl, buffer, sizeof(buffer));
+        if (recv_len <= 0)
+        {
+            break;
+        }
+        response.append(buffer, recv_len);
+    }
+    printf("%s", response.data());
+    *resumed = SSL_session_reused(ssl) == 1;
+    printf("\nversion: %s, cipher: %s, resumed: %d\n", SSL_get_version(ssl), SSL_get_cipher(ssl), *resumed);
+
+    long ktls_after = ktlsTxCount();
+    printf("send path: %s\n", ktls_before < 0 ? "userspace (kernel tls module not loaded)" :
+                              ktls_after > ktls_before ? "ktls" : "userspace");
+
+    SSL_SESSION *new_session = SSL_get1_session(ssl);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    ::close(sock);
+    if (!completeResponse(response))
+    {
+        printf("FAILED: incomplete response\n");
+        SSL_SESSION_free(new_session);
+        return nullptr;
+    }
+    return new_session;
+}
+
+// 握手之后直接在socket上发送一个长度为64字节的application_data记录, 内容是随机数据
+// 服务器解密失败后应该关闭连接, 5秒内没有关闭视为失败
+bool badRecord(SSL_CTX *ctx)
+{
+    int sock = connectServer();
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, sock);
+    SSL_set_min_proto_version(ssl, TLS1_3_VERSION);
+    if (SSL_connect(ssl) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+
+    unsigned char record[5 + 64] = {0x17, 0x03, 0x03, 0x00, 0x40};
+    RAND_bytes(record + 5, 64);
+    ssize_t sent = ::send(sock, record, sizeof(record), 0);
+    assert(sent == static_cast<ssize_t>(sizeof(record)));
+
+    struct timeval timeout = {5, 0};
+    ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // 丢弃会话票据和警报, 直到对端关闭
+    bool closed = false;
+    char buffer[1024];
+    while (true)
+    {
+        ssize_t recv_len = ::recv(sock, buffer, sizeof(buffer), 0);
+        if (recv_len > 0)
+        {
+            continue;
+        }
+        closed = recv_len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+    printf("bad record: connection %s\n", closed ? "closed" : "still open");
+
+    SSL_free(ssl);
+    ::close(sock);
+    return closed;
+}
+
+int main()
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    // 自签名证书, 不校验服务端证书
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+
+    bool resumed = false;
+    SSL_SESSION *session = request(ctx, nullptr, &resumed);
+    if (!session)
+    {
+        return 1;
+    }
+    SSL_SESSION *second = request(ctx, session, &resumed);
+    if (!second)
+    {
+        return 1;
+    }
+    if (!resumed)
+    {
+        printf("FAILED: second connection did not resume the session\n");
+        return 1;
+    }
+
+    bool closed = badRecord(ctx);
+
+    SSL_SESSION_free(session);
+    SSL_SESSION_free(second);
+    SSL_CTX_free(ctx);
+    return closed ? 0 : 1;
+}
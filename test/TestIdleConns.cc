@@ -0,0 +1,129 @@
+// 测试空闲的持久连接占用的内存: 建立大量keep-alive连接, 每个连接发送一个带有较大请求头的请求并读完响应,
+// 然后保持连接空闲, 比较建立连接前后服务器的常驻内存(VmRSS)
+// 用法: TestIdleConns <服务器进程号> [连接数目, 默认10000]
+// 连接数目受 ulimit -n 限制, 服务器也需要足够的文件描述符
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// 读取进程的常驻内存(KiB)
+long readRssKiB(int pid)
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *fp = std::fopen(path, "r");
+    if (!fp)
+    {
+        std::perror("fopen()");
+        std::exit(1);
+    }
+    char line[256];
+    long rss = -1;
+    while (std::fgets(line, sizeof(line), fp))
+    {
+        if (std::sscanf(line, "VmRSS: %ld kB", &rss) == 1)
+        {
+            break;
+        }
+    }
+    std::fclose(fp);
+    return rss;
+}
+
+// 读完一个带有Content-Length的响应
+bool readResponse(int sock)
+{
+    std::string response;
+    char buffer[4096];
+    size_t total = std::string::npos;
+    while (response.size() < total)
+    {
+        ssize_t recv_len = ::recv(sock, buffer, sizeof(buffer), 0);
+        if (recv_len <= 0)
+        {
+            return false;
+        }
+        response.append(buffer, recv_len);
+        auto head_end = response.find("\r\n\r\n");
+        auto length_pos = response.find("Content-Length: ");
+        if (total == std::string::npos && head_end != std::string::npos && length_pos != std::string::npos)
+        {
+            total = head_end + 4 + std::atol(response.c_str() + length_pos + 16);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <server pid> [connections]\n", argv[0]);
+        return 1;
+    }
+    int pid = std::atoi(argv[1]);
+    int conns_num = argc > 2 ? std::atoi(argv[2]) : 10000;
+
+    struct sockaddr_in server_addr = {0};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = ::htons(3333);
+    ::inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+
+    // 8KiB左右的请求头, 让服务器的缓冲区先增长到较高的水位
+    std::string msg = "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1:3333\r\nConnection: keep-alive\r\n";
+    for (int i = 0; i < 64; ++i)
+    {
+        msg += "X-Padding-" + std::to_string(i) + ": " + std::string(120, 'x') + "\r\n";
+    }
+    msg += "\r\n";
+
+    long rss_before = readRssKiB(pid);
+    std::vector<int> socks;
+    for (int i = 0; i < conns_num; ++i)
+    {
+        int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0)
+        {
+            std::perror("::socket()");
+            break;
+        }
+        if (::connect(sock, (struct sockaddr *)(&server_addr), sizeof(server_addr)) < 0)
+        {
+            std::perror("::connect()");
+            ::close(sock);
+            break;
+        }
+        ssize_t send_len = ::send(sock, msg.data(), msg.size(), 0);
+        assert(send_len == static_cast<ssize_t>(msg.size()));
+        if (!readResponse(sock))
+        {
+            std::fprintf(stderr, "connection %d closed by server\n", i);
+            ::close(sock);
+            break;
+        }
+        socks.push_back(sock);
+    }
+    // 等服务器处理完所有连接
+    ::sleep(1);
+    long rss_after = readRssKiB(pid);
+
+    std::printf("idle connections: %zu\n", socks.size());
+    std::printf("server rss before: %ld KiB, after: %ld KiB\n", rss_before, rss_after);
+    if (!socks.empty())
+    {
+        std::printf("rss per idle connection: %.1f bytes\n",
+                    (rss_after - rss_before) * 1024.0 / socks.size());
+    }
+    for (int sock : socks)
+    {
+        ::close(sock);
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+// 测试日志缓冲区满时的处理方式: 多个线程用很小的缓冲区连续输出日志, 使后台线程写文件跟不上
+// 检查写入的日志条数加上丢弃的条数等于输出的条数, 每一行都完整, 日志中报告的丢弃条数与dropStats()一致
+// level模式下检查丢弃了DEBUG日志, 而ERROR几乎没有丢弃(不超过0.1%)
+// 用法: TestLogOverflow [block|newest|oldest|level, 默认level] [每个线程的循环次数, 默认100000] [text|binary, 默认text]
+#include <logger/AsyncLogger.h>
+#include <logger/LogDecoder.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr int THREADS = 4;
+
+// 每次循环输出DEBUG和INFO各一条, 每10次输出一条ERROR
+void doLog(int count, double *max_us)
+{
+    double worst = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        auto begin = chrono::steady_clock::now();
+        LOG_DEBUG("overflow test debug %d, padding padding padding padding padding", i);
+        LOG_INFO("overflow test info %d, padding padding padding padding padding", i);
+        if (i % 10 == 0)
+        {
+            LOG_ERROR("overflow test error %d, padding padding padding padding padding", i);
+        }
+        chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - begin;
+        worst = max(worst, elapsed.count());
+    }
+    *max_us = worst;
+}
+
+int main(int argc, char *argv[])
+{
+    string mode = argc > 1 ? argv[1] : "level";
+    int count = argc > 2 ? atoi(argv[2]) : 100000;
+    bool binary = argc > 3 && string(argv[3]) == "binary";
+    LogOverflow overflow = mode == "block" ? LogOverflow::BLOCK :
+                           mode == "newest" ? LogOverflow::DROP_NEWEST :
+                           mode == "oldest" ? LogOverflow::DROP_OLDEST : LogOverflow::DROP_BY_LEVEL;
+    const string log_path = "./log_overflow";
+    filesystem::remove_all(log_path);
+
+    LogRotation rotation;
+    rotation.max_files = 0;
+    rotation.max_total_bytes = 0;
+    rotation.compress = false;
+    auto &logger = AsyncLogger::getInstance();
+    logger.setRotation(rotation);
+    logger.setOverflow(overflow);
+    // 每个线程16KiB的缓冲区
+    logger.init(LogLevel::DEBUG, log_path, ".log", 0, 1, binary ? LogFormat::BINARY : LogFormat::TEXT);
+
+    auto begin = chrono::steady_clock::now();
+    vector<thread> workers;
+    vector<double> max_us(THREADS);
+    for (int i = 0; i < THREADS; ++i)
+    {
+        workers.emplace_back(doLog, count, &max_us[i]);
+    }
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - begin;
+
+    // 等待写完, 并且超过报告间隔, 最后一批丢弃的条数也写入日志
+    this_thread::sleep_for(chrono::milliseconds(AsyncLogger::DROP_REPORT_INTERVAL_MS + 500));
+    LogDropStats drops = logger.dropStats();
+
+    long lines = 0;
+    long malformed = 0;
+    unsigned long reported = 0;
+    auto check = [&](const string &line) {
+        size_t pos = line.find("logger dropped ");
+        if (pos != string::npos)
+        {
+            reported += strtoul(line.data() + pos + 15, nullptr, 10);
+            return;
+        }
+        ++lines;
+        if (line.compare(0, 2, "20") != 0 || line.find("] : overflow test ") == string::npos ||
+            line.find("padding padding padding padding padding") == string::npos)
+        {
+            if (++malformed == 1)
+            {
+                printf("malformed line: %s\n", line.data());
+            }
+        }
+    };
+    LogDecoder decoder;
+    for (auto &entry : filesystem::directory_iterator(log_path))
+    {
+        if (binary)
+        {
+            decoder.decodeFile(entry.path(), check);
+            continue;
+        }
+        ifstream in(entry.path());
+        string line;
+        while (getline(in, line))
+        {
+            check(line);
+        }
+    }
+
+    long logged = THREADS * (2L * count + (count + 9) / 10);
+    long dropped = static_cast<long>(drops.total());
+    double worst = *max_element(max_us.begin(), max_us.end());
+    printf("%s, %s: %ld logs in %.1f ms, max %.1f us per loop, %ld written, %ld dropped "
+           "(debug:%lu info:%lu warn:%lu error:%lu fatal:%lu), %lu reported\n",
+           mode.data(), binary ? "binary" : "text", logged, elapsed.count(), worst, lines, dropped,
+           drops.dropped[0], drops.dropped[1], drops.dropped[2], drops.dropped[3], drops.dropped[4], reported);
+
+    bool ok = true;
+    if (malformed > 0 || decoder.errors() > 0)
+    {
+        printf("FAILED: %ld malformed lines\n", malformed);
+        ok = false;
+    }
+    if (lines + dropped != logged)
+    {
+        printf("FAILED: written + dropped != logged\n");
+        ok = false;
+    }
+    if (reported != drops.total())
+    {
+        printf("FAILED: reported drops do not match dropStats()\n");
+        ok = false;
+    }
+    if (overflow == LogOverflow::BLOCK && dropped != 0)
+    {
+        printf("FAILED: block mode dropped logs\n");
+        ok = false;
+    }
+    // WARN以上的日志只挤掉DEBUG/INFO, 只有等待后台线程写出超时才会丢弃
+    long errors = THREADS * ((count + 9) / 10);
+    if (overflow == LogOverflow::DROP_BY_LEVEL &&
+        (drops.dropped[0] == 0 || static_cast<long>(drops.dropped[3]) * 1000 > errors))
+    {
+        printf("FAILED: errors were dropped while debug logs were shed\n");
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
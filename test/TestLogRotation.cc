@@ -0,0 +1,87 @@
+// 测试日志文件按大小分割, 压缩以及保留策略:
+// 写入远超过保留数目的日志后, 检查只保留了max_files个文件, 不再写入的文件都被压缩,
+// 每个文件解压后不超过max_file_bytes, 最后一条日志在正在写入的文件中
+// 用法: TestLogRotation [日志条数, 默认200000]
+#include <logger/AsyncLogger.h>
+
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// 读取(压缩过的)文件的全部内容
+string readAll(const string &path)
+{
+    string data;
+    gzFile in = gzopen(path.data(), "rb");
+    char chunk[64 * 1024];
+    int read_len;
+    while (in && (read_len = gzread(in, chunk, sizeof(chunk))) > 0)
+    {
+        data.append(chunk, read_len);
+    }
+    if (in)
+    {
+        gzclose(in);
+    }
+    return data;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    const string log_path = "./log_rotation";
+    filesystem::remove_all(log_path);
+
+    LogRotation rotation;
+    rotation.max_file_bytes = 1024 * 1024;
+    rotation.max_files = 6;
+    rotation.compress = true;
+    auto &logger = AsyncLogger::getInstance();
+    logger.setRotation(rotation);
+    logger.init(LogLevel::DEBUG, log_path, ".log", 0, 1024);
+
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        LOG_INFO("rotation test line %d, some padding to make the line about one hundred bytes long", i);
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - begin;
+
+    // 等待写入, 压缩和清理
+    this_thread::sleep_for(chrono::seconds(2));
+
+    int files = 0;
+    int compressed = 0;
+    size_t max_size = 0;
+    size_t disk_bytes = 0;
+    bool found_last = false;
+    string last = "rotation test line " + to_string(count - 1) + ",";
+    for (auto &entry : filesystem::directory_iterator(log_path))
+    {
+        string path = entry.path();
+        ++files;
+        compressed += path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+        string data = readAll(path);
+        max_size = max(max_size, data.size());
+        found_last = found_last || data.find(last) != string::npos;
+        struct stat file_stat;
+        ::stat(path.data(), &file_stat);
+        disk_bytes += file_stat.st_blocks * 512;
+    }
+    printf("%d logs: %.1f ns/log, %d files kept (%d compressed), largest %zu bytes, %zu bytes on disk\n",
+           count, elapsed.count() / count, files, compressed, max_size, disk_bytes);
+    if (files > rotation.max_files || compressed != files - 1 || max_size > rotation.max_file_bytes || !found_last)
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+// 测试大文件下载对小文件请求延迟的影响: 先在没有其它负载时测量小文件请求的延迟,
+// 再在多个客户端不断下载大文件的同时测量一次, 比较两次的p50/p99
+// 服务器把剩余数据较多的响应按BULK优先级调度, 并且每个任务最多发送WRITE_BUDGET字节, 小文件的p99应当基本不变
+// 用法: TestMixedLoad <大文件路径, 如/big.bin> [下载大文件的客户端数, 默认8] [小文件请求数, 默认2000]
+// 大文件需要预先放在资源目录中, 例如: head -c 30000000 /dev/urandom > resources/big.bin
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+int connectServer()
+{
+    struct sockaddr_in server_addr = {0};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = ::htons(3333);
+    ::inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || ::connect(sock, (struct sockaddr *)(&server_addr), sizeof(server_addr)) < 0)
+    {
+        std::perror("::connect()");
+        std::exit(1);
+    }
+    return sock;
+}
+
+// 读完一个带有Content-Length的响应, 主体直接丢弃
+bool readResponse(int sock)
+{
+    std::string head;
+    char buffer[64 * 1024];
+    size_t body_left = 0;
+    while (true)
+    {
+        ssize_t recv_len = ::recv(sock, buffer, sizeof(buffer), 0);
+        if (recv_len <= 0)
+        {
+            return false;
+        }
+        head.append(buffer, recv_len);
+        auto head_end = head.find("\r\n\r\n");
+        if (head_end != std::string::npos)
+        {
+            auto length_pos = head.find("Content-Length: ");
+            size_t total = std::atol(head.c_str() + length_pos + 16);
+            size_t received = head.size() - head_end - 4;
+            body_left = total > received ? total - received : 0;
+            break;
+        }
+    }
+    while (body_left > 0)
+    {
+        ssize_t recv_len = ::recv(sock, buffer, std::min(sizeof(buffer), body_left), 0);
+        if (recv_len <= 0)
+        {
+            return false;
+        }
+        body_left -= recv_len;
+    }
+    return true;
+}
+
+bool request(int sock, const std::string &msg)
+{
+    return ::send(sock, msg.data(), msg.size(), 0) == static_cast<ssize_t>(msg.size()) && readResponse(sock);
+}
+
+std::string makeRequest(const char *path)
+{
+    return std::string("GET ") + path + " HTTP/1.1\r\nHost: 127.0.0.1:3333\r\nConnection: keep-alive\r\n\r\n";
+}
+
+// 在一个持久连接上依次请求小文件, 返回每个请求的延迟(微秒), 从小到大排列
+std::vector<long> measureSmall(int requests)
+{
+    std::string msg = makeRequest("/index.html");
+    std::vector<long> latencies;
+    latencies.reserve(requests);
+    int sock = connectServer();
+    for (int i = 0; i < requests; ++i)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        if (!request(sock, msg))
+        {
+            std::fprintf(stderr, "small request %d failed\n", i);
+            break;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+    ::close(sock);
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+long percentile(const std::vector<long> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return -1;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p))];
+}
+
+void report(const char *name, const std::vector<long> &latencies)
+{
+    std::printf("%-12s requests:%6zu p50:%7ldus p99:%7ldus max:%7ldus\n", name, latencies.size(),
+                percentile(latencies, 0.5), percentile(latencies, 0.99), latencies.empty() ? -1 : latencies.back());
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <large file path> [bulk clients] [small requests]\n", argv[0]);
+        return 1;
+    }
+    std::string bulk_msg = makeRequest(argv[1]);
+    int bulk_clients = argc > 2 ? std::atoi(argv[2]) : 8;
+    int requests = argc > 3 ? std::atoi(argv[3]) : 2000;
+
+    std::vector<long> idle = measureSmall(requests);
+
+    std::atomic<bool> running(true);
+    std::atomic<long> downloads(0);
+    std::vector<std::thread> bulk_threads;
+    for (int i = 0; i < bulk_clients; ++i)
+    {
+        bulk_threads.emplace_back([&]() {
+            int sock = connectServer();
+            while (running.load() && request(sock, bulk_msg))
+            {
+                downloads.fetch_add(1);
+            }
+            ::close(sock);
+        });
+    }
+    // 等大文件的发送进入稳定状态
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto begin = std::chrono::steady_clock::now();
+    long downloads_before = downloads.load();
+    std::vector<long> loaded = measureSmall(requests);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    long bulk_done = downloads.load() - downloads_before;
+    running.store(false);
+    for (auto &t : bulk_threads)
+    {
+        t.join();
+    }
+
+    report("idle", idle);
+    report("bulk load", loaded);
+    std::printf("large file downloads during measurement: %ld (%.1f/s)\n", bulk_done, bulk_done / elapsed.count());
+    return 0;
+}
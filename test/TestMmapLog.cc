@@ -0,0 +1,134 @@
+// 测试映射文件的日志(LogSink::MMAP): 子进程输出日志, 调用sync()之后被SIGKILL杀死,
+// 检查sync()之前输出的日志都在文件中并且完整, 跨过多个映射块和多个日志文件
+// 同时输出两种写文件方式下从开始输出到sync()返回的耗时
+// 用法: TestMmapLog [text|binary, 默认text] [每个线程的日志数, 默认100000]
+#include <logger/AsyncLogger.h>
+#include <logger/LogDecoder.h>
+
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr int THREADS = 2;
+
+void doLog(int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        LOG_INFO("mmap test line %d, padding padding padding padding padding padding", i);
+    }
+}
+
+// 输出日志, 等待写出后被杀死, 不执行任何析构函数
+void runChild(const string &log_path, int count, bool binary, LogSink sink)
+{
+    LogRotation rotation;
+    rotation.max_file_bytes = 6 * 1024 * 1024;
+    rotation.max_files = 0;
+    rotation.max_total_bytes = 0;
+    rotation.compress = false;
+    auto &logger = AsyncLogger::getInstance();
+    logger.setRotation(rotation);
+    logger.setSink(sink);
+    logger.init(LogLevel::DEBUG, log_path, ".log", 0, 1024, binary ? LogFormat::BINARY : LogFormat::TEXT);
+
+    auto begin = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int i = 0; i < THREADS; ++i)
+    {
+        workers.emplace_back(doLog, count);
+    }
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+    logger.sync();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - begin;
+    printf("%s sink: %d logs written and synced in %.1f ms\n",
+           sink == LogSink::MMAP ? "mmap" : "write", THREADS * count, elapsed.count());
+    fflush(stdout);
+    kill(getpid(), SIGKILL);
+}
+
+int main(int argc, char *argv[])
+{
+    bool binary = argc > 1 && string(argv[1]) == "binary";
+    int count = argc > 2 ? atoi(argv[2]) : 100000;
+    const string log_path = "./log_mmap";
+
+    int result = 0;
+    for (LogSink sink : {LogSink::WRITE, LogSink::MMAP})
+    {
+        filesystem::remove_all(log_path);
+        // 子进程会继承还没有输出的stdout缓冲区
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            runChild(log_path, count, binary, sink);
+            _exit(1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL)
+        {
+            printf("FAILED: child did not reach sync()\n");
+            return 1;
+        }
+
+        // 被杀死时正在写入的文件末尾是映射时填充的0
+        long lines = 0;
+        long malformed = 0;
+        auto check = [&](const string &line) {
+            if (line.empty() || line[0] == '\0')
+            {
+                return;
+            }
+            ++lines;
+            if (line.find("[INFO] : mmap test line ") == string::npos ||
+                line.find("padding padding padding padding padding padding") == string::npos)
+            {
+                if (++malformed == 1)
+                {
+                    printf("malformed line: %s\n", line.data());
+                }
+            }
+        };
+        LogDecoder decoder;
+        int files = 0;
+        for (auto &entry : filesystem::directory_iterator(log_path))
+        {
+            ++files;
+            if (binary)
+            {
+                decoder.decodeFile(entry.path(), check);
+                continue;
+            }
+            ifstream in(entry.path());
+            string line;
+            while (getline(in, line))
+            {
+                check(line);
+            }
+        }
+        printf("%s sink: %d files, %ld lines after SIGKILL\n", sink == LogSink::MMAP ? "mmap" : "write", files, lines);
+        if (lines != static_cast<long>(THREADS) * count || malformed > 0 || decoder.errors() > 0)
+        {
+            printf("FAILED: expected %ld complete lines\n", static_cast<long>(THREADS) * count);
+            result = 1;
+        }
+    }
+    filesystem::remove_all(log_path);
+    return result;
+}
@@ -0,0 +1,122 @@
+// 测试持久连接稳定运行时处理请求不分配内存: 替换全局的operator new/delete统计调用次数,
+// 通过socketpair(2)直接驱动HttpConn, 预热之后反复处理keep-alive请求, 期间不应该有任何分配
+// 用法: 在test目录下运行TestRequestAlloc, 与服务器一样从 ../resources 读取静态资源
+#include <http/HttpConn.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// 发送一个请求, 处理后读出完整的响应, 返回响应的字节数
+size_t roundTrip(HttpConn &conn, int client, const char *request)
+{
+    size_t len = std::strlen(request);
+    ssize_t send_len = ::send(client, request, len, 0);
+    assert(send_len == static_cast<ssize_t>(len));
+    bool parsed = conn.processRequest();
+    assert(parsed);
+    conn.setResponse();
+    bool sent = conn.processResponse();
+    assert(sent);
+    (void)send_len;
+    (void)parsed;
+    (void)sent;
+
+    static char response[64 * 1024];
+    size_t total = 0;
+    ssize_t read_len;
+    while ((read_len = ::recv(client, response, sizeof(response), 0)) > 0)
+    {
+        total += read_len;
+    }
+    return total;
+}
+
+int main()
+{
+    int sv[2];
+    int ret = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+    assert(ret == 0);
+    (void)ret;
+
+    const char *requests[] = {
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "User-Agent: TestRequestAlloc\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+        "GET /bench.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+        "GET /missing.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+    };
+    constexpr int WARMUP_ROUNDS = 16;
+    constexpr int ROUNDS = 10000;
+
+    size_t bytes = 0;
+    {
+        HttpConn conn(sv[0], {}, true);
+        for (int i = 0; i < WARMUP_ROUNDS; ++i)
+        {
+            for (const char *request : requests)
+            {
+                bytes += roundTrip(conn, sv[1], request);
+            }
+        }
+        size_t before = allocations.load();
+        for (int i = 0; i < ROUNDS; ++i)
+        {
+            for (const char *request : requests)
+            {
+                bytes += roundTrip(conn, sv[1], request);
+            }
+        }
+        size_t after = allocations.load();
+
+        std::printf("requests: %d, response bytes: %zu, allocations: %zu\n",
+                    ROUNDS * 3, bytes, after - before);
+        if (after != before)
+        {
+            std::printf("FAILED: steady-state keep-alive requests allocated memory\n");
+            return 1;
+        }
+    }
+    ::close(sv[1]);
+    std::printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,439 @@
+// 线程池吞吐量测试: 对比单个互斥锁队列的线程池(原来的实现)和工作窃取线程池
+// -> inject: 主线程(相当于事件循环)提交大量小任务
+// -> spawn:  每个任务在工作线程上再提交一批子任务(本地队列)
+// -> batch:  主线程每次通过addTasks()提交一批任务, 相当于事件循环一次epoll_wait(2)的就绪连接
+// 开始前检查预热之后提交和执行任务不分配内存, 以及线程数随阻塞任务伸缩, 按优先级加权取出任务,
+// 丢弃已经取消或者过期的任务, 反复唤醒空闲线程时空闲线程数不超过线程数, shutdown()之后不再执行任务
+// 用法: TestThreadPool [最大线程数, 默认64] [任务数, 默认1000000]
+#include <pool/ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <thread>
+#include <vector>
+
+std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// 原来的线程池: 一个任务队列, 一个互斥锁和条件变量
+class MutexThreadPool
+{
+public:
+    explicit MutexThreadPool(int threads_num)
+      : running_(true)
+    {
+        for (int i = 0; i < threads_num; ++i)
+        {
+            threads_.emplace_back(&MutexThreadPool::threadFunc, this);
+        }
+    }
+
+    ~MutexThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            running_ = false;
+        }
+        cond_.notify_all();
+        for (auto &t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    template <typename F>
+    void addTask(F &&task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            task_queue_.emplace(std::forward<F>(task));
+        }
+        cond_.notify_one();
+    }
+
+private:
+    void threadFunc()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> guard(lock_);
+                while (task_queue_.empty() && running_)
+                {
+                    cond_.wait(guard);
+                }
+                if (!running_)
+                {
+                    break;
+                }
+                task = std::move(task_queue_.front());
+                task_queue_.pop();
+            }
+            task();
+        }
+    }
+
+    bool running_;
+    std::mutex lock_;
+    std::condition_variable cond_;
+    std::queue<std::function<void()>> task_queue_;
+    std::vector<std::thread> threads_;
+};
+
+// 模拟处理一个事件的少量计算
+void work()
+{
+    volatile unsigned x = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        x = x + i;
+    }
+}
+
+void waitDone(const std::atomic<long> &done, long total)
+{
+    while (done.load(std::memory_order_acquire) < total)
+    {
+        std::this_thread::yield();
+    }
+}
+
+// 主线程提交total个任务, 返回每秒完成的任务数
+template <typename Pool>
+double benchInject(Pool &pool, long total)
+{
+    std::atomic<long> done(0);
+    auto begin = std::chrono::steady_clock::now();
+    for (long i = 0; i < total; ++i)
+    {
+        pool.addTask([&done]() {
+            work();
+            done.fetch_add(1, std::memory_order_release);
+        });
+    }
+    waitDone(done, total);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return total / elapsed.count();
+}
+
+// 主线程提交total / FANOUT个任务, 每个任务在工作线程上再提交FANOUT - 1个子任务
+template <typename Pool>
+double benchSpawn(Pool &pool, long total)
+{
+    constexpr long FANOUT = 64;
+    long roots = total / FANOUT;
+    std::atomic<long> done(0);
+    auto begin = std::chrono::steady_clock::now();
+    for (long i = 0; i < roots; ++i)
+    {
+        pool.addTask([&pool, &done]() {
+            for (long j = 1; j < FANOUT; ++j)
+            {
+                pool.addTask([&done]() {
+                    work();
+                    done.fetch_add(1, std::memory_order_release);
+                });
+            }
+            work();
+            done.fetch_add(1, std::memory_order_release);
+        });
+    }
+    waitDone(done, roots * FANOUT);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return roots * FANOUT / elapsed.count();
+}
+
+// 主线程每次提交BATCH个任务
+double benchBatch(ThreadPool &pool, long total)
+{
+    constexpr long BATCH = 64;
+    std::atomic<long> done(0);
+    Task tasks[BATCH];
+    auto begin = std::chrono::steady_clock::now();
+    for (long i = 0; i < total; i += BATCH)
+    {
+        for (long j = 0; j < BATCH; ++j)
+        {
+            tasks[j] = Task([&done]() {
+                work();
+                done.fetch_add(1, std::memory_order_release);
+            });
+        }
+        pool.addTasks(tasks, BATCH);
+    }
+    waitDone(done, (total + BATCH - 1) / BATCH * BATCH);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return total / elapsed.count();
+}
+
+// 与服务器的任务捕获相同的内容: this指针以及连接的weak_ptr
+// 与事件循环一样每轮提交一批任务, 队列长度有上限, 预热之后队列和任务节点都不再增长
+bool checkNoAllocation(int threads)
+{
+    constexpr long BATCH = 256;
+    constexpr long ROUNDS = 2000;
+    ThreadPool pool(threads);
+    auto p_conn = std::make_shared<int>(0);
+    std::weak_ptr<int> wp_conn = p_conn;
+    std::atomic<long> done(0);
+    long submitted = 0;
+    auto run = [&](long rounds) {
+        for (long r = 0; r < rounds; ++r)
+        {
+            for (long i = 0; i < BATCH; ++i)
+            {
+                pool.addTask([&done, wp_conn]() {
+                    if (auto p = wp_conn.lock())
+                    {
+                        done.fetch_add(1, std::memory_order_release);
+                    }
+                });
+            }
+            submitted += BATCH;
+            waitDone(done, submitted);
+        }
+    };
+    run(ROUNDS);
+    size_t before = allocations.load();
+    run(ROUNDS);
+    size_t after = allocations.load();
+    std::printf("allocations for %ld tasks on %d threads: %zu\n", ROUNDS * BATCH, threads, after - before);
+    return after == before;
+}
+
+// 阻塞的任务让线程池扩容, 空闲后缩回下限
+bool checkElastic()
+{
+    ThreadPool pool(1, 8, std::chrono::milliseconds(200));
+    std::atomic<long> done(0);
+    for (int i = 0; i < 64; ++i)
+    {
+        pool.addTask([&done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            done.fetch_add(1, std::memory_order_release);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    waitDone(done, 64);
+    ThreadPoolStats busy = pool.stats();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ThreadPoolStats idle = pool.stats();
+    std::printf("elastic: busy threads:%zu grown:%lu max_wait_us:%lu, idle threads:%zu shrunk:%lu\n",
+                busy.threads, busy.grown, busy.max_wait_us, idle.threads, idle.shrunk);
+    return busy.grown > 0 && idle.threads == 1 && idle.shrunk == busy.grown;
+}
+
+// 单个工作线程上同时排队的INTERACTIVE和BULK任务按8:2的比例交错执行
+// 所有INTERACTIVE任务执行完时最多执行了约1/4数目的BULK任务, BULK任务也没有被饿死
+bool checkPriority()
+{
+    constexpr int COUNT = 80;
+    ThreadPool pool(1);
+    std::mutex lock;
+    std::vector<int> order;
+    std::atomic<bool> gate(false);
+    // 先让唯一的线程阻塞, 保证两类任务都在注入队列中排队
+    pool.addTask([&gate]() {
+        while (!gate.load())
+        {
+            std::this_thread::yield();
+        }
+    });
+    for (int i = 0; i < COUNT; ++i)
+    {
+        pool.addTask([&]() { std::lock_guard<std::mutex> guard(lock); order.push_back(1); }, TaskPriority::BULK);
+    }
+    for (int i = 0; i < COUNT; ++i)
+    {
+        pool.addTask([&]() { std::lock_guard<std::mutex> guard(lock); order.push_back(0); });
+    }
+    gate.store(true);
+    while (true)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (order.size() == 2 * COUNT)
+        {
+            break;
+        }
+    }
+    int bulk_before = 0;
+    int interactive_seen = 0;
+    for (int kind : order)
+    {
+        if (kind == 0 && ++interactive_seen == COUNT)
+        {
+            break;
+        }
+        bulk_before += kind;
+    }
+    std::printf("priority: %d of %d bulk tasks ran before the last interactive task\n", bulk_before, COUNT);
+    return bulk_before > 0 && bulk_before <= COUNT / 4 + 1;
+}
+
+// 排队期间代数改变或者过期的任务不执行, 计入统计
+bool checkDiscard()
+{
+    constexpr int COUNT = 100;
+    ThreadPool pool(1);
+    std::atomic<uint32_t> generation(0);
+    std::atomic<long> ran(0);
+    std::atomic<bool> gate(false);
+    pool.addTask([&gate]() {
+        while (!gate.load())
+        {
+            std::this_thread::yield();
+        }
+    });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+    int64_t deadline_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    for (int i = 0; i < COUNT; ++i)
+    {
+        pool.addTask(Task([&ran]() { ran.fetch_add(1); }, TaskGuard{&generation, generation.load(), 0}));
+        pool.addTask(Task([&ran]() { ran.fetch_add(1); }, TaskGuard{nullptr, 0, deadline_ns}));
+        pool.addTask(Task([&ran]() { ran.fetch_add(1); }, TaskGuard{&generation, generation.load() + 1, 0}));
+    }
+    // 第一批任务的连接关闭, 第二批任务过期, 第三批任务属于复用socket的新连接
+    generation.fetch_add(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    gate.store(true);
+    ThreadPoolStats stats;
+    do
+    {
+        std::this_thread::yield();
+        stats = pool.stats();
+    } while (ran.load() + stats.cancelled + stats.expired < 3 * COUNT);
+    std::printf("discard: ran:%ld cancelled:%lu expired:%lu\n", ran.load(), stats.cancelled, stats.expired);
+    return ran.load() == COUNT && stats.cancelled == COUNT && stats.expired == COUNT;
+}
+
+// 每次向空闲的线程池提交一个任务: 线程登记为空闲后发现新任务, 同时被提交者取出唤醒
+// 唤醒必须在这次park()中消耗掉, 否则idle_中残留正在运行的线程, 空闲线程数超过线程数
+bool checkIdleWakeup()
+{
+    constexpr int THREADS = 4;
+    constexpr long ROUNDS = 100000;
+    ThreadPool pool(THREADS);
+    std::atomic<long> done(0);
+    size_t max_idle = 0;
+    for (long i = 0; i < ROUNDS; ++i)
+    {
+        pool.addTask([&done]() { done.fetch_add(1, std::memory_order_release); });
+        waitDone(done, i + 1);
+        max_idle = std::max(max_idle, pool.stats().idle);
+    }
+    // 所有线程都空闲之后每个线程恰好登记一次
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ThreadPoolStats stats = pool.stats();
+    max_idle = std::max(max_idle, stats.idle);
+    std::printf("idle wakeup: %ld rounds, max idle:%zu of %zu threads, idle at rest:%zu\n",
+                ROUNDS, max_idle, stats.threads, stats.idle);
+    return max_idle <= stats.threads && stats.idle == stats.threads;
+}
+
+// shutdown()返回后不会再有任务执行, 之后提交的任务被丢弃
+bool checkShutdown()
+{
+    ThreadPool pool(2, 4);
+    std::atomic<long> started(0);
+    for (int i = 0; i < 1000; ++i)
+    {
+        pool.addTask([&started]() {
+            started.fetch_add(1);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        });
+    }
+    pool.shutdown();
+    long after_shutdown = started.load();
+    pool.addTask([&started]() { started.fetch_add(1); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::printf("shutdown: %ld of 1000 tasks ran before shutdown\n", after_shutdown);
+    return started.load() == after_shutdown;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : 64;
+    long total = argc > 2 ? std::atol(argv[2]) : 1000000;
+
+    if (!checkNoAllocation(4))
+    {
+        std::printf("FAILED: submitting tasks allocated memory\n");
+        return 1;
+    }
+    if (!checkElastic())
+    {
+        std::printf("FAILED: pool did not grow under blocking tasks or shrink when idle\n");
+        return 1;
+    }
+    if (!checkPriority())
+    {
+        std::printf("FAILED: tasks were not taken in weighted priority order\n");
+        return 1;
+    }
+    if (!checkDiscard())
+    {
+        std::printf("FAILED: cancelled or expired tasks were not discarded\n");
+        return 1;
+    }
+    if (!checkIdleWakeup())
+    {
+        std::printf("FAILED: idle threads exceeded worker threads after repeated wakeups\n");
+        return 1;
+    }
+    if (!checkShutdown())
+    {
+        std::printf("FAILED: tasks ran after shutdown\n");
+        return 1;
+    }
+
+    std::printf("%8s %16s %16s %16s %16s %16s\n", "threads", "mutex inject/s", "steal inject/s",
+                "mutex spawn/s", "steal spawn/s", "steal batch/s");
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        double mutex_inject, steal_inject, mutex_spawn, steal_spawn, steal_batch;
+        {
+            MutexThreadPool pool(threads);
+            mutex_inject = benchInject(pool, total);
+            mutex_spawn = benchSpawn(pool, total);
+        }
+        {
+            ThreadPool pool(threads);
+            steal_inject = benchInject(pool, total);
+            steal_spawn = benchSpawn(pool, total);
+            steal_batch = benchBatch(pool, total);
+        }
+        std::printf("%8d %16.0f %16.0f %16.0f %16.0f %16.0f\n", threads, mutex_inject, steal_inject,
+                    mutex_spawn, steal_spawn, steal_batch);
+    }
+    return 0;
+}
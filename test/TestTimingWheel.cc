@@ -0,0 +1,142 @@
+// 测试分层时间轮: 先检查定时器按时到期, 刷新和修改超时时间改变到期时间, 取消后不再执行, 重复的定时器按间隔执行
+// 再对比二叉堆(TimerManager)和时间轮在大量连接不断活动时的开销:
+// 每次操作随机选择一个连接, 90%刷新超时时间(相当于一次读写事件), 10%关闭后重新建立, 每1000次操作处理一次到期定时器
+// 用法: TestTimingWheel [定时器数目, 默认60000] [操作次数, 默认10000000]
+#include <timer/TimerManager.h>
+#include <timer/TimingWheel.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+uint32_t nextRandom()
+{
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// 在时间轮上运行到没有定时器, 记录每个定时器的到期时间(相对开始的毫秒数)
+bool checkExpire()
+{
+    TimingWheel wheel;
+    int64_t begin = TimingWheel::nowMs();
+    std::vector<int64_t> fired(5, -1);
+    auto record = [&](int k) {
+        return [&, k]() { fired[k] = TimingWheel::nowMs() - begin; };
+    };
+    TimerId refreshed_id = wheel.add(50, record(0));
+    wheel.add(100, record(1));
+    wheel.add(30, record(2));
+    TimerId cancelled_id = wheel.add(5000, record(3));     // 跨过第1层, 取消后不执行
+    TimerId reset_id = wheel.add(5000, record(4));         // 改为更早到期
+    std::vector<int64_t> repeats;
+    TimerId repeat_id = wheel.add(20, [&]() { repeats.push_back(TimingWheel::nowMs() - begin); }, 20);
+    bool changed = false;
+    while (wheel.size() > 0)
+    {
+        int timeout = wheel.millisecondsToNextExpired();
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+        wheel.checkAndHandleTimer();
+        if (!changed && TimingWheel::nowMs() - begin >= 30)
+        {
+            // 30ms时第0个定时器对应的连接有活动, 从现在起重新计算50ms
+            changed = true;
+            wheel.refresh(refreshed_id);
+            wheel.cancel(cancelled_id);
+            wheel.reset(reset_id, 40);
+        }
+        if (repeats.size() == 5)
+        {
+            wheel.cancel(repeat_id);
+        }
+    }
+    // 到期或者取消后句柄失效
+    bool stale = !wheel.reset(refreshed_id, 10) && !wheel.reset(cancelled_id, 10) && wheel.size() == 0;
+    std::printf("expire: #0 %ldms (refreshed, ~80), #1 %ldms (~100), #2 %ldms (~30), #3 %ld (cancelled), "
+                "#4 %ldms (reset, ~70), repeat %zu times, last %ldms (~100)\n",
+                fired[0], fired[1], fired[2], fired[3], fired[4], repeats.size(), repeats.empty() ? -1 : repeats.back());
+    auto near = [](int64_t value, int64_t expected) { return value >= expected && value < expected + 15; };
+    return near(fired[0], 80) && near(fired[1], 100) && near(fired[2], 30) && fired[3] == -1 && near(fired[4], 70)
+           && repeats.size() == 5 && near(repeats.back(), 100) && stale;
+}
+
+// 返回每次操作的平均纳秒数
+template <typename Op>
+double bench(long ops, Op op)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (long i = 0; i < ops; ++i)
+    {
+        op(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count() / ops;
+}
+
+int main(int argc, char *argv[])
+{
+    int timers = argc > 1 ? std::atoi(argv[1]) : 60000;
+    long ops = argc > 2 ? std::atol(argv[2]) : 10000000;
+
+    if (!checkExpire())
+    {
+        std::printf("FAILED: timers did not expire on time\n");
+        return 1;
+    }
+
+    long fired = 0;
+    TimerManager heap;
+    for (int fd = 0; fd < timers; ++fd)
+    {
+        heap.add(fd, ::time(nullptr) + 60, [&fired]() { ++fired; });
+    }
+    double heap_ns = bench(ops, [&](long i) {
+        int fd = nextRandom() % timers;
+        if (nextRandom() % 10 == 0)
+        {
+            heap.cancel(fd);
+            heap.add(fd, ::time(nullptr) + 60, [&fired]() { ++fired; });
+        }
+        else
+        {
+            heap.adjustTime(fd, ::time(nullptr) + 60);
+        }
+        if (i % 1000 == 0)
+        {
+            heap.checkAndHandleTimer();
+        }
+    });
+
+    TimingWheel wheel;
+    std::vector<TimerId> ids(timers);
+    for (int fd = 0; fd < timers; ++fd)
+    {
+        ids[fd] = wheel.add(60000, [&fired]() { ++fired; });
+    }
+    double wheel_ns = bench(ops, [&](long i) {
+        int fd = nextRandom() % timers;
+        if (nextRandom() % 10 == 0)
+        {
+            wheel.cancel(ids[fd]);
+            ids[fd] = wheel.add(60000, [&fired]() { ++fired; });
+        }
+        else
+        {
+            wheel.refresh(ids[fd]);
+        }
+        if (i % 1000 == 0)
+        {
+            wheel.checkAndHandleTimer();
+        }
+    });
+
+    std::printf("%d timers, %ld ops: heap %.1f ns/op, timing wheel %.1f ns/op, fired %ld\n",
+                timers, ops, heap_ns, wheel_ns, fired);
+    return 0;
+}
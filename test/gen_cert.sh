@@ -0,0 +1,7 @@
+#!/bin/sh
+# 生成测试HTTPS使用的自签名证书, 输出到仓库根目录下的certs目录
+dir="$(cd "$(dirname "$0")/.." && pwd)/certs"
+mkdir -p "$dir"
+openssl req -x509 -newkey rsa:2048 -nodes -days 365 \
+        -subj "/CN=127.0.0.1" \
+        -keyout "$dir/server.key" -out "$dir/server.crt"